@@ -0,0 +1,137 @@
+/* Time of the exact and approximate mask strategies, and the penalty (scored exactly) of the mask each one picks
+ * gcc -O2 bench/mask_strategy_bench.c -pthread -o mask_strategy_bench */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#define ENABLE_QRCODE_LIB
+#include "../qrcode_generator.h"
+
+#define SYMBOLS_PER_VERSION 40
+#define TEXT_MAX_SIZE 3000
+
+/* Version ranges reported on their own */
+#define VERSION_RANGES 3
+const int VERSION_RANGE_LAST[VERSION_RANGES] = {9, 26, 40};
+
+double get_time_us() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec*1e6 + time.tv_nsec/1e3;
+}
+
+/* xorshift32, so that the texts are the same on every platform */
+unsigned int get_random(unsigned int *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+/* Evaluates the masks with a strategy; returns the one that would be applied (the first one with the lowest score) */
+int select_mask(mask_evaluation_t *evaluation, bool is_approximate) {
+    evaluation->is_approximate = is_approximate;
+    evaluate_masks(evaluation, false);
+    int mask = 0;
+    for (int current_mask = 1; current_mask < MASK_NUMBER; current_mask++) {
+        if (evaluation->penalties[current_mask] < evaluation->penalties[mask])
+            mask = current_mask;
+    }
+    return mask;
+}
+
+typedef struct strategy_statistics {
+    int symbols;
+    int same_masks;
+    double exact_time;
+    double approximate_time;
+    unsigned long exact_penalty;
+    unsigned long approximate_penalty;
+    unsigned int worst_penalty_loss;
+} strategy_statistics_t;
+
+void print_statistics(const char *name, const strategy_statistics_t *statistics) {
+    printf("%-10s %7d %9.2f %9.2f %7.2fx %9.1f%% %11.2f%% %11u\n", name, statistics->symbols,
+            statistics->exact_time / statistics->symbols, statistics->approximate_time / statistics->symbols, statistics->exact_time / statistics->approximate_time,
+            100.0 * statistics->same_masks / statistics->symbols,
+            100.0 * (statistics->approximate_penalty - statistics->exact_penalty) / statistics->exact_penalty, statistics->worst_penalty_loss);
+}
+
+int main() {
+    static unsigned char codewords[QRCODE_MAX_CODEWORDS];
+    static qrcode_matrix_t unmasked_qrcode;
+    static mask_evaluation_t evaluation;
+    static char text[TEXT_MAX_SIZE + 1];
+    unsigned int random_state = 2463534242u;
+    strategy_statistics_t statistics[VERSION_RANGES + 1] = {{0}};
+
+    for (int version = 1; version <= QRCODE_VERSIONS; version++) {
+        int range = 0;
+        while (version > VERSION_RANGE_LAST[range])
+            range++;
+        const version_template_t *version_template = get_version_template(version);
+        if (!version_template) { fprintf(stderr, "QRCODE ERROR: Memory Error\n"); return 1; }
+
+        for (int s = 0; s < SYMBOLS_PER_VERSION; s++) {
+            /* Printable text in Byte mode, from a few characters up to the capacity of the version */
+            qrcode_template_t qrcode_template = QRCODE_TEMPLATE_DEFAULT;
+            qrcode_template.version = version;
+            qrcode_template.correction_level = s % CORRECTION_LEVELS;
+            size_t capacity = QRCODE_INFO[version].correction_level_info[qrcode_template.correction_level].character_capacity[BYTE];
+            size_t text_size = 1 + get_random(&random_state) % (capacity < TEXT_MAX_SIZE ? capacity : TEXT_MAX_SIZE);
+            for (size_t i = 0; i < text_size; i++)
+                text[i] = ' ' + get_random(&random_state) % 95;
+            text[text_size] = '\0';
+            qrcode_template.text = text;
+
+            if (!get_data_codewords(&qrcode_template, codewords, NULL, 0))
+                return 1;
+            reed_solomon_encoder_t encoder;
+            const correction_level_related_information_t *info = &QRCODE_INFO[version].correction_level_info[qrcode_template.correction_level];
+            reed_solomon_encoder_init(&encoder, info->error_correction_codewords_per_block);
+            get_qrcode_correction_codewords(&qrcode_template, &encoder, codewords);
+            int final_codewords = info->total_codewords + info->error_correction_codewords_per_block*(info->blocks_in_group1 + info->blocks_in_group2);
+            const unsigned short *placement_map = get_placement_map(version, qrcode_template.correction_level);
+            if (!placement_map) { fprintf(stderr, "QRCODE ERROR: Memory Error\n"); return 1; }
+            populate_qrcode(&unmasked_qrcode, codewords, final_codewords, placement_map, version_template);
+
+            evaluation.unmasked_qrcode = &unmasked_qrcode;
+            evaluation.version_template = version_template;
+            evaluation.correction_level = qrcode_template.correction_level;
+
+            double start = get_time_us();
+            int exact_mask = select_mask(&evaluation, false);
+            double exact_time = get_time_us() - start;
+            unsigned int exact_penalties[MASK_NUMBER];
+            memcpy(exact_penalties, evaluation.penalties, sizeof(exact_penalties));
+
+            start = get_time_us();
+            int approximate_mask = select_mask(&evaluation, true);
+            double approximate_time = get_time_us() - start;
+
+            /* The approximate pick is scored with the exact penalty */
+            unsigned int penalty_loss = exact_penalties[approximate_mask] - exact_penalties[exact_mask];
+            strategy_statistics_t *range_statistics[2] = {&statistics[range], &statistics[VERSION_RANGES]};
+            for (int r = 0; r < 2; r++) {
+                range_statistics[r]->symbols++;
+                range_statistics[r]->same_masks += exact_mask == approximate_mask;
+                range_statistics[r]->exact_time += exact_time;
+                range_statistics[r]->approximate_time += approximate_time;
+                range_statistics[r]->exact_penalty += exact_penalties[exact_mask];
+                range_statistics[r]->approximate_penalty += exact_penalties[approximate_mask];
+                if (penalty_loss > range_statistics[r]->worst_penalty_loss)
+                    range_statistics[r]->worst_penalty_loss = penalty_loss;
+            }
+        }
+    }
+
+    printf("%-10s %7s %9s %9s %8s %10s %12s %11s\n", "versions", "symbols", "exact us", "approx us", "speedup", "same mask", "penalty loss", "worst loss");
+    for (int range = 0; range < VERSION_RANGES; range++) {
+        char name[16];
+        snprintf(name, sizeof(name), "%d-%d", range == 0 ? 1 : VERSION_RANGE_LAST[range - 1] + 1, VERSION_RANGE_LAST[range]);
+        print_statistics(name, &statistics[range]);
+    }
+    print_statistics("all", &statistics[VERSION_RANGES]);
+    return 0;
+}
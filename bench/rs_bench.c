@@ -0,0 +1,140 @@
+/* Time of the Reed-Solomon kernels on the blocks of a version 40-H symbol, against the polynomial division they replaced
+ * gcc -O2 bench/rs_bench.c -pthread -o rs_bench */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#define ENABLE_QRCODE_LIB
+#include "../qrcode_generator.h"
+
+#define RUNS 20000
+
+double get_time_us() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec*1e6 + time.tv_nsec/1e3;
+}
+
+/* The previous encoder: the generator (exponents of alpha) is shifted along the whole message and subtracted from it */
+void get_correction_words_by_division(const unsigned char message_polynomial[], int message_size, const unsigned char generator_polynomial[], int generator_polynomial_size, unsigned char destination[]) {
+    int pol_dim = message_size + generator_polynomial_size - 1;
+    unsigned char polynomial[pol_dim];
+    unsigned char temp_polynomial[pol_dim];
+
+    for (int i = 0; i < pol_dim; i++) {
+        temp_polynomial[i] = i < generator_polynomial_size ? generator_polynomial[i] : 0;
+        polynomial[i] = i < message_size ? message_polynomial[i] : 0;
+    }
+
+    for (int i = 0; i < message_size; i++) {
+        if (polynomial[i] != 0) {
+            int lead_exponent = GF_LOG_TABLE[polynomial[i]];
+            for (int j = i; j < i + generator_polynomial_size; j++)
+                polynomial[j] ^= GF_EXP_TABLE[temp_polynomial[j] + lead_exponent];
+        }
+        for (int j = pol_dim - 1; j > 0; j--)
+            temp_polynomial[j] = temp_polynomial[j-1];
+        temp_polynomial[0] = 0;
+    }
+
+    memcpy(destination, polynomial + message_size, generator_polynomial_size - 1);
+}
+
+/* Data codewords of every block of the symbol, and where their correction codewords go */
+typedef struct symbol_blocks {
+    const correction_level_related_information_t *info;
+    int blocks_number;
+    unsigned char data[QRCODE_MAX_CODEWORDS];
+    const unsigned char *messages[QRCODE_MAX_CODEWORDS];
+    int message_sizes[QRCODE_MAX_CODEWORDS];
+    unsigned char *destinations[QRCODE_MAX_CODEWORDS];
+    unsigned char correction[QRCODE_MAX_CODEWORDS];
+} symbol_blocks_t;
+
+void symbol_blocks_init(symbol_blocks_t *blocks, int version, enum CORRECTION_LEVEL correction_level) {
+    blocks->info = &QRCODE_INFO[version].correction_level_info[correction_level];
+    blocks->blocks_number = blocks->info->blocks_in_group1 + blocks->info->blocks_in_group2;
+    for (int i = 0; i < QRCODE_MAX_CODEWORDS; i++)
+        blocks->data[i] = i*37 + 11;
+    int offset = 0;
+    for (int block = 0; block < blocks->blocks_number; block++) {
+        blocks->messages[block] = blocks->data + offset;
+        blocks->message_sizes[block] = block < blocks->info->blocks_in_group1 ? blocks->info->data_codewords_per_block_in_group1 : blocks->info->data_codewords_per_block_in_group2;
+        blocks->destinations[block] = blocks->correction + block*blocks->info->error_correction_codewords_per_block;
+        offset += blocks->message_sizes[block];
+    }
+}
+
+bool is_kernel_supported(enum RS_KERNEL kernel) {
+#ifdef QRCODE_X86_SIMD
+    if (kernel == RS_KERNEL_AVX2)
+        return __builtin_cpu_supports("avx2");
+    if (kernel == RS_KERNEL_SSSE3)
+        return __builtin_cpu_supports("ssse3");
+#endif
+    return kernel == RS_KERNEL_SCALAR;
+}
+
+int main() {
+    static symbol_blocks_t blocks;
+    symbol_blocks_init(&blocks, 40, HIGH);
+    int correction_codewords = blocks.info->error_correction_codewords_per_block;
+    size_t correction_size = blocks.blocks_number * correction_codewords;
+    unsigned char expected[QRCODE_MAX_CODEWORDS];
+    volatile unsigned char sink = 0;
+
+    printf("Version 40-H: %d blocks of %d and %d data codewords, %d correction codewords, %d runs\n", blocks.blocks_number,
+            blocks.info->data_codewords_per_block_in_group1, blocks.info->data_codewords_per_block_in_group2, correction_codewords, RUNS);
+
+    double start = get_time_us();
+    for (int run = 0; run < RUNS; run++) {
+        for (int block = 0; block < blocks.blocks_number; block++)
+            get_correction_words_by_division(blocks.messages[block], blocks.message_sizes[block], get_generator_polynomial(correction_codewords), correction_codewords + 1, expected + block*correction_codewords);
+        sink ^= expected[run % correction_size];
+    }
+    double division_time = (get_time_us() - start) / RUNS;
+    printf("%-22s %8.2f us/symbol\n", "polynomial division", division_time);
+
+    const char *KERNEL_NAMES[] = {"scalar", "ssse3", "avx2"};
+    bool is_valid = true;
+    for (enum RS_KERNEL kernel = RS_KERNEL_SCALAR; kernel <= RS_KERNEL_AVX2; kernel++) {
+        if (!is_kernel_supported(kernel)) {
+            printf("%-22s not supported by this cpu\n", KERNEL_NAMES[kernel]);
+            continue;
+        }
+        reed_solomon_encoder_t encoder;
+        reed_solomon_encoder_init(&encoder, correction_codewords);
+        encoder.kernel = kernel;
+
+        /* One block at a time, as get_correction_words is called */
+        memset(blocks.correction, 0, sizeof(blocks.correction));
+        start = get_time_us();
+        for (int run = 0; run < RUNS; run++) {
+            for (int block = 0; block < blocks.blocks_number; block++)
+                get_correction_words(&encoder, blocks.messages[block], blocks.message_sizes[block], blocks.destinations[block]);
+            sink ^= blocks.correction[run % correction_size];
+        }
+        double kernel_time = (get_time_us() - start) / RUNS;
+        bool is_same = !memcmp(blocks.correction, expected, correction_size);
+        printf("%-22s %8.2f us/symbol, %5.1fx%s\n", KERNEL_NAMES[kernel], kernel_time, division_time / kernel_time, is_same ? "" : " MISMATCH");
+        is_valid = is_valid && is_same;
+
+        /* The blocks of each group side by side, as get_qrcode_correction_codewords does */
+        if (kernel == RS_KERNEL_SCALAR)
+            continue;
+        memset(blocks.correction, 0, sizeof(blocks.correction));
+        int blocks1 = blocks.info->blocks_in_group1;
+        start = get_time_us();
+        for (int run = 0; run < RUNS; run++) {
+            get_correction_words_batch(&encoder, blocks.messages, blocks.message_sizes[0], blocks1, blocks.destinations);
+            get_correction_words_batch(&encoder, blocks.messages + blocks1, blocks.message_sizes[blocks1], blocks.blocks_number - blocks1, blocks.destinations + blocks1);
+            sink ^= blocks.correction[run % correction_size];
+        }
+        kernel_time = (get_time_us() - start) / RUNS;
+        is_same = !memcmp(blocks.correction, expected, correction_size);
+        printf("%-22s %8.2f us/symbol, %5.1fx%s\n", kernel == RS_KERNEL_AVX2 ? "avx2 batch" : "ssse3 batch", kernel_time, division_time / kernel_time, is_same ? "" : " MISMATCH");
+        is_valid = is_valid && is_same;
+    }
+    return is_valid ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+/* Size and time of the SVG output of a version 40 qrcode, against naive SVGs with one rect per module
+ * gcc -O2 bench/svg_bench.c -pthread -o svg_bench */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#define ENABLE_QRCODE_LIB
+#include "../qrcode_generator.h"
+
+#define RUNS 200
+
+double get_time_us() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec*1e6 + time.tv_nsec/1e3;
+}
+
+/* One rect for every module of the rendered symbol (quiet zone included) */
+bool render_svg_all_modules(qrcode_t qrcode, qrcode_render_options_t options, unsigned char **destination, size_t *destination_size) {
+    int qrcode_size = qrcode.size - 2*QRCODE_PADDING;
+    int modules = get_rendered_size(qrcode, options.quiet_zone);
+    byte_buffer_t svg = BYTE_BUFFER_EMPTY;
+    byte_buffer_append_format(&svg, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" viewBox=\"0 0 %d %d\" shape-rendering=\"crispEdges\">",
+            modules*options.scale, modules*options.scale, modules, modules);
+    for (int i = 0; i < modules; i++) {
+        for (int j = 0; j < modules; j++) {
+            int row = i - options.quiet_zone, column = j - options.quiet_zone;
+            bool is_symbol = row >= 0 && row < qrcode_size && column >= 0 && column < qrcode_size;
+            int module = get_qrcode_module(qrcode, is_symbol ? row + QRCODE_PADDING : 0, is_symbol ? column + QRCODE_PADDING : 0);
+            byte_buffer_append_format(&svg, "<rect x=\"%d\" y=\"%d\" width=\"1\" height=\"1\" fill=\"%s\"/>", j, i, module == QRCODE_WHITE ? "#fff" : "#000");
+        }
+    }
+    byte_buffer_append_format(&svg, "</svg>\n");
+    *destination = svg.data;
+    *destination_size = svg.size;
+    return svg.is_valid;
+}
+
+/* A background rect, then one rect for every module of the other color */
+bool render_svg_dark_modules(qrcode_t qrcode, qrcode_render_options_t options, unsigned char **destination, size_t *destination_size) {
+    int qrcode_size = qrcode.size - 2*QRCODE_PADDING;
+    int modules = get_rendered_size(qrcode, options.quiet_zone);
+    int background = get_qrcode_module(qrcode, 0, 0);
+    byte_buffer_t svg = BYTE_BUFFER_EMPTY;
+    byte_buffer_append_format(&svg, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" viewBox=\"0 0 %d %d\" shape-rendering=\"crispEdges\">"
+            "<rect width=\"%d\" height=\"%d\" fill=\"%s\"/>",
+            modules*options.scale, modules*options.scale, modules, modules, modules, modules, background == QRCODE_WHITE ? "#fff" : "#000");
+    for (int i = 0; i < qrcode_size; i++) {
+        for (int j = 0; j < qrcode_size; j++) {
+            if (get_qrcode_module(qrcode, i + QRCODE_PADDING, j + QRCODE_PADDING) != background)
+                byte_buffer_append_format(&svg, "<rect x=\"%d\" y=\"%d\" width=\"1\" height=\"1\" fill=\"%s\"/>",
+                        j + options.quiet_zone, i + options.quiet_zone, background == QRCODE_WHITE ? "#000" : "#fff");
+        }
+    }
+    byte_buffer_append_format(&svg, "</svg>\n");
+    *destination = svg.data;
+    *destination_size = svg.size;
+    return svg.is_valid;
+}
+
+typedef bool (*svg_renderer_t)(qrcode_t qrcode, qrcode_render_options_t options, unsigned char **destination, size_t *destination_size);
+
+bool run_benchmark(const char *name, svg_renderer_t renderer, qrcode_t qrcode) {
+    unsigned char *svg = NULL;
+    size_t svg_size = 0;
+    double start = get_time_us();
+    for (int i = 0; i < RUNS; i++) {
+        free(svg);
+        if (!renderer(qrcode, QRCODE_RENDER_OPTIONS_DEFAULT, &svg, &svg_size)) { fprintf(stderr, "QRCODE ERROR: %s failed\n", name); return false; }
+    }
+    printf("%-28s %9zu bytes %9.1f us\n", name, svg_size, (get_time_us() - start) / RUNS);
+    free(svg);
+    return true;
+}
+
+int main() {
+    qrcode_template_t qrcode_template = QRCODE_TEMPLATE_DEFAULT;
+    qrcode_template.text = "https://example.com/labels/0000000000";
+    qrcode_template.version = 40;
+    qrcode_template.correction_level = HIGH;
+    qrcode_t qrcode = generate_qrcode(qrcode_template);
+    if (!is_qrcode_valid(qrcode))
+        return 1;
+
+    printf("Version 40-H, %d runs\n", RUNS);
+    bool is_valid = run_benchmark("render_svg (merged paths)", render_svg, qrcode) &&
+        run_benchmark("one rect per module", render_svg_all_modules, qrcode) &&
+        run_benchmark("one rect per dark module", render_svg_dark_modules, qrcode);
+    free(qrcode.data);
+    return is_valid ? 0 : 1;
+}
@@ -1,3 +1,5 @@
+/* getline is POSIX 2008 */
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,12 +10,215 @@ void print_help() {
     printf("help: [parameters] inputfile\n"
             "-v [version (1-40)] (default: depends on input size)\n"
             "-c [correction (0: Low, 1: Medium, 2: Quartile, 3: High)] (default: 0)\n"
+            "--max-correction (raise the correction to the highest level that still fits in the version)\n"
             "-m [mask (0-7)] (default: best)\n"
-            "-o [filename] (print to ppm file instead of to the terminal)\n"
-            "-e [encoding (0: Numeric, 1: Alphanumeric, 2: Byte, 3: Kanji)] (default: 2)\n"
+            "-s [mask selection (0: Exact, 1: Approximate, 2: Fixed)] (default: 0, 2 if -m is given; 0 and 1 can't be used with -m)\n"
+            "-o [filename] (print to image file instead of to the terminal: pbm, png or svg if the name ends with .pbm, .png or .svg, else ppm;\n"
+            "    a .qra name is an archive, that takes all the qrcodes of a batch)\n"
+            "--scale [pixels per module (1-100)] (default: 10)\n"
+            "--quiet-zone [modules (0-100)] (default: 4)\n"
+            "--color (terminal: white on black with ANSI colors, whatever the terminal theme)\n"
+            "-e [encoding (0: Numeric, 1: Alphanumeric, 2: Byte, 3: Kanji, 4: Mixed, the segments of the modes that take the fewest bits, 5: Auto, the single mode that takes the fewest bits)] (default: 2)\n"
             "--negative (invert colors)\n"
             "--iso (use ISO-8859-1 instead of UTF-8 in Byte mode for compatibility)\n"
-            "-d (debug: more info on qrcode process)\n");
+            "--parallel-masks (evaluate the masks on multiple threads)\n"
+            "-d (debug: more info on qrcode process)\n"
+            "-b [file] (batch: one qrcode per record of the file, - for stdin; -o takes a pattern like out_%%06d.ppm)\n"
+            "--length-prefixed (batch records are a 4 bytes big endian length followed by the text, instead of lines)\n"
+            "--overrides (batch records can start with a column like v5,c2,m3 followed by a tab, to change version, correction and mask)\n");
+}
+
+/* Output type of an image file, from the extension of its name */
+enum OUTPUT_TYPE get_file_output_type(const char *file_name) {
+    const char *extension = strrchr(file_name, '.');
+    if (extension && !strcmp(extension, ".pbm"))
+        return FILE_PBM;
+    if (extension && !strcmp(extension, ".png"))
+        return FILE_PNG;
+    if (extension && !strcmp(extension, ".svg"))
+        return FILE_SVG;
+    return FILE_PPM;
+}
+
+/* Returns true if the output file is an archive of qrcodes */
+bool is_archive_file(const char *file_name) {
+    const char *extension = file_name ? strrchr(file_name, '.') : NULL;
+    return extension && !strcmp(extension, ".qra");
+}
+
+enum RECORD_STATUS {RECORD_READ, RECORD_END, RECORD_ERROR};
+
+/* Reads the next batch record into a growable buffer (NULL terminated). A truncated record, a record with a NUL character (the text would be cut there),
+ * a read error or a memory error is an error (printed with the record number); the batch can't go on after it */
+enum RECORD_STATUS read_record(FILE *input, bool length_prefixed, int record_number, char **record, size_t *record_capacity) {
+    size_t length = 0;
+    if (length_prefixed) {
+        unsigned char prefix[4];
+        size_t prefix_read = fread(prefix, 1, sizeof(prefix), input);
+        if (prefix_read == 0 && !ferror(input))
+            return RECORD_END;
+        if (prefix_read != sizeof(prefix)) {
+            fprintf(stderr, "QRCODE ERROR: Record %d is truncated (incomplete length)\n", record_number);
+            return RECORD_ERROR;
+        }
+        length = (size_t) prefix[0] << 24 | (size_t) prefix[1] << 16 | (size_t) prefix[2] << 8 | prefix[3];
+        if (length + 1 > *record_capacity) {
+            char *grown = realloc(*record, length + 1);
+            if (!grown) {
+                fprintf(stderr, "QRCODE ERROR: Memory Error in record %d\n", record_number);
+                return RECORD_ERROR;
+            }
+            *record = grown;
+            *record_capacity = length + 1;
+        }
+        if (fread(*record, 1, length, input) != length) {
+            fprintf(stderr, "QRCODE ERROR: Record %d is truncated (%zu bytes expected)\n", record_number, length);
+            return RECORD_ERROR;
+        }
+    } else {
+        ssize_t read = getline(record, record_capacity, input);
+        if (read < 0) {
+            if (feof(input) && !ferror(input))
+                return RECORD_END;
+            fprintf(stderr, "QRCODE ERROR: Can't read record %d\n", record_number);
+            return RECORD_ERROR;
+        }
+        length = read;
+        while (length > 0 && ((*record)[length - 1] == '\n' || (*record)[length - 1] == '\r'))
+            length--;
+    }
+    if (memchr(*record, '\0', length)) {
+        fprintf(stderr, "QRCODE ERROR: Record %d contains a NUL character\n", record_number);
+        return RECORD_ERROR;
+    }
+    (*record)[length] = '\0';
+    return RECORD_READ;
+}
+
+/* Applies the overrides column of a record (comma separated v[version], c[correction], m[mask]); returns false if it is not valid */
+bool apply_overrides(qrcode_template_t *qrcode_template, char *overrides) {
+    for (char *item = strtok(overrides, ","); item; item = strtok(NULL, ",")) {
+        char *end;
+        long value = strtol(item + 1, &end, 10);
+        if (end == item + 1 || *end != '\0')
+            return false;
+        switch (item[0]) {
+            case 'v':
+                if (value < 1 || value > QRCODE_VERSIONS)
+                    return false;
+                qrcode_template->version = value;
+                break;
+            case 'c':
+                if (value < LOW || value > HIGH)
+                    return false;
+                qrcode_template->correction_level = value;
+                break;
+            case 'm':
+                if (value < 0 || value >= MASK_NUMBER)
+                    return false;
+                qrcode_template->mask = value;
+                qrcode_template->mask_strategy = MASK_FIXED;
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+/* Returns true if the output pattern has exactly one integer conversion (like %d or %06d) and no other one except %% */
+bool is_output_pattern_valid(const char *pattern) {
+    int conversions = 0;
+    for (const char *c = pattern; *c; c++) {
+        if (*c != '%')
+            continue;
+        c++;
+        if (*c == '%')
+            continue;
+        while (*c >= '0' && *c <= '9')
+            c++;
+        if (*c != 'd')
+            return false;
+        conversions++;
+    }
+    return conversions == 1;
+}
+
+/* Generates a qrcode for every record of the batch input, with the given template; returns the exit status */
+int run_batch(qrcode_template_t qrcode_template, const char *batch_file_name, bool length_prefixed, bool has_overrides, enum OUTPUT_TYPE output_type, const char *output_pattern, qrcode_render_options_t render_options) {
+    /* All qrcodes go in one archive, or in a file each */
+    bool is_archive = is_archive_file(output_pattern);
+    if (output_type != TERMINAL && !is_archive && !is_output_pattern_valid(output_pattern)) {
+        fprintf(stderr, "QRCODE ERROR: Output pattern must contain one integer conversion (like %%06d)\n");
+        return 1;
+    }
+
+    FILE *input = strcmp(batch_file_name, "-") ? fopen(batch_file_name, "rb") : stdin;
+    if (!input) {
+        fprintf(stderr, "QRCODE ERROR: Can't open batch file %s\n", batch_file_name);
+        return 1;
+    }
+    qrcode_archive_writer_t archive;
+    if (is_archive && !qrcode_archive_open(&archive, output_pattern)) {
+        if (input != stdin)
+            fclose(input);
+        return 1;
+    }
+
+    int status = 0;
+    char *record = NULL;
+    size_t record_capacity = 0;
+    char file_name[FILENAME_MAX];
+    for (int record_number = 0; ; record_number++) {
+        enum RECORD_STATUS record_status = read_record(input, length_prefixed, record_number, &record, &record_capacity);
+        if (record_status == RECORD_ERROR)
+            status = 1;
+        if (record_status != RECORD_READ)
+            break;
+
+        qrcode_template_t record_template = qrcode_template;
+        record_template.text = record;
+        /* The overrides column is optional: a record without a tab is all text and uses the shared template */
+        char *separator = has_overrides ? strchr(record, '\t') : NULL;
+        if (separator) {
+            *separator = '\0';
+            record_template.text = separator + 1;
+            if (!apply_overrides(&record_template, record)) {
+                fprintf(stderr, "QRCODE ERROR: Invalid overrides in record %d\n", record_number);
+                if (is_archive)
+                    qrcode_archive_append_empty(&archive);
+                status = 1;
+                continue;
+            }
+        }
+
+        qrcode_t qrcode = generate_qrcode(record_template);
+        if (!is_qrcode_valid(qrcode)) {
+            fprintf(stderr, "QRCODE ERROR: Record %d not generated\n", record_number);
+            if (is_archive)
+                qrcode_archive_append_empty(&archive);
+            status = 1;
+            continue;
+        }
+        if (is_archive) {
+            if (!qrcode_archive_append(&archive, qrcode, record_template.text))
+                status = 1;
+            free(qrcode.data);
+            continue;
+        }
+        if (output_type != TERMINAL)
+            snprintf(file_name, sizeof(file_name), output_pattern, record_number);
+        if (!print_matrix_with_options(qrcode, output_type, output_type != TERMINAL ? file_name : NULL, render_options))
+            status = 1;
+        free(qrcode.data);
+    }
+
+    free(record);
+    if (input != stdin)
+        fclose(input);
+    if (is_archive && !qrcode_archive_close(&archive))
+        status = 1;
+    return status;
 }
 
 int main(int argc, char **argv) {
@@ -23,6 +228,12 @@ int main(int argc, char **argv) {
     /* Output type */
     enum OUTPUT_TYPE output_type = TERMINAL;
     char *file_name = NULL;
+    qrcode_render_options_t render_options = QRCODE_RENDER_OPTIONS_DEFAULT;
+    /* Batch input (NULL if a single qrcode is generated from the text) */
+    char *batch_file_name = NULL;
+    bool length_prefixed = false;
+    bool has_overrides = false;
+    bool is_mask_strategy_given = false;
 
     /* argv handling */
     for (int argv_count = 1; argv_count < argc; argv_count++) {
@@ -52,33 +263,86 @@ int main(int argc, char **argv) {
                 if (qrcode_template.mask < 0 || qrcode_template.mask >= MASK_NUMBER)
                     qrcode_template.mask = MASK_ANY;
             }
+        } else if (!strcmp(argv[argv_count], "-s")) {
+            argv_count++;
+            if (argv_count < argc) {
+                is_mask_strategy_given = true;
+                qrcode_template.mask_strategy = atoi(argv[argv_count]);
+                if (qrcode_template.mask_strategy < MASK_EXACT || qrcode_template.mask_strategy > MASK_FIXED)
+                    qrcode_template.mask_strategy = MASK_EXACT;
+            }
         } else if (!strcmp(argv[argv_count], "-o")) {
             argv_count++;
             if (argv_count < argc) {
-                output_type = FILE_PPM;
                 file_name = argv[argv_count];
+                output_type = get_file_output_type(file_name);
             }
+        } else if (!strcmp(argv[argv_count], "--scale")) {
+            argv_count++;
+            if (argv_count < argc)
+                render_options.scale = atoi(argv[argv_count]);
+        } else if (!strcmp(argv[argv_count], "--color")) {
+            render_options.terminal_color = true;
+        } else if (!strcmp(argv[argv_count], "--quiet-zone")) {
+            argv_count++;
+            if (argv_count < argc)
+                render_options.quiet_zone = atoi(argv[argv_count]);
         } else if (!strcmp(argv[argv_count], "-e")) {
             argv_count++;
             if (argv_count < argc) {
                 qrcode_template.encoding_mode = atoi(argv[argv_count]);
-                if (qrcode_template.encoding_mode < NUMERIC || qrcode_template.encoding_mode > KANJI)
+                if (qrcode_template.encoding_mode < NUMERIC || qrcode_template.encoding_mode > ENCODING_AUTO)
                     qrcode_template.encoding_mode = BYTE;
             }
+        } else if (!strcmp(argv[argv_count], "-b")) {
+            argv_count++;
+            if (argv_count < argc)
+                batch_file_name = argv[argv_count];
+        } else if (!strcmp(argv[argv_count], "--length-prefixed")) {
+            length_prefixed = true;
+        } else if (!strcmp(argv[argv_count], "--overrides")) {
+            has_overrides = true;
+        } else if (!strcmp(argv[argv_count], "--max-correction")) {
+            qrcode_template.maximize_correction_level = true;
         } else if (!strcmp(argv[argv_count], "--negative")) {
             qrcode_template.negative = true;
         } else if (!strcmp(argv[argv_count], "--iso")) {
             qrcode_template.iso = true;
+        } else if (!strcmp(argv[argv_count], "--parallel-masks")) {
+            qrcode_template.parallel_masks = true;
         } else {
             qrcode_template.text = argv[argv_count];
         }
     }
 
+    /* A given mask is a fixed mask: a strategy that chooses the mask would be ignored */
+    if (qrcode_template.mask != MASK_ANY) {
+        if (is_mask_strategy_given && qrcode_template.mask_strategy != MASK_FIXED) {
+            fprintf(stderr, "QRCODE ERROR: Input error, mask selection %d can't be used with a given mask (-m)\n", qrcode_template.mask_strategy);
+            return 1;
+        }
+        qrcode_template.mask_strategy = MASK_FIXED;
+    }
+
+    if (batch_file_name)
+        return run_batch(qrcode_template, batch_file_name, length_prefixed, has_overrides, output_type, file_name, render_options);
+
     qrcode_t qrcode = generate_qrcode(qrcode_template);
     if (!is_qrcode_valid(qrcode))
         return 1;
 
-    print_matrix(qrcode, output_type, file_name);
+    bool is_printed;
+    if (is_archive_file(file_name)) {
+        qrcode_archive_writer_t archive;
+        is_printed = qrcode_archive_open(&archive, file_name);
+        if (is_printed) {
+            is_printed = qrcode_archive_append(&archive, qrcode, qrcode_template.text);
+            is_printed &= qrcode_archive_close(&archive);
+        }
+    } else {
+        is_printed = print_matrix_with_options(qrcode, output_type, file_name, render_options);
+    }
+    free(qrcode.data);
 
-    return 0;
+    return is_printed ? 0 : 1;
 }
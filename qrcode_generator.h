@@ -6,10 +6,33 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
-#include <math.h>
-#include <iconv.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+/* x86 vector kernels are selected at runtime (define QRCODE_DISABLE_SIMD to only use the portable code) */
+#if !defined(QRCODE_DISABLE_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define QRCODE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/* Work can be spread on POSIX threads (define QRCODE_DISABLE_THREADS to always run on the calling thread) */
+#ifndef QRCODE_DISABLE_THREADS
+#define QRCODE_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+/* Archives can be read through mmap on POSIX systems */
+#if defined(__unix__) || defined(__APPLE__)
+#define QRCODE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #define BITS_PER_BYTE 8
 
@@ -19,28 +42,39 @@
 /* Padding around the qrcode (white cells) */
 #define QRCODE_PADDING 4
 
-/* qrcode cell */
-#define LOCKED 1
-#define UNLOCKED 0
-typedef struct cell {
-    unsigned char value;
-    bool locked;
-} cell_t;
-
-enum OUTPUT_TYPE {TERMINAL, FILE_PPM};
+enum OUTPUT_TYPE {TERMINAL, FILE_PPM, FILE_PBM, FILE_PNG, FILE_SVG};
 
 #define QRCODE_VERSIONS 40
 #define VERSION_ANY 0
 
+/* qrcode matrix: two bit planes, the module values and the function pattern modules (locked, data can't go there).
+ * Every row is padded to whole 64 bits words; module j of a row is bit (j % 64) of word (j / 64) */
+#define LOCKED 1
+#define UNLOCKED 0
+#define QRCODE_MAX_SIZE 177
+#define QRCODE_MATRIX_WORD_BITS 64
+#define QRCODE_MATRIX_MAX_WORDS_PER_ROW ((QRCODE_MAX_SIZE + QRCODE_MATRIX_WORD_BITS - 1) / QRCODE_MATRIX_WORD_BITS)
+typedef struct qrcode_matrix {
+    int size;
+    int words_per_row;
+    uint64_t value[QRCODE_MAX_SIZE * QRCODE_MATRIX_MAX_WORDS_PER_ROW];
+    uint64_t function[QRCODE_MAX_SIZE * QRCODE_MATRIX_MAX_WORDS_PER_ROW];
+} qrcode_matrix_t;
+
 #define CORRECTION_LEVELS 4
 enum CORRECTION_LEVEL {LOW, MEDIUM, QUARTILE, HIGH};
 
 #define ENCODING_MODES 4
-enum ENCODING_MODE {NUMERIC, ALPHANUMERIC, BYTE, KANJI};
+/* MIXED and AUTO are not modes of their own: with MIXED the text is split in segments of the other modes, the ones that take the fewest bits;
+ * with AUTO the whole text goes in the mode with the fewest bits that can encode it */
+enum ENCODING_MODE {NUMERIC, ALPHANUMERIC, BYTE, KANJI, MIXED, ENCODING_AUTO};
 
 #define MASK_NUMBER 8
 #define MASK_ANY -1
 
+/* How the mask is chosen: the lowest penalty of all masks, the lowest estimated penalty (cheaper, rule 3 is skipped) or the template mask */
+enum MASK_STRATEGY {MASK_EXACT, MASK_APPROXIMATE, MASK_FIXED};
+
 /* Bits used in text computation */
 #define NUMERIC_3_CHARACTER_SIZE 10
 #define NUMERIC_2_CHARACTER_SIZE 7
@@ -54,47 +88,178 @@ enum ENCODING_MODE {NUMERIC, ALPHANUMERIC, BYTE, KANJI};
 
 /* Encoding modes */
 #define MODE_INDICATOR_SIZE 4
-const unsigned char MODE_INDICATOR[ENCODING_MODES][MODE_INDICATOR_SIZE] = { {0, 0, 0, 1}, {0, 0, 1, 0}, {0, 1, 0, 0}, {1, 0, 0, 0}, };
+const unsigned char MODE_INDICATOR[ENCODING_MODES] = {0x1, 0x2, 0x4, 0x8};
+const char *ENCODING_MODE_NAMES[ENCODING_MODES] = {"NUMERIC", "ALPHANUMERIC", "BYTE", "KANJI"};
 
 /* Terminator max possible size */
 #define TERMINATOR_MAX_SIZE 4
 /* Filler characters to add to data after the input if space is still not filled */
 const int FILLER_CHARACTERS[] = {236, 17};
 
-/* Lookup tables for correction computation */
-#define LOOKUPTABLE_SIZE 256
-int log_lookup_table[LOOKUPTABLE_SIZE];
-int log_reverse_lookup_table[LOOKUPTABLE_SIZE];
+/* Galois field GF(256) arithmetic (primitive polynomial 285), used for the correction computation.
+ * The exponential table is doubled so that the sum of two logarithms never needs a modulo. */
+#define GF_SIZE 256
+#define GF_ORDER 255
+const unsigned char GF_EXP_TABLE[2*GF_SIZE] = {
+      1,   2,   4,   8,  16,  32,  64, 128,  29,  58, 116, 232, 205, 135,  19,  38,
+     76, 152,  45,  90, 180, 117, 234, 201, 143,   3,   6,  12,  24,  48,  96, 192,
+    157,  39,  78, 156,  37,  74, 148,  53, 106, 212, 181, 119, 238, 193, 159,  35,
+     70, 140,   5,  10,  20,  40,  80, 160,  93, 186, 105, 210, 185, 111, 222, 161,
+     95, 190,  97, 194, 153,  47,  94, 188, 101, 202, 137,  15,  30,  60, 120, 240,
+    253, 231, 211, 187, 107, 214, 177, 127, 254, 225, 223, 163,  91, 182, 113, 226,
+    217, 175,  67, 134,  17,  34,  68, 136,  13,  26,  52, 104, 208, 189, 103, 206,
+    129,  31,  62, 124, 248, 237, 199, 147,  59, 118, 236, 197, 151,  51, 102, 204,
+    133,  23,  46,  92, 184, 109, 218, 169,  79, 158,  33,  66, 132,  21,  42,  84,
+    168,  77, 154,  41,  82, 164,  85, 170,  73, 146,  57, 114, 228, 213, 183, 115,
+    230, 209, 191,  99, 198, 145,  63, 126, 252, 229, 215, 179, 123, 246, 241, 255,
+    227, 219, 171,  75, 150,  49,  98, 196, 149,  55, 110, 220, 165,  87, 174,  65,
+    130,  25,  50, 100, 200, 141,   7,  14,  28,  56, 112, 224, 221, 167,  83, 166,
+     81, 162,  89, 178, 121, 242, 249, 239, 195, 155,  43,  86, 172,  69, 138,   9,
+     18,  36,  72, 144,  61, 122, 244, 245, 247, 243, 251, 235, 203, 139,  11,  22,
+     44,  88, 176, 125, 250, 233, 207, 131,  27,  54, 108, 216, 173,  71, 142,   1,
+      2,   4,   8,  16,  32,  64, 128,  29,  58, 116, 232, 205, 135,  19,  38,  76,
+    152,  45,  90, 180, 117, 234, 201, 143,   3,   6,  12,  24,  48,  96, 192, 157,
+     39,  78, 156,  37,  74, 148,  53, 106, 212, 181, 119, 238, 193, 159,  35,  70,
+    140,   5,  10,  20,  40,  80, 160,  93, 186, 105, 210, 185, 111, 222, 161,  95,
+    190,  97, 194, 153,  47,  94, 188, 101, 202, 137,  15,  30,  60, 120, 240, 253,
+    231, 211, 187, 107, 214, 177, 127, 254, 225, 223, 163,  91, 182, 113, 226, 217,
+    175,  67, 134,  17,  34,  68, 136,  13,  26,  52, 104, 208, 189, 103, 206, 129,
+     31,  62, 124, 248, 237, 199, 147,  59, 118, 236, 197, 151,  51, 102, 204, 133,
+     23,  46,  92, 184, 109, 218, 169,  79, 158,  33,  66, 132,  21,  42,  84, 168,
+     77, 154,  41,  82, 164,  85, 170,  73, 146,  57, 114, 228, 213, 183, 115, 230,
+    209, 191,  99, 198, 145,  63, 126, 252, 229, 215, 179, 123, 246, 241, 255, 227,
+    219, 171,  75, 150,  49,  98, 196, 149,  55, 110, 220, 165,  87, 174,  65, 130,
+     25,  50, 100, 200, 141,   7,  14,  28,  56, 112, 224, 221, 167,  83, 166,  81,
+    162,  89, 178, 121, 242, 249, 239, 195, 155,  43,  86, 172,  69, 138,   9,  18,
+     36,  72, 144,  61, 122, 244, 245, 247, 243, 251, 235, 203, 139,  11,  22,  44,
+     88, 176, 125, 250, 233, 207, 131,  27,  54, 108, 216, 173,  71, 142,   1,   2
+};
+const unsigned char GF_LOG_TABLE[GF_SIZE] = { /* log(0) is undefined, kept as 0 */
+      0,   0,   1,  25,   2,  50,  26, 198,   3, 223,  51, 238,  27, 104, 199,  75,
+      4, 100, 224,  14,  52, 141, 239, 129,  28, 193, 105, 248, 200,   8,  76, 113,
+      5, 138, 101,  47, 225,  36,  15,  33,  53, 147, 142, 218, 240,  18, 130,  69,
+     29, 181, 194, 125, 106,  39, 249, 185, 201, 154,   9, 120,  77, 228, 114, 166,
+      6, 191, 139,  98, 102, 221,  48, 253, 226, 152,  37, 179,  16, 145,  34, 136,
+     54, 208, 148, 206, 143, 150, 219, 189, 241, 210,  19,  92, 131,  56,  70,  64,
+     30,  66, 182, 163, 195,  72, 126, 110, 107,  58,  40,  84, 250, 133, 186,  61,
+    202,  94, 155, 159,  10,  21, 121,  43,  78, 212, 229, 172, 115, 243, 167,  87,
+      7, 112, 192, 247, 140, 128,  99,  13, 103,  74, 222, 237,  49, 197, 254,  24,
+    227, 165, 153, 119,  38, 184, 180, 124,  17,  68, 146, 217,  35,  32, 137,  46,
+     55,  63, 209,  91, 149, 188, 207, 205, 144, 135, 151, 178, 220, 252, 190,  97,
+    242,  86, 211, 171,  20,  42,  93, 158, 132,  60,  57,  83,  71, 109,  65, 162,
+     31,  45,  67, 216, 183, 123, 164, 118, 196,  23,  73, 236, 127,  12, 111, 246,
+    108, 161,  59,  82,  41, 157,  85, 170, 251,  96, 134, 177, 187, 204,  62,  90,
+    203,  89,  95, 176, 156, 169, 160,  81,  11, 245,  22, 235, 122, 117,  44, 215,
+     79, 174, 213, 233, 230, 231, 173, 232, 116, 214, 244, 234, 168,  80,  88, 175
+};
+
+/* Reed-Solomon generator polynomials for every number of correction codewords per block (coefficients from the highest degree).
+ * Row n holds the n+1 coefficients of (x - a^0)(x - a^1)...(x - a^(n-1)), both as exponents of alpha and as field elements. */
+#define RS_MAX_CORRECTION_CODEWORDS 30
+const unsigned char RS_GENERATOR_POLYNOMIAL_EXPONENTS[RS_MAX_CORRECTION_CODEWORDS + 1][RS_MAX_CORRECTION_CODEWORDS + 1] = {
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 25, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 198, 199, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 75, 249, 78, 6, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 113, 164, 166, 119, 10, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 166, 0, 134, 5, 176, 15, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 87, 229, 146, 149, 238, 102, 21, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 175, 238, 208, 249, 215, 252, 196, 28, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 95, 246, 137, 231, 235, 149, 11, 123, 36, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 251, 67, 46, 61, 118, 70, 64, 94, 32, 45, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 220, 192, 91, 194, 172, 177, 209, 116, 227, 10, 55, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 102, 43, 98, 121, 187, 113, 198, 143, 131, 87, 157, 66, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 74, 152, 176, 100, 86, 100, 106, 104, 130, 218, 206, 140, 78, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 199, 249, 155, 48, 190, 124, 218, 137, 216, 87, 207, 59, 22, 91, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 8, 183, 61, 91, 202, 37, 51, 58, 58, 237, 140, 124, 5, 99, 105, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 120, 104, 107, 109, 102, 161, 76, 3, 91, 191, 147, 169, 182, 194, 225, 120, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 43, 139, 206, 78, 43, 239, 123, 206, 214, 147, 24, 99, 150, 39, 243, 163, 136, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 215, 234, 158, 94, 184, 97, 118, 170, 79, 187, 152, 148, 252, 179, 5, 98, 96, 153, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 67, 3, 105, 153, 52, 90, 83, 17, 150, 159, 44, 128, 153, 133, 252, 222, 138, 220, 171, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 17, 60, 79, 50, 61, 163, 26, 187, 202, 180, 221, 225, 83, 239, 156, 164, 212, 212, 188, 190, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 240, 233, 104, 247, 181, 140, 67, 98, 85, 200, 210, 115, 148, 137, 230, 36, 122, 254, 148, 175, 210, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 210, 171, 247, 242, 93, 230, 14, 109, 221, 53, 200, 74, 8, 172, 98, 80, 219, 134, 160, 105, 165, 231, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 171, 102, 146, 91, 49, 103, 65, 17, 193, 150, 14, 25, 183, 248, 94, 164, 224, 192, 1, 78, 56, 147, 253, 0, 0, 0, 0, 0, 0, 0},
+    {0, 229, 121, 135, 48, 211, 117, 251, 126, 159, 180, 169, 152, 192, 226, 228, 218, 111, 0, 117, 232, 87, 96, 227, 21, 0, 0, 0, 0, 0, 0},
+    {0, 231, 181, 156, 39, 170, 26, 12, 59, 15, 148, 201, 54, 66, 237, 208, 99, 167, 144, 182, 95, 243, 129, 178, 252, 45, 0, 0, 0, 0, 0},
+    {0, 173, 125, 158, 2, 103, 182, 118, 17, 145, 201, 111, 28, 165, 53, 161, 21, 245, 142, 13, 102, 48, 227, 153, 145, 218, 70, 0, 0, 0, 0},
+    {0, 79, 228, 8, 165, 227, 21, 180, 29, 9, 237, 70, 99, 45, 58, 138, 135, 73, 126, 172, 94, 216, 193, 157, 26, 17, 149, 96, 0, 0, 0},
+    {0, 168, 223, 200, 104, 224, 234, 108, 180, 110, 190, 195, 147, 205, 27, 232, 201, 21, 43, 245, 87, 42, 195, 212, 119, 242, 37, 9, 123, 0, 0},
+    {0, 156, 45, 183, 29, 151, 219, 54, 96, 249, 24, 136, 5, 241, 175, 189, 28, 75, 234, 150, 148, 23, 9, 202, 162, 68, 250, 140, 24, 151, 0},
+    {0, 41, 173, 145, 152, 216, 31, 179, 182, 50, 48, 110, 86, 239, 96, 222, 125, 42, 173, 226, 193, 224, 130, 156, 37, 251, 216, 238, 40, 192, 180}
+};
+const unsigned char RS_GENERATOR_POLYNOMIAL_COEFFICIENTS[RS_MAX_CORRECTION_CODEWORDS + 1][RS_MAX_CORRECTION_CODEWORDS + 1] = {
+    {1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 3, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 7, 14, 8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 15, 54, 120, 64, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 31, 198, 63, 147, 116, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 63, 1, 218, 32, 227, 38, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 127, 122, 154, 164, 11, 68, 117, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 255, 11, 81, 54, 239, 173, 200, 24, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 226, 207, 158, 245, 235, 164, 232, 197, 37, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 216, 194, 159, 111, 199, 94, 95, 113, 157, 193, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 172, 130, 163, 50, 123, 219, 162, 248, 144, 116, 160, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 68, 119, 67, 118, 220, 31, 7, 84, 92, 127, 213, 97, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 137, 73, 227, 17, 177, 17, 52, 13, 46, 43, 83, 132, 120, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 14, 54, 114, 70, 174, 151, 43, 158, 195, 127, 166, 210, 234, 163, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 29, 196, 111, 163, 112, 74, 10, 105, 105, 139, 132, 151, 32, 134, 26, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 59, 13, 104, 189, 68, 209, 30, 8, 163, 65, 41, 229, 98, 50, 36, 59, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 119, 66, 83, 120, 119, 22, 197, 83, 249, 41, 143, 134, 85, 53, 125, 99, 79, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 239, 251, 183, 113, 149, 175, 199, 215, 240, 220, 73, 82, 173, 75, 32, 67, 217, 146, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 194, 8, 26, 146, 20, 223, 187, 152, 85, 115, 238, 133, 146, 109, 173, 138, 33, 172, 179, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 152, 185, 240, 5, 111, 99, 6, 220, 112, 150, 69, 36, 187, 22, 228, 198, 121, 121, 165, 174, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 44, 243, 13, 131, 49, 132, 194, 67, 214, 28, 89, 124, 82, 158, 244, 37, 236, 142, 82, 255, 89, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 89, 179, 131, 176, 182, 244, 19, 189, 69, 40, 28, 137, 29, 123, 67, 253, 86, 218, 230, 26, 145, 245, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 179, 68, 154, 163, 140, 136, 190, 152, 25, 85, 19, 3, 196, 27, 113, 198, 18, 130, 2, 120, 93, 41, 71, 0, 0, 0, 0, 0, 0, 0},
+    {1, 122, 118, 169, 70, 178, 237, 216, 102, 115, 150, 229, 73, 130, 72, 61, 43, 206, 1, 237, 247, 127, 217, 144, 117, 0, 0, 0, 0, 0, 0},
+    {1, 245, 49, 228, 53, 215, 6, 205, 210, 38, 82, 56, 80, 97, 139, 81, 134, 126, 168, 98, 226, 125, 23, 171, 173, 193, 0, 0, 0, 0, 0},
+    {1, 246, 51, 183, 4, 136, 98, 199, 152, 77, 56, 206, 24, 145, 40, 209, 117, 233, 42, 135, 68, 70, 144, 146, 77, 43, 94, 0, 0, 0, 0},
+    {1, 240, 61, 29, 145, 144, 117, 150, 48, 58, 139, 94, 134, 193, 105, 33, 169, 202, 102, 123, 113, 195, 25, 213, 6, 152, 164, 217, 0, 0, 0},
+    {1, 252, 9, 28, 13, 18, 251, 208, 150, 103, 174, 100, 41, 167, 12, 247, 56, 117, 119, 233, 127, 181, 100, 121, 147, 176, 74, 58, 197, 0, 0},
+    {1, 228, 193, 196, 48, 170, 86, 80, 217, 54, 143, 79, 32, 88, 255, 87, 24, 15, 251, 85, 82, 201, 58, 112, 191, 153, 108, 132, 143, 170, 0},
+    {1, 212, 246, 77, 73, 195, 192, 75, 98, 5, 70, 103, 177, 22, 217, 138, 51, 181, 246, 72, 25, 18, 46, 228, 74, 216, 195, 11, 106, 130, 150}
+};
 
 /* Format data constants */
 #define FORMAT_INFORMATION_BITS_SIZE 15
-#define ERROR_CORRECTION_LEVEL_BITS_SIZE 2
-#define MASK_LEVEL_BITS_SIZE 3
-#define FORMAT_POSITION_THRESHOLD 5
-const unsigned char ERROR_CORRECTION_LEVEL_BITS[CORRECTION_LEVELS][ERROR_CORRECTION_LEVEL_BITS_SIZE] = { {0, 1}, {0, 0}, {1, 1}, {1, 0} };
-#define FORMAT_STRING_GENERATOR_POLYNOMIAL_SIZE 11
-const unsigned char FORMAT_INFORMATION_GENERATOR_POLYNOMIAL[FORMAT_STRING_GENERATOR_POLYNOMIAL_SIZE] = {1, 0, 1, 0, 0, 1, 1, 0, 1, 1, 1};
-const unsigned char FORMAT_INFORMATION_MASK_STRING[FORMAT_INFORMATION_BITS_SIZE] = {1, 0, 1, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0};
+/* Format information strings (15 bits, correction bits and fixed mask included) for every correction level and mask */
+const unsigned int FORMAT_INFORMATION_STRINGS[CORRECTION_LEVELS][MASK_NUMBER] = {
+    {0x77C4, 0x72F3, 0x7DAA, 0x789D, 0x662F, 0x6318, 0x6C41, 0x6976},
+    {0x5412, 0x5125, 0x5E7C, 0x5B4B, 0x45F9, 0x40CE, 0x4F97, 0x4AA0},
+    {0x355F, 0x3068, 0x3F31, 0x3A06, 0x24B4, 0x2183, 0x2EDA, 0x2BED},
+    {0x1689, 0x13BE, 0x1CE7, 0x19D0, 0x0762, 0x0255, 0x0D0C, 0x083B}
+};
 
 /* Version information constants */
 #define VERSION_INFORMATION_BITS_SIZE 18
-#define VERSION_BITS_SIZE 6
-#define VERSION_INFORMATION_GENERATOR_POLYNOMIAL_SIZE 13
-#define VERSION_POSITION_THRESHOLD 6
-const unsigned char VERSION_INFORMATION_GENERATOR_POLYNOMIAL[VERSION_INFORMATION_GENERATOR_POLYNOMIAL_SIZE] = {1, 1, 1, 1, 1, 0, 0, 1, 0, 0, 1, 0, 1};
+/* Version information strings (18 bits, correction bits included) for every version (only versions 7 and above have them) */
+const unsigned int VERSION_INFORMATION_STRINGS[QRCODE_VERSIONS + 1] = {
+    0x00000, 0x00000, 0x00000, 0x00000, 0x00000, 0x00000, 0x00000, 0x07C94,
+    0x085BC, 0x09A99, 0x0A4D3, 0x0BBF6, 0x0C762, 0x0D847, 0x0E60D, 0x0F928,
+    0x10B78, 0x1145D, 0x12A17, 0x13532, 0x149A6, 0x15683, 0x168C9, 0x177EC,
+    0x18EC4, 0x191E1, 0x1AFAB, 0x1B08E, 0x1CC1A, 0x1D33F, 0x1ED75, 0x1F250,
+    0x209D5, 0x216F0, 0x228BA, 0x2379F, 0x24B0B, 0x2542E, 0x26A64, 0x27541,
+    0x28C69
+};
 
 typedef struct qrcode {
-    /* QRCODE data */
-    char* data;
+    /* QRCODE data (one bit per module, every row padded to whole 64 bits words; read it with get_qrcode_module) */
+    uint64_t* data;
     /* QRCODE size (of the square) */
     size_t size;
+    /* Number of 64 bits words in every row */
+    size_t words_per_row;
 } qrcode_t;
 
-#define QRCODE_INVALID  \
-    (qrcode_t)          \
-    {                   \
-        .data = NULL,   \
-        .size = 0       \
+#define QRCODE_INVALID          \
+    (qrcode_t)                  \
+    {                           \
+        .data = NULL,           \
+        .size = 0,              \
+        .words_per_row = 0      \
     }
 
 /* QRCODE template struct */
@@ -109,12 +274,18 @@ typedef struct qrcode_template {
     enum ENCODING_MODE encoding_mode;
     /* QRCODE mask [0-7] (-1 = ANY)*/
     int mask;
+    /* How the mask is chosen when it is ANY (FIXED requires a mask) */
+    enum MASK_STRATEGY mask_strategy;
     /* flag to invert QRCODE colors */
     bool negative;
     /* flag to use ISO-8859-1 instead of UTF-8 for compatibility */
     bool iso;
     /* flag to print debug information to stdout when creating a qrcode from this template */
     bool debug;
+    /* flag to evaluate the mask candidates at the same time on a pool of threads (for large symbols) */
+    bool parallel_masks;
+    /* flag to raise the correction level to the highest one that still holds the data in the selected version */
+    bool maximize_correction_level;
 } qrcode_template_t;
 
 /* Default template */
@@ -126,9 +297,12 @@ typedef struct qrcode_template {
         .correction_level = LOW,     \
         .encoding_mode = BYTE,       \
         .mask = MASK_ANY,            \
+        .mask_strategy = MASK_EXACT, \
         .negative = false,           \
         .iso = false,                \
         .debug = false,              \
+        .parallel_masks = false,     \
+        .maximize_correction_level = false, \
     }
 
 typedef struct version_related_information {
@@ -195,31 +369,66 @@ const qrcode_information_t QRCODE_INFO[QRCODE_VERSIONS + 1] = {
     { {14, 13, 16, 12}, 0, { {{7089, 4296, 2953, 1817}, 2956, 30, 19, 118, 6, 119}, {{5596, 3391, 2331, 1435}, 2334, 28, 18, 47, 31, 48}, {{3993, 2420, 1663, 1024}, 1666, 30, 34, 24, 34, 25}, {{3057, 1852, 1273, 784}, 1276, 30, 20, 15, 61, 16} }, {6, 30, 58, 86, 114, 142, 170} },
 };
 
-/* Converts n to binary and inserts it into destination 
- *  Es. n = 5, destination_size = 8;
- *  result = 0 0 0 0 0 1 0 1
+/* Packed stream of bits (most significant bit first), used to build the codewords */
+typedef struct bitstream {
+    /* Packed bytes (every byte is a codeword once the stream is complete) */
+    unsigned char *data;
+    /* Capacity of the stream in bits */
+    size_t size;
+    /* Number of bits already written */
+    size_t position;
+} bitstream_t;
+
+/* Initializes a bitstream over the given buffer (which is cleared) */
+void bitstream_init(bitstream_t *stream, unsigned char *buffer, size_t buffer_bytes) {
+    memset(buffer, 0, buffer_bytes);
+    stream->data = buffer;
+    stream->size = buffer_bytes * BITS_PER_BYTE;
+    stream->position = 0;
+}
+
+/* Appends the lowest 'bits' bits of value to the stream.
+ * Returns false (and writes nothing) if the stream does not have enough space left.
+ *  Es. value = 5, bits = 4;
+ *  appended = 0 1 0 1
  * */
-void get_binary_from_integer(unsigned int n, unsigned char *destination, unsigned int destination_size) {
-    unsigned int temp = n;
-    unsigned int bit_count = 0;
-    while (bit_count < destination_size) {
-        if (temp > 0) {
-            destination[destination_size - bit_count - 1] = temp % 2;
-            temp /= 2;
-        } else {
-            destination[destination_size - bit_count - 1] = 0;
-        }
-        bit_count++;
+bool bitstream_append(bitstream_t *stream, unsigned int value, int bits) {
+    if (stream->position + bits > stream->size)
+        return false;
+
+    while (bits > 0) {
+        int free_bits = BITS_PER_BYTE - (stream->position % BITS_PER_BYTE);
+        int chunk = bits < free_bits ? bits : free_bits;
+        unsigned int part = (value >> (bits - chunk)) & ((1u << chunk) - 1);
+        stream->data[stream->position / BITS_PER_BYTE] |= part << (free_bits - chunk);
+        stream->position += chunk;
+        bits -= chunk;
     }
+    return true;
+}
+
+/* Adds 0's until the stream size is a multiple of 8 (the buffer is already cleared) */
+void bitstream_align_to_byte(bitstream_t *stream) {
+    stream->position = (stream->position + BITS_PER_BYTE - 1) / BITS_PER_BYTE * BITS_PER_BYTE;
+    if (stream->position > stream->size)
+        stream->position = stream->size;
 }
 
-/* Gets an integer from a binary value of 1 Byte */
-unsigned char get_integer_from_binary(unsigned char bits[]) {
-    int n = 0;
-    for (int i = 0; i < BITS_PER_BYTE; i++ ) {
-        n += pow(2, BITS_PER_BYTE - 1 - i) * bits[i];
+/* Completes the data stream: adds the terminator, aligns it and fills the remaining codewords with the filler characters */
+void bitstream_add_terminator_and_filler(bitstream_t *stream) {
+    /* Terminator (may be shorter if the stream is almost full) */
+    size_t terminator_size = stream->size - stream->position < TERMINATOR_MAX_SIZE ? stream->size - stream->position : TERMINATOR_MAX_SIZE;
+    stream->position += terminator_size;
+
+    bitstream_align_to_byte(stream);
+
+    /* If the data is still not full, add filler codewords */
+    int filler_step = 0;
+    for (size_t i = stream->position / BITS_PER_BYTE; i < stream->size / BITS_PER_BYTE; i++) {
+        stream->data[i] = FILLER_CHARACTERS[filler_step];
+        filler_step = (filler_step + 1) % 2;
     }
-    return n;
+    stream->position = stream->size;
 }
 
 /* Gets the size of a qrcode from its version */
@@ -232,162 +441,1207 @@ int get_qrcode_size_with_padding(int version) {
     return (version * 4) + 17 + 2*QRCODE_PADDING;
 }
 
-/* Gets the length in bytes of the converted input */
-size_t get_input_length_bytes_converted(char *input, size_t input_bytes, char* encoding) {
+/* Character sets the text can be converted to (from UTF-8) */
+enum CHARSET {CHARSET_SHIFT_JIS, CHARSET_ISO_8859_1};
+
+/* JIS X 0208 characters of Shift-JIS (the ones in the Kanji mode ranges), sorted by Unicode code point.
+ * The code points are split in pages of 256: the characters of page p are from KANJI_PAGE_START[p] to KANJI_PAGE_START[p+1],
+ * with the low byte of their code point and their Kanji mode value (13 bits). Full width yen, cent and not signs share the value of their ASCII-like twins. */
+#define UNICODE_PAGES 256
+#define KANJI_CHARACTERS 6882
+const unsigned short KANJI_PAGE_START[UNICODE_PAGES + 1] = {
+       0,   11,   11,   11,   59,  125,  125,  125,  125,  125,  125,  125,  125,  125,  125,  125,
+     125,  125,  125,  125,  125,  125,  125,  125,  125,  125,  125,  125,  125,  125,  125,  125,
+     125,  140,  148,  180,  181,  181,  225,  232,  232,  232,  232,  232,  232,  232,  232,  232,
+     232,  431,  431,  431,  431,  431,  431,  431,  431,  431,  431,  431,  431,  431,  431,  431,
+     431,  431,  431,  431,  431,  431,  431,  431,  431,  431,  431,  431,  431,  431,  431,  546,
+     637,  715,  831,  935, 1047, 1138, 1203, 1266, 1332, 1415, 1504, 1549, 1653, 1741, 1807, 1909,
+    2018, 2119, 2215, 2326, 2407, 2473, 2567, 2658, 2771, 2860, 2955, 3023, 3108, 3191, 3269, 3352,
+    3425, 3475, 3534, 3608, 3664, 3719, 3828, 3912, 3976, 4032, 4105, 4200, 4284, 4370, 4475, 4538,
+    4606, 4695, 4780, 4872, 4946, 5017, 5092, 5155, 5218, 5301, 5371, 5476, 5532, 5614, 5664, 5731,
+    5810, 5914, 5986, 6037, 6092, 6125, 6166, 6262, 6342, 6407, 6470, 6524, 6590, 6634, 6698, 6754,
+    6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787,
+    6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787,
+    6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787,
+    6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787,
+    6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787,
+    6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787, 6787,
+    6882
+};
+const unsigned char KANJI_UNICODE_LOW_BYTES[KANJI_CHARACTERS] = {
+    162, 163, 167, 168, 172, 176, 177, 180, 182, 215, 247, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156, 157,
+    158, 159, 160, 161, 163, 164, 165, 166, 167, 168, 169, 177, 178, 179, 180, 181, 182, 183, 184, 185, 186, 187, 188, 189,
+    190, 191, 192, 193, 195, 196, 197, 198, 199, 200, 201,   1,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25,  26,  27,
+     28,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,  39,  40,  41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51,
+     52,  53,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,  72,  73,  74,  75,
+     76,  77,  78,  79,  81,  16,  21,  22,  24,  25,  28,  29,  32,  33,  37,  38,  48,  50,  51,  59,   3,  43, 144, 145,
+    146, 147, 210, 212,   0,   2,   3,   7,   8,  11,  18,  26,  29,  30,  32,  39,  40,  41,  42,  43,  44,  52,  53,  61,
+     82,  96,  97, 102, 103, 106, 107, 130, 131, 134, 135, 165,  18,   0,   1,   2,   3,  12,  15,  16,  19,  20,  23,  24,
+     27,  28,  29,  32,  35,  36,  37,  40,  43,  44,  47,  48,  51,  52,  55,  56,  59,  60,  63,  66,  75, 160, 161, 178,
+    179, 188, 189, 198, 199, 203, 206, 207, 239,   5,   6,  64,  66, 106, 109, 111,   0,   1,   2,   3,   5,   6,   7,   8,
+      9,  10,  11,  12,  13,  14,  15,  16,  17,  18,  19,  20,  21,  28,  65,  66,  67,  68,  69,  70,  71,  72,  73,  74,
+     75,  76,  77,  78,  79,  80,  81,  82,  83,  84,  85,  86,  87,  88,  89,  90,  91,  92,  93,  94,  95,  96,  97,  98,
+     99, 100, 101, 102, 103, 104, 105, 106, 107, 108, 109, 110, 111, 112, 113, 114, 115, 116, 117, 118, 119, 120, 121, 122,
+    123, 124, 125, 126, 127, 128, 129, 130, 131, 132, 133, 134, 135, 136, 137, 138, 139, 140, 141, 142, 143, 144, 145, 146,
+    147, 155, 156, 157, 158, 161, 162, 163, 164, 165, 166, 167, 168, 169, 170, 171, 172, 173, 174, 175, 176, 177, 178, 179,
+    180, 181, 182, 183, 184, 185, 186, 187, 188, 189, 190, 191, 192, 193, 194, 195, 196, 197, 198, 199, 200, 201, 202, 203,
+    204, 205, 206, 207, 208, 209, 210, 211, 212, 213, 214, 215, 216, 217, 218, 219, 220, 221, 222, 223, 224, 225, 226, 227,
+    228, 229, 230, 231, 232, 233, 234, 235, 236, 237, 238, 239, 240, 241, 242, 243, 244, 245, 246, 251, 252, 253, 254,   0,
+      1,   3,   7,   8,   9,  10,  11,  13,  14,  16,  17,  20,  21,  22,  23,  24,  25,  30,  33,  38,  42,  45,  49,  50,
+     54,  56,  57,  59,  60,  63,  66,  67,  69,  75,  77,  78,  79,  85,  86,  87,  88,  89,  93,  94,  95,  98, 113, 115,
+    126, 128, 130, 133, 134, 136, 137, 138, 139, 140, 142, 145, 146, 148, 149, 152, 153, 155, 156, 158, 159, 160, 161, 162,
+    164, 165, 166, 168, 171, 172, 173, 174, 176, 179, 182, 186, 192, 193, 194, 196, 198, 199, 202, 203, 205, 206, 207, 212,
+    213, 214, 215, 216, 217, 221, 222, 223, 227, 228, 229, 237, 238, 240, 242, 246, 247, 251,   1,   9,  10,  13,  14,  15,
+     16,  17,  26,  28,  29,  47,  48,  52,  54,  56,  58,  60,  61,  67,  70,  71,  77,  78,  79,  80,  81,  83,  85,  87,
+     89,  90,  91,  92,  93,  94, 105, 111, 112, 115, 117, 118, 123, 124, 127, 131, 134, 136, 139, 141, 143, 145, 150, 152,
+    155, 157, 160, 161, 171, 173, 174, 175, 181, 182, 191, 194, 195, 196, 202, 206, 208, 209, 212, 215, 216, 218, 219, 221,
+    223, 225, 227, 228, 229, 238, 239, 243, 245, 246, 248, 250, 254,   5,   6,   9,  11,  13,  15,  17,  18,  20,  22,  25,
+     26,  31,  33,  35,  36,  37,  38,  40,  41,  42,  43,  44,  45,  54,  57,  67,  71,  72,  73,  79,  80,  85,  86,  90,
+     92, 101, 108, 114, 116, 117, 118, 120, 125, 128, 133, 141, 145, 152, 153, 154, 172, 173, 178, 179, 180, 181, 183, 190,
+    194, 197, 201, 202, 205, 207, 209, 213, 214, 218, 222, 227, 229, 231, 237, 238, 245, 249, 251,   0,   1,   2,   4,   9,
+     18,  20,  21,  22,  24,  26,  31,  33,  42,  50,  55,  58,  59,  60,  63,  64,  65,  67,  68,  69,  70,  71,  72,  73,
+     75,  76,  77,  78,  80,  82,  84,  90,  92,  98, 101, 104, 105, 106, 107, 108, 109, 110, 113, 117, 118, 119, 120, 124,
+    128, 130, 133, 134, 137, 138, 140, 141, 143, 144, 145, 146, 147, 149, 150, 151, 153, 160, 162, 164, 165, 166, 168, 169,
+    170, 171, 172, 176, 177, 178, 179, 180, 181, 182, 183, 189, 196, 197, 198, 201, 203, 204, 205, 214, 219, 220, 221, 224,
+    225, 230, 231, 233, 234, 237, 240, 241, 245, 246, 248, 249, 250, 253, 254,   0,   3,   4,   6,   7,   8,  10,  11,  14,
+     17,  20,  23,  29,  36,  37,  39,  41,  42,  46,  48,  51,  54,  55,  56,  57,  58,  59,  67,  68,  71,  74,  75,  76,
+     77,  79,  84,  86,  91,  94,  99, 100, 101, 105, 106, 111, 112, 113, 114, 115, 116, 117, 125, 127, 131, 135, 136, 137,
+    141, 145, 146, 148, 155, 159, 160, 163, 169, 170, 171, 172, 173, 177, 180, 181, 185, 188, 190, 193, 195, 197, 199, 201,
+    205, 210, 213, 215, 216, 217, 221, 222, 223, 224, 226, 227, 228, 230, 231, 242, 243, 245, 248, 249, 250, 254, 255,   1,
+      2,   5,   6,   8,  13,  15,  16,  21,  22,  23,  25,  26,  29,  32,  33,  35,  42,  47,  49,  51,  56,  57,  58,  59,
+     63,  64,  65,  67,  69,  70,  71,  72,  73,  74,  77,  81,  82,  83,  84,  87,  88,  90,  92,  94,  96, 102, 105, 110,
+    111, 112, 113, 115, 116, 117, 119, 120, 123, 127, 130, 132, 150, 152, 154, 159, 160, 165, 166, 168, 169, 173, 174, 176,
+    179, 182, 187, 194, 195, 200, 201, 202, 203, 204, 205, 206, 212, 214, 215, 217, 219, 223, 225, 226, 227, 228, 229, 232,
+    233, 234, 235, 236, 237, 238, 239, 240, 241, 242, 243, 246, 247, 248, 250,   1,   3,   4,   8,   9,  10,  11,  12,  13,
+     14,  15,  16,  17,  27,  29,  31,  32,  38,  41,  43,  44,  45,  46,  54,  56,  57,  59,  60,  61,  62,  64,  66,  70,
+     72,  73,  74,  78,  81,  95, 104, 106, 112, 113, 115, 117, 118, 119, 123, 124, 125, 128, 132, 134, 139, 140, 142, 143,
+    144, 146, 162, 164, 165, 168, 171, 172, 175, 178, 179, 184, 188, 189, 190, 192, 193, 194, 196, 199, 200, 201, 216, 225,
+    226, 229, 230, 232, 233, 237, 238, 242, 250, 253,   4,   6,   7,  15,  16,  20,  22,  46,  47,  49,  51,  56,  57,  62,
+     64,  68,  69,  70,  76,  79,  83,  86,  87,  92,  93,  99, 123, 124, 126, 128, 131, 132, 135, 137, 138, 139, 152, 153,
+    154, 156, 157, 158, 159, 167, 168, 169, 170, 171, 172, 174, 176, 182, 196, 197, 199, 212, 218, 220, 223, 227, 228, 247,
+    249, 253, 254,   6,   9,  20,  22,  23,  24,  27,  41,  47,  49,  50,  52,  54,  56,  66,  76,  78,  80,  91, 100, 104,
+    106, 107, 108, 116, 120, 122, 128, 134, 135, 138, 143, 148, 160, 162, 165, 174, 180, 182, 188, 192, 193, 194, 195, 200,
+    206, 209, 211, 215, 216, 218, 219, 222, 224, 227, 238, 240, 242, 243, 249, 250, 253, 255,   0,   3,   4,   8,   9,  11,
+     13,  15,  18,  19,  22,  24,  28,  31,  38,  39,  40,  45,  48,  55,  56,  59,  64,  66,  71,  74,  78,  79,  80,  81,
+     97, 100, 102, 105, 106, 127, 130, 136, 137, 139, 147, 160, 162, 163, 164, 170, 176, 179, 192, 195, 198, 203, 206, 210,
+    211, 212, 214, 220, 223, 224, 227, 244, 247, 249, 250, 252,   0,   2,   5,   6,  10,  11,  21,  25,  29,  33,  36,  42,
+     47,  48,  49,  52,  53,  58,  61,  64,  65,  74,  75,  81,  82,  84,  87,  88,  89,  90,  94,  98, 105, 107, 112, 114,
+    117, 121, 126, 131, 133, 147, 151, 156, 159, 168, 171, 174, 179, 184, 185, 186, 187, 190, 193, 197, 199, 202, 204, 209,
+    211, 213, 215, 216, 217, 220, 222, 223, 228, 229, 235, 236, 238, 239, 240, 241, 242, 247, 249, 250, 251, 252, 253,   2,
+      9,  10,  15,  16,  21,  22,  24,  25,  26,  27,  28,  34,  37,  39,  41,  42,  43,  44,  45,  46,  49,  50,  55,  56,
+     62,  68,  71,  72,  73,  78,  79,  80,  81,  84,  85,  87,  88,  90,  96,  98, 101, 103, 104, 105, 106, 108, 110, 115,
+    116, 120, 125, 129, 130, 131, 132, 138, 141, 147, 150, 153, 155, 157, 163, 165, 168, 172, 178, 185, 187, 190, 198, 201,
+    203, 208, 209, 211, 212, 217, 218, 220, 229, 230, 232, 234, 235, 246, 251, 255,   1,   3,   9,  17,  24,  26,  28,  31,
+     32,  37,  41,  47,  53,  54,  60,  64,  65,  70,  73,  90,  98, 102, 106, 108, 127, 146, 154, 155, 188, 189, 190, 193,
+    194, 201, 203, 204, 208, 214, 215, 225, 227, 230, 233, 250, 251,   9,  11,  12,  22,  34,  42,  44,  48,  50,  54,  62,
+     64,  67,  69,  80,  81,  84,  85,  87,  88,  90,  91,  92,  93,  95,  99, 100, 101, 102, 105, 107, 112, 113, 115, 117,
+    120, 122, 128, 131, 133, 135, 136, 137, 139, 140, 141, 143, 149, 151, 152, 153, 154, 155, 156, 157, 159, 162, 163, 164,
+    165, 166, 174, 176, 179, 180, 181, 182, 184, 185, 191, 194, 195, 196, 197, 198, 199, 201, 204, 208, 210, 211, 212, 219,
+    221, 222, 223, 225, 226, 228, 229, 230, 231, 232, 233, 235, 238, 240, 243, 245, 246, 248, 250, 254, 255,   1,   2,   4,
+      5,   6,   7,   8,   9,  10,  11,  13,  14,  15,  17,  19,  22,  26,  32,  34,  36,  40,  45,  49,  56,  57,  58,  59,
+     60,  61,  62,  63,  64,  65,  69,  70,  72,  74,  75,  77,  78,  79,  80,  81,  83,  85,  94,  96,  97, 100, 101, 108,
+    110, 111, 113, 118, 121, 140, 144, 145, 148, 161, 168, 169, 171, 172, 177, 179, 182, 183, 184, 187, 188, 190, 197, 199,
+    217, 224, 225, 232, 233, 234, 237, 239, 240, 246, 250, 251, 253,   7,  11,  14,  17,  20,  21,  22,  23,  24,  25,  26,
+     27,  31,  34,  41,  75,  76,  78,  80,  82,  92, 105, 108, 111, 115, 118, 130, 132, 135, 139, 140, 144, 157, 162, 172,
+    174, 183, 186, 188, 189, 201, 204, 205, 210, 211, 214, 219, 221, 222, 225, 227, 229, 230, 231, 232, 235, 238, 241, 242,
+    243, 244, 245, 247, 251, 253, 254,   2,   3,   6,  11,  12,  17,  22,  25,  26,  27,  29,  37,  43,  45,  47,  48,  51,
+     54,  55,  56,  61,  64,  67,  68,  69,  71,  76,  78,  84,  85,  87,  95,  97,  98,  99, 100, 114, 115, 116, 117, 118,
+    120, 121, 122, 123, 124, 125, 126, 127, 129, 131, 132, 135, 138, 143, 149, 150, 151, 154, 156, 160, 166, 167, 171, 173,
+    181, 182, 183, 184, 193, 194, 195, 200, 201, 202, 207, 208, 211, 214, 218, 219, 221, 223, 224, 225, 226, 227, 232, 233,
+    236, 240, 241, 243, 244, 246, 247, 248, 250, 251, 252, 254, 255,   1,   3,   4,   9,  10,  11,  12,  13,  15,  16,  17,
+     19,  20,  21,  22,  23,  24,  27,  31,  37,  38,  39,  41,  45,  47,  49,  53,  55,  56,  60,  62,  65,  72,  74,  76,
+     78,  81,  83,  86,  87,  89,  92,  93,  97,  98, 102, 105, 106, 107, 108, 109, 112, 113, 115, 119, 121, 124, 127, 128,
+    129, 130, 131, 132, 133, 135, 136, 138, 139, 140, 144, 145, 146, 147, 151, 152, 153, 158, 160, 161, 168, 169, 170, 173,
+    174, 179, 180, 185, 188, 189, 195, 197, 204, 205, 214, 215, 216, 217, 220, 221, 224, 228, 235, 240, 241, 245, 248, 251,
+    253, 255,  14,  15,  16,  18,  21,  22,  25,  27,  28,  29,  32,  33,  37,  38,  39,  40,  41,  42,  43,  47,  49,  58,
+     65,  66,  67,  70,  74,  75,  77,  80,  82,  85,  89,  90,  95,  96,  98,  99, 100, 101, 104, 105, 106, 107, 108, 109,
+    111, 112, 117, 119, 129, 131, 132, 137, 139, 140, 141, 146, 148, 150, 151, 154, 155, 159, 160, 163, 166, 167, 169, 170,
+    178, 179, 180, 181, 182, 184, 188, 189, 197, 198, 199, 209, 211, 216, 218, 220, 223, 224, 225, 227, 231, 232, 240, 241,
+    243, 244, 246, 247, 249, 250, 251,   0,   1,   3,   6,   8,   9,  13,  14,  15,  21,  26,  27,  31,  33,  39,  40,  44,
+     52,  60,  61,  62,  63,  66,  68,  71,  72,  74,  75,  76,  77,  78,  83,  85,  88,  89,  90,  93,  95,  98,  99, 101,
+    103, 104, 107, 110, 111, 112, 113, 115, 116, 117, 118, 119, 126, 130, 135, 138, 142, 144, 145, 148, 150, 153, 154, 164,
+    167, 169, 171, 172, 174, 178, 182, 186, 190, 195, 198, 199, 200, 201, 202, 203, 204, 205, 208, 227, 230, 242, 244, 246,
+    247, 248, 250, 252, 253, 254, 255,   0,   8,   9,  10,  12,  13,  14,  16,  17,  18,  20,  22,  26,  27,  29,  30,  31,
+     33,  38,  42,  46,  47,  48,  50,  51,  52,  56,  59,  63,  64,  65,  71,  72,  73,  75,  77,  78,  83,  85,  88,  91,
+     94,  96,  99, 104, 110, 113, 118, 121, 124, 126, 127, 128, 130, 131, 132, 137, 138, 145, 146, 147, 148, 149, 150, 151,
+    152, 155, 156, 158, 171, 172, 177, 181, 185, 187, 188, 189, 194, 197, 198, 199, 200, 201, 202, 204, 205, 207, 208, 209,
+    210, 211, 212, 215, 216, 217, 219, 220, 221, 224, 225, 236, 237, 238, 239, 241, 243, 245, 246, 247, 254, 255,   1,   2,
+      7,   8,   9,  12,  17,  25,  31,  39,  40,  43,  47,  58,  61,  62,  63,  73,  76,  77,  79,  80,  85,  87,  92, 103,
+    104, 105, 107, 110, 114, 118, 119, 122, 123, 128, 131, 136, 137, 140, 142, 143, 146, 150, 152, 155, 159, 160, 161, 162,
+    163, 165, 167, 168, 169, 170, 171, 172, 178, 180, 181, 187, 190, 192, 195, 196, 198, 201, 207, 208, 210, 214, 218, 219,
+    225, 227, 233, 238, 244, 246, 250,   6,  13,  15,  19,  22,  23,  28,  38,  40,  44,  45,  52,  54,  58,  62,  66,  78,
+     88, 103, 105, 111, 118, 120, 122, 131, 136, 146, 147, 149, 154, 158, 164, 165, 169, 171, 173, 174, 176, 178, 185, 187,
+    188, 193, 194, 197, 199, 205, 210, 212, 216, 218, 224, 225, 226, 227, 230, 231, 236, 239, 241, 242, 244, 246, 250, 253,
+    254,   0,   5,  24,  28,  29,  35,  36,  42,  43,  44,  47,  52,  53,  54,  55,  56,  57,  59,  62,  63,  69,  72,  77,
+     79,  81,  85,  86,  87,  88,  89,  93,  94,  98,  99, 102, 108, 112, 114, 116, 117, 119, 120, 130, 131, 135, 136, 137,
+    140, 142, 144, 145, 151, 153, 155, 156, 159, 161, 164, 165, 167, 171, 172, 173, 175, 176, 183, 185, 188, 189, 193, 195,
+    196, 197, 198, 203, 204, 207, 210, 215, 217, 219, 224, 225, 226, 229, 230, 231, 232, 233, 236, 237, 241, 250, 251,   2,
+      3,   6,   7,  10,  12,  14,  15,  19,  20,  28,  31,  32,  37,  39,  40,  45,  47,  52,  53,  54,  60,  63,  65,  66,
+     67,  68,  73,  75,  79,  82,  93,  94,  95,  98, 100, 102, 103, 104, 105, 110, 111, 112, 116, 118, 122, 129, 131, 132,
+    135, 136, 137, 142, 145, 150, 151, 152, 157, 162, 166, 171, 174, 180, 184, 185, 188, 190, 193, 196, 199, 201, 214, 217,
+    218, 220, 221, 224, 230, 233, 240, 242, 243, 244, 245, 247, 248, 249, 252, 253, 254, 255,   0,   3,   8,   9,  11,  13,
+     15,  20,  21,  22,  23,  27,  29,  30,  31,  38,  39,  40,  42,  43,  44,  45,  46,  49,  52,  54,  55,  56,  58,  61,
+     63,  65,  70,  73,  78,  79,  80,  81,  83,  86,  89,  92,  94,  95,  96,  97,  98,  99, 100, 101, 106, 109, 111, 112,
+    113, 114, 115, 117, 119, 124, 126, 127, 133, 135, 137, 139, 140, 144, 149, 151, 154, 156, 157, 160, 161, 162, 166, 169,
+    175, 179, 180, 182, 183, 184, 185, 193, 196, 198, 202, 206, 207, 208, 209, 211, 212, 216, 218, 221, 222, 226, 228, 231,
+    233, 236, 238, 239, 241, 243, 244, 245, 251, 254, 255,   2,   3,   4,  19,  22,  23,  30,  33,  34,  41,  42,  43,  50,
+     52,  56,  57,  60,  61,  64,  65,  66,  67,  70,  72,  77,  78,  80,  81,  83,  84,  89,  92,  93,  95,  99, 103, 116,
+    118, 119, 126, 127, 129, 131, 133, 141, 143, 147, 148, 151, 155, 157, 159, 160, 162, 166, 167, 168, 173, 175, 176, 177,
+    179, 181, 182, 185, 186, 188, 196, 198, 201, 202, 203, 205, 210, 212, 213, 215, 216, 218, 223, 224, 225, 227, 231, 238,
+    239, 242, 249, 250,   0,   1,   4,   5,   8,  11,  12,  13,  14,  15,  18,  25,  26,  27,  28,  33,  34,  35,  37,  38,
+     40,  42,  48,  52,  54,  57,  61,  63,  74,  83,  84,  85,  89,  90,  92,  93,  94,  96,  97,  98, 106, 107, 109, 110,
+    111, 115, 116, 117, 119, 120, 121, 124, 125, 126, 129, 130, 138, 142, 145, 148, 149, 155, 156, 160, 167, 174, 177, 178,
+    180, 187, 190, 191, 193, 195, 199, 202, 203, 204, 205, 206, 208, 211, 216, 217, 221, 222, 231, 232, 235, 237, 242, 249,
+    251, 253, 255,   2,   5,  10,  11,  12,  18,  19,  20,  23,  25,  27,  30,  31,  33,  34,  35,  41,  42,  43,  46,  53,
+     54,  56,  57,  58,  61,  68,  71,  72,  75,  88,  89,  95,  97,  98, 102, 114, 120, 127, 128, 132, 141, 142, 144, 151,
+    156, 160, 162, 163, 170, 172, 174, 179, 184, 187, 193, 194, 195, 209, 211, 218, 219, 222, 223, 232, 234, 250, 251,   4,
+      5,  10,  18,  22,  29,  31,  32,  33,  35,  39,  50,  55,  56,  57,  58,  61,  62,  67,  71,  73,  76,  78,  80,  83,
+     84,  89,  91,  95,  97,  98,  99, 100, 102, 105, 106, 111, 115, 116, 120, 121, 123, 127, 128, 131, 132, 134, 137, 138,
+    139, 141, 149, 150, 152, 158, 164, 170, 171, 175, 177, 178, 179, 180, 181, 183, 186, 187, 188, 191, 192, 197, 198, 203,
+    205, 206, 210, 211, 212, 216, 219, 223, 235, 236, 239, 243,   8,  15,  17,  19,  20,  23,  27,  35,  36,  52,  55,  56,
+     62,  64,  65,  66,  78,  80,  85,  87,  90,  93,  94,  95,  96,  98, 104, 106, 112, 114, 115, 122, 125, 126, 129, 130,
+    131, 136, 140, 141, 144, 146, 147, 150, 153, 154, 155, 161, 162, 171, 174, 177, 179, 184, 185, 186, 187, 188, 189, 190,
+    191, 193, 196, 197, 201, 202, 204, 211, 213, 215, 217, 219, 221, 225, 226, 227, 229, 232, 234, 239, 240, 241, 243,  11,
+     12,  18,  23,  25,  27,  30,  31,  37,  41,  42,  43,  50,  51,  53,  54,  56,  59,  61,  62,  65,  68,  69,  89,  90,
+     92,  99, 100, 102, 105, 106, 108, 110, 116, 119, 120, 121, 133, 136, 140, 142, 147, 149, 153, 155, 156, 175, 178, 181,
+    184, 188, 192, 197, 198, 199, 203, 204, 209, 210, 213, 216, 217, 222, 225, 228, 230, 232, 234, 235, 236, 238, 241, 243,
+    245, 247, 249, 250, 251,   5,   7,   8,   9,  10,  11,  19,  21,  25,  26,  27,  29,  31,  32,  33,  35,  36,  37,  38,
+     41,  43,  44,  45,  46,  47,  56,  58,  62,  67,  74,  77,  78,  86,  88,  91,  95, 103, 107, 110, 111, 114, 118, 126,
+    127, 128, 130, 140, 143, 144, 150, 152, 156, 157, 159, 162, 165, 170, 175, 178, 182, 183, 186, 189, 194, 196, 197, 201,
+    203, 204, 209, 211, 212, 213, 221, 222, 236, 239, 242, 244, 247, 248, 254, 255,   1,   2,   6,   9,  15,  17,  19,  20,
+     21,  32,  34,  35,  43,  44,  49,  50,  56,  62,  63,  65,  69,  84,  88,  91,  92,  95, 100, 102, 109, 110, 111, 112,
+    116, 120, 122, 124, 128, 129, 130, 132, 134, 142, 145, 151, 161, 163, 164, 170, 177, 179, 185, 192, 193, 194, 195, 198,
+    212, 213, 216, 219, 223, 224, 225, 228, 235, 236, 238, 239, 241, 243, 246, 250, 254,   1,   9,  11,  15,  17,  21,  24,
+     26,  27,  29,  30,  31,  38,  39,  44,  48,  50,  62,  76,  81,  88,  99, 107, 111, 112, 120, 124, 125, 137, 138, 142,
+    146, 153, 172, 173, 174, 175, 179, 184, 185, 186, 200, 203, 207, 217, 221, 223, 241, 249, 253,   9,  20,  25,  26,  28,
+     33,  38,  54,  60,  73,  76,  78,  85,  86,  89,  98, 100, 101, 102, 103, 105, 108, 110, 125, 132, 136, 138, 143, 148,
+    149, 153, 159, 168, 172, 177, 185, 190, 195, 200, 201, 206, 208, 210, 212, 213, 215, 223, 224, 229, 230, 231, 236, 237,
+    238, 245, 249, 251, 252, 255,   6,  13,  16,  27,  40,  42,  44,  45,  48,  50,  53,  54,  58,  59,  60,  61,  62,  63,
+     64,  70,  71,  72,  75,  76,  82,  88,  89,  91,  93,  95,  97,  98, 103, 105, 114, 116, 121, 125, 126, 128, 129, 130,
+    135, 146, 150, 160, 162, 167, 172, 175, 178, 182, 185, 194, 195, 196, 198, 206, 208, 210, 215, 217, 219, 224, 225, 226,
+    233, 236, 237, 247, 248, 249, 252, 253,  10,  22,  23,  27,  28,  29,  31,  37,  41,  42,  43,  46,  47,  52,  54,  55,
+     62,  63,  68,  69,  78,  79,  87,  99, 104, 106, 112, 114, 117, 120, 122, 123, 132, 135, 137, 139, 150, 169, 178, 179,
+    187, 192, 194, 200, 202, 205, 206, 222, 224, 229, 234, 237, 238, 241, 248, 254,   3,   5,   6,   9,  34,  37,  50,  51,
+     52,  53,  54,  58,  63,  65,  85,  89,  90,  91,  92,  94,  95,  96,  99, 100, 105, 106, 111, 112, 115, 118, 126, 131,
+    139, 158, 162, 167, 176, 189, 202, 207, 212, 220, 224, 226, 227, 230, 231, 233, 238, 240, 241, 242, 246, 247, 248,   3,
+      4,   5,  12,  13,  14,  17,  19,  21,  24,  26,  28,  30,  31,  35,  37,  38,  40,  43,  44,  48,  49,  50,  51,  55,
+     56,  58,  59,  60,  68,  70,  73,  74,  75,  76,  77,  79,  81,  84,  89,  90,  91,  92,  93,  96,  98, 100, 101, 102,
+    103, 105, 106, 107, 109, 112, 115, 116, 118, 119, 120, 127, 130, 134, 135, 137, 138, 139, 142, 143, 145, 148, 154, 157,
+    163, 165, 171, 177, 178, 179, 181, 184, 185, 188, 189, 190, 194, 195, 197, 199, 202, 205, 210, 212, 213, 216, 217, 219,
+    222, 226, 227, 233, 240, 242, 243, 244, 250, 252, 254, 255,   1,   9,  11,  13,  31,  32,  33,  34,  36,  39,  48,  52,
+     59,  66,  70,  71,  72,  76,  82,  86,  88,  92,  97,  98, 103, 104, 105, 106, 108, 112, 114, 118, 120, 122, 123, 124,
+    125, 126, 128, 131, 132, 134, 135, 136, 139, 142, 144, 147, 150, 153, 154, 174, 176, 180, 183, 184, 185, 186, 191, 194,
+    195, 198, 200, 202, 205, 210, 214, 215, 219, 220, 222, 223, 225, 227, 228, 229, 231, 234, 238, 242, 244, 248, 251, 254,
+      1,   4,   7,   8,   9,  11,  12,  27,  30,  31,  32,  36,  37,  38,  41,  55,  56,  58,  60,  64,  71,  90,  91,  97,
+     99, 101, 102, 104, 107, 121, 126, 127, 139, 142, 145, 158, 160, 165, 172, 173, 176, 179, 182, 185, 187, 188, 189, 191,
+    199, 205, 215, 218, 219, 220, 226, 227, 229, 231, 233, 237, 238, 239, 243, 252,   2,  12,  18,  20,  21,  32,  37,  38,
+     39,  50,  52,  58,  63,  69,  93, 107, 108, 111, 114, 116, 124, 129, 134, 135, 140, 141, 142, 145, 147, 149, 151, 154,
+    163, 167, 169, 170, 175, 181, 186, 188, 190, 193, 197, 198, 202, 203, 208, 209, 212, 218, 231, 232, 236, 239, 244, 253,
+      1,   7,  14,  17,  18,  25,  38,  42,  43,  44,  58,  60,  62,  64,  65,  71,  72,  73,  80,  83,  85,  86,  87,  90,
+     93,  94,  95,  96,  98, 101, 104, 109, 119, 122, 127, 128, 129, 132, 133, 138, 141, 142, 143, 157, 166, 167, 170, 174,
+    176, 179, 185, 186, 189, 190, 191, 192, 193, 201, 203, 209, 210, 213, 216, 223, 225, 227, 228, 230, 231, 233, 236, 240,
+    251,   0,   8,  11,  13,  14,  20,  23,  24,  25,  26,  28,  31,  32,  46,  49,  50,  55,  59,  60,  61,  62,  63,  64,
+     66,  67,  70,  73,  77,  78,  79,  80,  87,  97,  98,  99, 105, 107, 112, 116, 118, 121, 122, 125, 127, 129, 131, 132,
+    136, 146, 147, 149, 150, 151, 152, 159, 169, 170, 174, 175, 176, 182, 186, 191, 195, 196, 197, 199, 200, 202, 203, 205,
+    207, 210, 211, 213, 217, 218, 220, 221, 223, 224, 225, 226, 227, 229, 230, 234, 237, 239, 240, 246, 248, 249, 250, 255,
+      2,   4,   6,   8,  10,  11,  15,  17,  24,  25,  27,  30,  32,  37,  38,  40,  44,  51,  53,  54,  57,  69,  70,  72,
+     73,  75,  76,  77,  79,  80,  81,  82,  84,  86,  93, 101, 103, 108, 110, 112, 113, 116, 117, 122, 134, 135, 139, 141,
+    143, 146, 148, 149, 151, 152, 153, 154, 156, 157, 159, 161, 170, 173, 177, 180, 184, 192, 193, 196, 198, 199, 201, 203,
+    204, 207, 221, 224, 228, 229, 230, 233, 237, 243, 246, 247,   0,   7,  13,  17,  18,  19,  20,  23,  31,  33,  35,  39,
+     42,  43,  55,  56,  61,  62,  63,  64,  67,  76,  77,  79,  80,  84,  86,  88,  95,  96, 100, 101, 108, 115, 117, 126,
+    129, 130, 131, 137, 139, 141, 144, 146, 149, 151, 152, 155, 159, 161, 162, 164, 165, 167, 168, 171, 173, 174, 177, 178,
+    179, 185, 189, 190, 192, 194, 197, 202, 206, 210, 214, 216, 220, 222, 223, 224, 226, 231, 239, 242, 244, 246, 248, 250,
+    251, 254,   0,   2,   4,   5,   6,  10,  11,  13,  16,  20,  21,  23,  24,  25,  26,  27,  28,  32,  33,  34,  43,  44,
+     46,  47,  48,  50,  51,  53,  57,  58,  63,  66,  67,  68,  69,  70,  75,  76,  78,  79,  80,  86,  91,  94,  97,  98,
+     99, 102, 104, 110, 113, 114, 115, 117, 118, 121, 125, 137, 143, 147, 153, 154, 155, 156, 159, 162, 163, 171, 172, 173,
+    174, 175, 176, 177, 178, 180, 181, 184, 186, 187, 189, 190, 191, 199, 202, 203, 207, 209, 210, 213, 216, 218, 220, 221,
+    222, 224, 225, 228, 232, 233, 236, 239, 242, 244, 251,   1,   4,   5,   9,  10,  11,  18,  27,  30,  31,  33,  34,  35,
+     38,  43,  46,  49,  50,  53,  55,  57,  58,  59,  61,  62,  65,  67,  70,  74,  75,  77,  84,  85,  86,  89,  90,  93,
+     94, 102, 103, 105, 106, 109, 112, 121, 123, 124, 125, 127, 130, 131, 136, 137, 140, 142, 143, 144, 146, 147, 148, 150,
+    155, 156,  54,  56,  58,  69,  76,  77,  78,  80,  81,  84,  85,  88,  95,  96, 103, 104, 105, 106, 107, 110, 112, 114,
+    117, 119, 120, 121, 130, 131, 133, 134, 135, 136, 138, 140, 142, 148, 154, 157, 158, 163, 164, 168, 169, 174, 175, 178,
+    182, 184, 185, 189, 193, 197, 198, 202, 204, 210, 212, 213, 224, 225, 230, 233, 235, 240, 243, 249, 251, 252,   0,   1,
+      3,   4,   5,   6,  11,  12,  16,  18,  21,  23,  24,  25,  28,  33,  40,  51,  54,  59,  61,  63,  70,  74,  82,  86,
+     88,  90,  94,  95,  97,  98, 104, 111, 112, 114, 115, 116, 118, 119, 121, 125, 126, 127, 132, 133, 134, 135, 137, 139,
+    140, 147, 150, 152, 154, 155, 157, 161, 162, 165, 169, 170, 172, 173, 175, 177, 178, 180, 186, 195, 196, 198, 204, 206,
+    214, 217, 218, 219, 221, 222, 225, 228, 229, 239, 241, 244, 248, 252, 253,   2,   5,   6,   7,   8,   9,  10,  26,  27,
+     35,  41,  47,  49,  51,  57,  62,  70,  75,  78,  80,  81,  83,  84,  85,  95, 101, 102, 107, 110, 112, 113, 116, 120,
+    121, 122, 127, 128, 130, 131, 136, 138, 143, 147, 149, 154, 156, 157, 160, 163, 164, 168, 169, 176, 179, 181, 184, 186,
+    189, 190, 191, 192, 194, 198, 200, 201, 205, 209, 211, 216, 217, 218, 223, 224, 227, 229, 231, 232, 234, 237, 243, 244,
+    250, 251, 252, 254,   1,   2,   5,   7,   8,   9,  10,  12,  13,  14,  16,  18,  22,  23,  24,  27,  28,  30,  31,  41,
+     42,  43,  44,  46,  51,  53,  54,  55,  56,  57,  64,  71,  88,  89,  90,  93,  95,  98, 100, 102, 104, 106, 107, 110,
+    111, 113, 114, 118, 119, 120, 126, 139, 141, 146, 153, 157, 159, 165, 166, 171, 172, 173, 175, 177, 179, 184, 185, 187,
+    189, 197, 209, 210, 211, 212, 215, 217, 219, 220, 222, 223, 225, 227, 229, 230, 231, 235, 241, 243, 244, 249, 250, 251,
+      2,   3,   4,   5,   6,   9,  14,  22,  23,  24,  28,  35,  40,  43,  47,  49,  50,  52,  53,  54,  56,  57,  64,  69,
+     73,  74,  79,  80,  82,  88, 115, 117, 119, 123, 124, 133, 135, 137, 138, 142, 147, 150, 154, 158, 159, 160, 162, 168,
+    170, 171, 177, 181, 189, 193, 197, 202, 204, 206, 211, 214, 216, 220, 223, 224, 233, 235, 239, 240, 241, 242, 244, 247,
+    251, 253,   3,   4,   7,  11,  12,  13,  14,  19,  32,  34,  41,  42,  44,  49,  53,  56,  60,  61,  70,  73,  78,  87,
+     91,  97,  98,  99, 102, 105, 107, 108, 109, 110, 111, 113, 117, 119, 121, 122, 130, 132, 139, 144, 148, 153, 156, 159,
+    161, 173, 178, 184, 185, 187, 188, 191, 193, 196, 198, 201, 202, 203, 205, 208, 209, 214, 217, 218, 236, 238, 244, 252,
+    255,   0,   6,  17,  19,  20,  21,  23,  24,  26,  31,  33,  38,  44,  45,  53,  61,  64,  65,  67,  72,  73,  74,  75,
+     78,  85,  87,  88,  90,  99, 104, 105, 106, 109, 119, 126, 128, 132, 135, 136, 138, 144, 145, 148, 151, 153, 155, 156,
+    164, 166, 168, 169, 170, 171, 172, 174, 175, 185, 186, 193, 201, 205, 207, 208, 213, 220, 221, 228, 229, 233, 234, 247,
+    249, 250, 251, 254,   2,   6,   7,  10,  11,  19,  22,  23,  26,  34,  45,  47,  48,  63,  77,  78,  80,  84,  85,  90,
+     92,  94,  95, 103, 107, 113, 121, 123, 138, 139, 140, 147, 149, 163, 164, 169, 170, 171, 175, 176, 182, 196, 198, 199,
+    201, 203, 205, 206, 212, 217, 219, 222, 223, 228, 233, 236, 237, 238, 239, 248, 249, 251, 254,   0,   2,   3,   6,   8,
+      9,  10,  13,  17,  18,  24,  26,  28,  37,  41,  52,  55,  59,  63,  73,  75,  76,  78,  83,  85,  87,  89,  95,  96,
+     99, 102, 104, 106, 110, 116, 118, 120, 127, 130, 141, 159, 162, 171, 175, 179, 186, 187, 189, 192, 196, 198, 199, 203,
+    208, 210, 224, 239, 242, 246, 247, 249, 251, 254,   5,  13,  14,  15,  17,  21,  22,  33,  34,  35,  39,  49,  54,  57,
+     59,  64,  66,  68,  70,  76,  77,  82,  83,  87,  89,  91,  93,  94,  97,  98,  99, 104, 107, 112, 114, 117, 119, 125,
+    126, 127, 129, 130, 136, 139, 141, 146, 150, 151, 153, 158, 162, 164, 171, 174, 176, 177, 180, 181, 183, 191, 193, 194,
+    195, 196, 197, 207, 212, 213, 216, 217, 220, 221, 223, 225, 232, 242, 243, 244, 248, 249, 252, 253, 254,   2,   4,   7,
+     10,  12,  16,  18,  19,  29,  30,  37,  42,  43,  54,  56,  59,  65,  67,  68,  76,  77,  86,  94,  95,  96, 100, 102,
+    106, 109, 111, 114, 116, 119, 126, 127, 129, 131, 134, 135, 136, 138, 139, 143, 147, 150, 151, 152, 154, 161, 166, 167,
+    169, 170, 172, 175, 178, 179, 186, 189, 191, 192, 210, 218, 220, 221, 227, 230, 231, 244, 248,   0,   2,   3,   8,  10,
+     12,  14,  16,  19,  22,  23,  24,  27,  29,  31,  35,  37,  42,  45,  49,  51,  52,  54,  58,  59,  60,  65,  70,  72,
+     80,  81,  82,  84,  85,  91,  94,  96,  98,  99, 102, 105, 107, 108, 109, 110, 112, 113, 114, 115, 124, 130, 132, 133,
+    135, 137, 140, 141, 145, 147, 149, 152, 154, 158, 160, 161, 163, 164, 165, 166, 168, 172, 173, 176, 178, 185, 188, 191,
+    194, 196, 199, 203, 204, 205, 207, 210, 214, 218, 219, 220, 222, 224, 225, 226, 228, 230, 231, 235, 237, 238, 241, 243,
+    247, 248, 250, 254,   0,   1,   2,   4,   7,  12,  14,  16,  20,  22,  23,  25,  26,  27,  29,  32,  33,  38,  40,  43,
+     44,  51,  57,  62,  65,  73,  76,  78,  79,  86,  88,  90,  91,  92,  95, 102, 107, 108, 111, 112, 113, 114, 116, 119,
+    125, 128, 131, 138, 140, 142, 144, 146, 147, 150, 153, 154,  55,  58,  63,  65,  70,  72,  74,  76,  78,  80,  85,  90,
+     97,  98, 106, 107, 108, 120, 121, 122, 124, 130, 133, 137, 138, 140, 141, 142, 148, 152, 157, 158, 160, 161, 162, 167,
+    168, 169, 170, 171, 172, 173, 174, 175, 176, 178, 179, 180, 182, 183, 184, 187, 188, 189, 191, 192, 193, 194, 195, 196,
+    199, 200, 202, 205, 206, 209, 211, 218, 219, 220, 222, 224, 226, 227, 228, 230, 234, 237, 250, 251, 252, 253,   4,   5,
+      7,   8,  10,  11,  13,  15,  16,  19,  20,  22, 100, 102, 103, 107, 109, 112, 113, 115, 116, 119, 129, 133, 138, 153,
+    163, 168, 179, 186, 190, 194, 203, 204, 207, 214, 218, 219, 221, 223, 225, 227, 232, 234, 235, 239, 243, 245, 252, 255,
+      8,   9,  10,  15,  16,  29,  30,  31,  42,  48,  52,  53,  66,  68,  71,  72,  73,  74,  76,  80,  85,  89,  95,  96,
+     99, 100, 114, 116, 118, 124, 129, 132, 133, 135, 138, 139, 141, 145, 147, 148, 153, 161, 170, 171, 172, 175, 176, 177,
+    190, 197, 198, 200, 202, 203, 204, 205, 210, 219, 223, 226, 227, 235, 248, 251, 252, 253, 254,   3,   5,   9,  10,  12,
+     18,  19,  20,  21,  25,  27,  28,  29,  31,  38,  41,  42,  47,  51,  56,  57,  59,  62,  63,  66,  68,  69,  70,  73,
+     76,  77,  78,  87,  92,  95,  97,  98,  99, 100, 155, 156, 158, 159, 163, 167, 168, 173, 174, 175, 176, 177, 178, 183,
+    186, 187, 188, 191, 194, 196, 197, 206, 209, 212, 218, 226, 229, 230, 233, 234, 235, 237, 239, 240, 244, 247, 248, 249,
+    250, 253,   0,   1,   3,   5,   6,  11,  13,  14,  15,  16,  17,  19,  20,  21,  22,  23,  25,  26,  29,  30,  31,  32,
+     33,  34,  35,  39,  46,  49,  50,  53,  54,  56,  57,  60,  62,  65,  66,  69,  71,  73,  74,  75,  77,  78,  79,  80,
+     81,  82,  83,  84,  85,  86,  88,  89,  92,  94,  96,  97,  99, 101, 104, 105, 109, 110, 111, 114, 117, 118, 119, 120,
+    122, 124, 125, 127, 128, 129, 130, 131, 132, 135, 137, 138, 143, 145, 163, 166, 168, 170, 175, 177, 181, 184, 193, 202,
+    206, 219, 225, 226, 228, 232, 237, 245, 247, 253,   2,  18,  25,  45,  48,  50,  73,  74,  75,  76,  77,  78,  82,  84,
+     86,  88,  98,  99, 101, 105, 106, 108, 114, 115, 117, 119, 120, 130, 135, 137, 139, 141, 144, 146, 151, 156, 162, 164,
+    170, 171, 175, 180, 181, 184, 186, 192, 193, 198, 199, 200, 201, 203, 204, 205, 206, 207, 208, 209, 214, 216, 219, 220,
+    221, 223, 225, 227, 230, 231, 245, 246, 252, 255,  13,  14,  17,  20,  21,  30,  41,  44,  52,  55,  63,  68,  69,  72,
+     73,  75,  80,  87,  90,  91,  94,  98, 100, 102, 113, 126, 128, 131, 133, 145, 147, 149, 150, 152, 154, 155, 156, 173,
+    183, 185, 207, 210, 228, 233, 234, 237, 242, 243, 248, 250, 252,   6,  15,  16,  24,  25,  26,  32,  34,  35,  38,  40,
+     43,  44,  46,  47,  50,  53,  58,  59,  68,  75,  77,  84,  86,  91,  92,  96, 108, 110, 117, 124, 126, 140, 148, 150,
+    151, 154, 167, 172, 173, 174, 176, 185, 195, 200, 208, 209, 214, 215, 216, 221, 225, 228, 229, 232,   3,   7,  16,  19,
+     20,  24,  25,  26,  33,  43,  53,  54,  56,  58,  65,  68,  81,  82,  83,  90,  91,  94,  96,  98, 106, 112, 117, 119,
+    124, 125, 126, 127, 129, 119, 128, 130, 131, 135, 137, 138, 139, 143, 145, 147, 148, 150, 152, 153, 160, 162, 163, 164,
+    165, 167, 168, 173, 178, 185, 187, 188, 190, 195, 199, 202, 204, 205, 212, 213, 214, 216, 220, 225, 226, 229,  28,  33,
+     40,  42,  46,  47,  50,  59,  63,  64,  66,  68,  75,  76,  77,  79,  80,  91,  92,  93,  94,  95,  98,  99, 100, 101,
+    102, 106, 108, 112, 114, 115, 117, 118, 119, 120, 122, 125, 133, 134, 136, 138, 139, 141, 142, 143, 148, 149, 151, 152,
+    153, 155, 156, 160, 163, 167, 168, 170, 176, 177, 178, 180, 182, 183, 184, 185, 187, 188, 192, 193, 196, 197, 198, 199,
+    201, 203, 204, 205, 206, 209, 213, 214, 217, 219, 220, 226, 227, 232, 234, 235, 240, 242, 246, 247, 249, 251,   0,   4,
+      6,   7,   8,  10,  13,  14,  15,  17,  19,  22,  25,  28,  30,  36,  39,  42,  48,  50,  56,  57,  61,  62,  66,  68,
+     70,  72,  73,  82,  86,  89,  92,  94,  96,  97,  98, 100, 102, 104, 105, 107, 109, 113, 116, 121, 122, 124, 129, 132,
+    133, 134, 139, 141, 143, 144, 152, 156, 160, 163, 166, 168, 171, 173, 179, 180, 195, 198, 200, 203, 211, 220, 237, 238,
+    242, 243, 245, 246, 251, 255,   1,   2,   3,   5,   6,   8,  12,  15,  16,  17,  18,  19,  23,  24,  26,  33,  36,  44,
+     45,  52,  55,  56,  59,  60,  61,  70,  75,  76,  77,  78,  79,  84,  85,  88,  91,  94, 103, 107, 111, 112, 113, 115,
+    116, 168, 170, 175, 177, 182, 195, 196, 198, 219, 220, 223, 226, 233, 235, 237, 238, 239, 242, 244, 252, 253, 254,   3,
+      5,   9,  10,  12,  16,  18,  19,  20,  24,  29,  30,  32,  33,  36,  40,  44,  46,  61,  62,  66,  69,  73,  75,  76,
+     80,  81,  82,  85,  87, 150, 151, 152, 153, 165, 168, 172, 173, 174, 179, 180, 188, 193, 196, 197, 198, 200, 208, 209,
+    210, 213, 216, 219, 221, 223, 226, 237, 238, 241, 242, 248, 251, 255,   1,   5,  14,  15,  18,  19,  25,  40,  43,  48,
+     55,  62,  64,  66,  67,  69,  77,  85,  87,  90,  91,  95,  98, 100, 101, 105, 106, 107, 168, 173, 176, 184, 188, 192,
+    196, 207, 209, 211, 212, 216, 222, 223, 226, 227, 230, 234, 235, 237, 238, 239, 241, 244, 247, 251,   6,  24,  26,  31,
+     34,  35,  37,  39,  40,  41,  42,  46,  47,  49,  50,  59,  60,  65,  66,  67,  68,  69,  77,  78,  79,  81,  84,  88,
+     90, 111, 116, 131, 142, 145, 146, 147, 150, 151, 159, 160, 168, 170, 171, 173, 174, 180, 185, 192, 198, 201, 202, 207,
+    209, 210, 212, 214, 219, 225, 226, 227, 228, 232, 240, 241, 242, 245,   4,   6,   8,   9,  10,  12,  13,  16,  18,  19,
+     20,  21,  27,  33,  36,  37,  45,  46,  47,  48,  50,  57,  58,  59,  62,  70,  71,  72,  82,  87,  90,  96, 103, 118,
+    120, 229, 231, 233, 235, 236, 240, 243, 244, 246,   3,   6,   7,   8,   9,  14,  18,  21,  27,  31,  35,  38,  40,  42,
+     43,  44,  59,  62,  63,  65,  68,  70,  72,  80,  81,  89,  92,  93,  94,  96,  97, 100, 108, 111, 114, 122, 135, 137,
+    143, 154, 164, 169, 171, 175, 178, 180, 184, 186, 187, 193, 194, 196, 198, 207, 211, 217, 230, 237, 239, 242, 248, 249,
+    250, 253,  26,  27,  30, 117, 120, 121, 125, 127, 129, 136, 139, 140, 145, 146, 147, 149, 151, 157, 159, 165, 166, 169,
+    170, 173, 184, 185, 186, 187, 188, 190, 191, 196, 204, 205, 206, 207, 208, 210, 212, 216, 217, 219, 220, 221, 222, 224,
+    229, 232, 239, 244, 246, 247, 249, 251, 252, 253,   7,   8,  14,  19,  21,  32,  33,  44,  59,  62,  74,  75,  78,  79,
+     82,  84,  95,  96,  97,  98,  99, 102, 103, 106, 108, 114, 118, 119, 141, 149, 156, 157, 160,   1,   3,   4,   5,   6,
+      8,   9,  10,  11,  12,  14,  15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25,  26,  27,  28,  29,  30,  31,  32,
+     33,  34,  35,  36,  37,  38,  39,  40,  41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51,  52,  53,  54,  55,  56,
+     57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,  72,  73,  74,  75,  76,  77,  78,  79,  80,
+     81,  82,  83,  84,  85,  86,  87,  88,  89,  90,  91,  92,  93, 224, 225, 226, 227, 229
+};
+const unsigned short KANJI_VALUES[KANJI_CHARACTERS] = {
+      81,   82,   88,   14,  138,   75,   61,   12,  183,   62,   64,  479,  480,  481,  482,  483,  484,  485,  486,  487,
+     488,  489,  490,  491,  492,  493,  494,  495,  496,  497,  498,  499,  500,  501,  502,  511,  512,  513,  514,  515,
+     516,  517,  518,  519,  520,  521,  522,  523,  524,  525,  526,  527,  528,  529,  530,  531,  532,  533,  534,  582,
+     576,  577,  578,  579,  580,  581,  583,  584,  585,  586,  587,  588,  589,  590,  591,  592,  593,  594,  595,  596,
+     597,  598,  599,  600,  601,  602,  603,  604,  605,  606,  607,  608,  624,  625,  626,  627,  628,  629,  631,  632,
+     633,  634,  635,  636,  637,  638,  640,  641,  642,  643,  644,  645,  646,  647,  648,  649,  650,  651,  652,  653,
+     654,  655,  656,  657,  630,   29,   28,   33,   37,   38,   39,   40,  181,  182,   36,   35,  177,   76,   77,  102,
+      78,  176,  105,  106,  104,  107,  139,  140,  141,  157,  142,  158,  120,  121,   60,  163,  165,   71,  154,  136,
+     137,  127,  126,  167,  168,   72,  166,  164,  160,   66,  159,   69,   70,  161,  162,  124,  125,  122,  123,  155,
+     156,  671,  682,  672,  683,  673,  684,  674,  685,  676,  687,  675,  686,  677,  698,  693,  688,  679,  700,  695,
+     690,  678,  694,  699,  689,  680,  696,  701,  691,  681,  697,  702,  692,   97,   96,   99,   98,  101,  100,   95,
+      94,   91,   93,   92,  188,   90,   89,   74,   73,  180,  179,  178,    0,    1,    2,   22,   24,   25,   26,   49,
+      50,   51,   52,   53,   54,   55,   56,   57,   58,  103,  108,   43,   44,   32,  287,  288,  289,  290,  291,  292,
+     293,  294,  295,  296,  297,  298,  299,  300,  301,  302,  303,  304,  305,  306,  307,  308,  309,  310,  311,  312,
+     313,  314,  315,  316,  317,  318,  319,  320,  321,  322,  323,  324,  325,  326,  327,  328,  329,  330,  331,  332,
+     333,  334,  335,  336,  337,  338,  339,  340,  341,  342,  343,  344,  345,  346,  347,  348,  349,  350,  351,  352,
+     353,  354,  355,  356,  357,  358,  359,  360,  361,  362,  363,  364,  365,  366,  367,  368,  369,   10,   11,   20,
+      21,  384,  385,  386,  387,  388,  389,  390,  391,  392,  393,  394,  395,  396,  397,  398,  399,  400,  401,  402,
+     403,  404,  405,  406,  407,  408,  409,  410,  411,  412,  413,  414,  415,  416,  417,  418,  419,  420,  421,  422,
+     423,  424,  425,  426,  427,  428,  429,  430,  431,  432,  433,  434,  435,  436,  437,  438,  439,  440,  441,  442,
+     443,  444,  445,  446,  448,  449,  450,  451,  452,  453,  454,  455,  456,  457,  458,  459,  460,  461,  462,  463,
+     464,  465,  466,  467,  468,  469,  470,    5,   27,   18,   19, 1514, 3354, 2613, 4124, 2852, 2511, 2851, 1658, 3891,
+    4254, 4512, 1550, 1806, 4513, 2978, 4736, 1973, 3960, 2853, 4348, 3968, 4514, 3334, 4515, 2104, 4516, 1883, 3279, 2661,
+    4517, 4518, 4519, 3668, 1974, 3670, 3617, 2241, 4050, 6952, 4520, 2854, 4521, 1651, 2083, 2286, 4199, 5092, 4304, 3643,
+    1827, 1940, 4522, 4523, 4345, 4252, 3144, 4525, 2582, 3633, 4528, 1565, 2269, 2268, 1508, 4458, 4457, 2417, 1439, 4529,
+    4530, 4531, 4051, 4532, 2288, 1509, 4114, 2012, 2013, 2014, 3424, 4346, 4533, 4534, 4535, 2924, 2713, 2925, 4540, 4538,
+    4539, 1975, 2401, 1710, 4537, 4536, 3943, 2533, 2532, 3196, 4541, 3892, 3045,   23, 4542, 4544, 3235, 4383, 1480, 4543,
+    1660, 2050, 3335, 2191, 4545, 3651, 1897, 4546, 1481, 2270, 1898, 3930, 3760, 1976, 1711, 4581, 3488, 3724, 4548, 3770,
+    4384, 2892, 2534, 2583, 1662, 3407, 3265, 4552, 1482, 3425, 2714, 2418, 4227, 3212, 1661, 4551, 4253, 4547, 4549, 2476,
+    4550, 4995, 4558, 4561, 4559, 1664, 3961, 4553, 4557, 2289, 2535, 1828, 4562, 4554, 4385, 2584, 4555, 4560, 4563, 4556,
+    2015, 1483, 2016, 1663, 4996, 4121, 3918, 2290, 2894, 4341, 3990, 2135, 3171, 1698, 2738, 4567, 4572, 4570, 4565, 3181,
+    4568, 4571, 4569, 3995, 4566, 2893, 4115, 4573, 4574, 2691, 4587, 3695, 3861, 4582, 4014, 1652, 4586, 4580, 4589, 3121,
+    2242, 3707, 6085, 4588, 3516, 4577, 2292, 2291, 4575, 2648, 4583, 4013, 3308, 4579, 2193, 4576, 4584, 4578, 4367, 4585,
+    4448, 2084, 2192, 4590, 4591, 4595, 1484, 3982, 4594, 4593, 4597, 4596, 3426, 2194, 4598, 2627, 3172, 3427, 2100, 4599,
+    1941, 4600, 4602, 4052, 2182, 2512, 3829, 4601, 2435, 4258, 4604, 4610, 4603, 2434, 2781, 2136, 4611, 2061, 4608, 4609,
+    3565, 3164, 2017, 4076, 4612, 4347, 4613, 4616, 4614, 3117, 4615, 4617, 4619, 4618, 3974, 1942, 4621, 4622, 1645, 4620,
+    2674, 4625, 4624, 4623, 4564, 4626, 2782, 4627, 4228, 4183, 4629, 4628, 4631, 4630, 4632, 4633, 1522, 2227, 2138, 2715,
+    3355, 2018, 3046, 2293, 2382, 4635, 4166, 3493, 2585, 4634, 4636, 3517, 1813, 4637, 3644, 3091, 4639, 4640, 3754, 2294,
+    4442, 4641, 2020, 3962, 3188, 2095, 3476, 2195, 4642, 4643, 3616, 1598, 4646, 2491, 4645, 2436, 4647, 6700, 4648, 4064,
+    4649, 4650, 4651, 2855, 2634, 1829, 4654, 4652, 4155, 4653, 3897, 4655, 4656, 4657, 3518, 4661, 4659, 4660, 4658, 2465,
+    4662, 4200, 4386, 4663, 2982, 4664, 2745, 4665, 3356, 4349, 3520, 4739, 4666, 7971, 2051, 4667, 4093, 2760, 3258, 4669,
+    3618, 4670, 4672, 1741, 4673, 2021, 3594, 1626, 2735, 3743, 4674, 3521, 2926, 4675, 3946, 3032, 1824, 1831, 4676, 4678,
+    2137, 4677, 4401, 2761, 3771, 3978, 4679, 4312, 4680, 4681, 3550, 4682, 2983, 2492, 2196, 4683, 2536, 2383, 3428, 4685,
+    3173, 2477, 4686, 4687, 3087, 4684, 4689, 4053, 2372, 4688, 2197, 2460, 3725, 4692, 4690, 3931, 2856, 4699, 1796, 4693,
+    4691, 3118, 4695, 4694, 1763, 2176, 4700, 4331, 4696, 4701, 4698, 4697, 4365, 2295, 1665, 4402, 2773, 3511, 2373, 4704,
+    4705, 4387, 4426, 4707, 2296, 4706, 1742, 4708, 4085, 3386, 4229, 3991, 4709, 7635, 3566, 4710, 1832, 4145, 2783, 4711,
+    4005, 4715, 2984, 4712, 2062, 4713, 1833, 2125, 4716, 4717, 4718, 4719, 2649, 2297, 4188, 4198, 3637, 4015, 4720, 4721,
+    4723, 4725, 4724, 4726, 1659, 4075, 2490, 4727, 3128, 2784, 2023, 4728, 3801, 4729, 4730, 4731, 4732, 3843, 2086, 1507,
+    3581, 4733, 2716, 3047, 4735, 4734, 2785, 2271, 4737, 3772, 4738, 3802, 3186, 3244, 2022, 3628, 3280, 3726, 4077, 4740,
+    3048, 2132, 4741, 4742, 1547, 1523, 1899, 3174, 1968, 4305, 4745, 1653, 4744, 2024, 4746, 4207, 4747, 4368, 2298, 2228,
+    4748, 4750, 4749, 2942, 1560, 1597, 4751, 4752, 2229, 4753, 1998, 2513, 4754, 4116, 2419, 1977, 4230, 3119, 3773, 2683,
+    2726, 2662, 2675, 2774, 3774, 4757, 1570, 3120, 2299, 2243, 2085, 4761, 3264, 3260, 2025, 2786, 4762, 4760, 1666, 3236,
+    2614, 2538, 1541, 1808, 2374, 2537, 4763, 4764, 1960, 1765, 2375, 1959, 3421, 1540, 3567, 4156, 2304, 4313, 3494, 2300,
+    2126, 4773, 2081, 4073, 3803, 4772, 1884, 4767, 4768, 4770, 4771, 1978, 2945, 3947, 4769, 4765, 2273, 4766, 4419, 4016,
+    3430, 2272, 2384, 4774, 3611, 4778, 2684, 2676, 4781, 4779, 4129, 4776, 4785, 4780, 4783, 2244, 4157, 4784, 4786, 4788,
+    2478, 4449, 4777, 4775, 4787, 4782, 4790, 4802, 4792, 4796, 4800, 4793, 4829, 2471, 1744, 4791, 4804, 1524, 4803, 1443,
+    3881, 4801, 4794, 4789, 4795, 2438, 4805, 1525, 4814, 4806, 4807, 2787, 4105, 4812, 4811, 3470, 4813, 4810, 1555, 2420,
+    2895, 4808, 3522, 4809, 1440, 4819, 4226, 2789, 4825, 4824, 4815, 3201, 4816, 3245, 4821, 2788, 4818, 4194, 2139, 4822,
+    4823, 4820, 4826, 4817, 4832, 4837, 4833, 4828, 4838, 3088, 4840, 2305, 4830, 3357, 4834, 4827, 1835, 1900, 1797, 4835,
+    4831, 2198, 4841, 4839, 3122, 1961, 2026, 4836, 2098, 1571, 4845, 4843, 4901, 4848, 4842, 4846, 4844, 2539, 4847, 4850,
+    4855, 4853, 4852, 3281, 1667, 4849, 4851, 2790, 1554, 4854, 1692, 4866, 2874, 4861, 4859, 4860, 4862, 1564, 3096, 4856,
+    4857, 1818, 4865, 1901, 4868, 4864, 4867, 3948, 3603, 3766, 4870, 4869, 1764, 4871, 4874, 4873, 4872, 3672, 4875, 4876,
+    4878, 4877, 4880, 4883, 4881, 4879, 4882, 4884, 4885, 4886, 4887, 4888, 4644, 2682, 2540, 1713, 1526, 3299, 4889, 2402,
+    1485, 2941, 4890, 2245, 2385, 4892, 4891, 3998, 4893, 4895, 4894, 4896, 4897, 2199, 1600, 4898, 4900, 4899, 4902, 3513,
+    4903, 1459, 2461, 2140, 3310, 4904, 4905, 4907, 4908, 2466, 2063, 4054, 4906, 4909, 2431, 2306, 4913, 2403, 3282, 4910,
+    3416, 4914, 2946, 4912, 4915, 2142, 4916, 4917, 2307, 1759, 4919, 4920, 4921, 4918, 4911, 4922, 4923, 4100, 2857, 4925,
+    4926, 4924, 4928, 3671, 1510, 3893, 4929, 2875, 2615, 3708, 1902, 2473, 4088, 3568, 2200, 3213, 4927, 4930, 3202, 4931,
+    4932, 4934, 3431, 1836, 7967, 1601, 4017, 2858, 3495, 2468, 4940, 3963, 4379, 1714, 4936, 3097, 4939, 3523, 3496, 3524,
+    3767, 3403, 2439, 4935, 1622, 3477, 4937, 4933, 2927, 4941, 2733, 2027, 4942, 4006, 3165, 3396, 4944, 4078, 4945, 4950,
+    3949, 4949, 4943, 4946, 4948, 2404, 3975, 4951, 3300, 1715, 2859, 4953, 4952, 2376, 4954, 4956, 4955, 4958, 4947, 4960,
+    4959, 4957, 2541, 2928, 3123, 4961, 3002, 1515, 3716, 3417, 4963, 4962, 4964, 4965, 4966, 4967, 3983, 4968, 1668, 4969,
+    4251, 1743, 4743, 2727, 3197, 4970, 4201, 4146, 4972, 3237, 3478, 3198, 3894, 4973, 4974, 1627, 2616, 4975, 1486, 4976,
+    4977, 1602, 1903, 3614, 4018, 4981, 3124, 4980, 2143, 4090, 4979, 3525, 4983, 4982, 4985, 4984, 1628, 4986, 2791, 4988,
+    3268, 4987, 3953, 2775, 3514, 4992, 2308, 4993, 3648, 3804, 4175, 3652, 5002, 1943, 4260, 4141, 5098, 4994, 4997, 3203,
+    4055, 3497, 4998, 4101, 2440, 2792, 4999, 2543, 2542, 1463, 2246, 2985, 1487, 5003, 5004, 5001, 1559, 1837, 5000, 4163,
+    3856, 1446, 1527, 2544, 1488, 1441, 5009, 5007, 4154, 5010, 5008, 5006, 2896, 5005, 3992, 2274, 5014, 5015, 2793, 5011,
+    4427, 3691, 5013, 2405, 5016, 3895, 5017, 5012, 4153, 3709, 5018, 3857, 5019, 5023, 5020, 1669, 5022, 2617, 5021, 2201,
+    5035, 5028, 5025, 3332, 5024, 5026, 5027, 5029, 5030, 1904, 5032, 5031, 5033, 2860, 5036, 3418, 1572, 5034, 5037, 5038,
+    5041, 5039, 5040, 2545, 5042, 2309, 5043, 2586, 3190, 5044, 5045, 2553, 2310, 4176, 1927, 2247, 5046, 1783, 5047, 3191,
+    5048, 5089, 5049, 5050, 5051, 5053, 5054, 5056, 3246, 1542, 2663, 1472, 3126, 1838, 2611, 2311, 3526, 2688, 1839, 3336,
+    3432, 1462, 1944, 4019, 2624, 1969, 3049, 2618, 4231, 5057, 1979, 2441, 1745, 1603, 2794, 1670, 5058, 4261, 2728, 2658,
+    5059, 1905, 3600, 4135, 5060, 5061, 3896, 5063, 1830, 2101, 5062, 1840, 2897, 5067, 2496, 1671, 5066, 5064, 5068, 5065,
+    3658, 5707, 2898, 5069, 4350, 5070, 5072, 3358, 5071, 2977, 2587, 3214, 2677, 3925, 3050, 2635, 5073, 2795, 5074, 5075,
+    1489, 3192, 2929, 5076, 3569, 2796, 2797, 5077, 3051, 2798, 5078, 5079, 4190, 5080, 2052, 2689, 5081, 5082, 2650, 2891,
+    3634, 2931, 3830, 3649, 2055, 5083, 1999, 5084, 2108, 3597, 1646, 2546, 5085, 5088, 5087, 2107, 5086, 3479, 3182, 3498,
+    2630, 3127, 4314, 5090, 5091, 3604, 2514, 5093, 5094, 5095, 1906, 5096, 5097, 1642, 3098, 1890, 5099, 4134, 3216, 1784,
+    5101, 5103, 1885, 5100, 5102, 5105, 5104, 5106, 5107, 3579, 2028, 1699, 5108, 5113, 5111, 4021, 4020, 3527, 5110, 2739,
+    5109, 2962, 5114, 2472, 5120, 5121, 5115, 1746, 5116, 5125, 5124, 5123, 5119, 5118, 5122, 4022, 5129, 5126, 5128, 4306,
+    5127, 5117, 2963, 5130, 2421, 5131, 5132, 5135, 5134, 5133, 3528, 5112, 5141, 5137, 5136, 5138, 5139, 5142, 4388, 5143,
+    5140, 5144, 1886, 5145, 5147, 5146, 5148, 5149, 3052, 2690, 2756, 3139, 2312, 2422, 2313, 2000, 5150, 2423, 2248, 5151,
+    4132, 3682, 5152, 2314, 1834, 3270, 2064, 2547, 3898, 3775, 5153, 1907, 5156, 3359, 5155, 5154, 5157, 3433, 2947, 2548,
+    3016, 3217, 1921, 3360, 5158, 5159, 2861, 4056, 5162, 5161, 5160, 3933, 5169, 4089, 5163, 5165, 4107, 5164, 5166, 3750,
+    5167, 3964, 5168, 1841, 3965, 3662, 5170, 5171, 2315, 1842, 5172, 2230, 4259, 4232, 1908, 5174, 3361, 2316, 2799, 3805,
+    2800, 2776, 3434, 4023, 3480, 2317, 3899, 5175, 3512, 2432, 2249, 3435, 1473, 2766, 2318, 4262, 5176, 5177, 3696, 5178,
+    4405, 4428, 5180, 5179, 1766, 5184, 5187, 5188, 5186, 3871, 2801, 5190, 5189, 5185, 5191, 5192, 5193, 5196, 5194, 5195,
+    5197, 1604, 3436, 5198, 2202, 1716, 3669, 5199, 3641, 3993, 5200, 4429, 5201, 3966, 5204, 4511, 4527, 2606, 3635, 5205,
+    1980, 3362, 1528, 5206, 3940, 2319, 3311, 3437, 4205, 2231, 2250, 5207, 5208, 5214, 2659, 3363, 2029, 5209, 3850, 3301,
+    5210, 5211, 2030, 5212, 5213, 5215, 3542, 5216, 5217, 5218, 5203, 5202, 5219, 2144, 3846, 2442, 3862, 3364, 3882, 5220,
+    2802, 1573, 5221, 5222, 4208, 3806, 5225, 1629, 2986, 5224, 5223, 2145, 3218, 5229, 5227, 5226, 4325, 2275, 2777, 5228,
+    3499, 2717, 3582, 5232, 5231, 5230, 5233, 2276, 5234, 3932, 2746, 5235, 3831, 3583, 3365, 3471, 5236, 1930, 2899, 3851,
+    1909, 3653, 5237, 2549, 4057, 4058, 1630, 5242, 3337, 5239, 1717, 5291, 5241, 3663, 5240, 5238, 2394, 5244, 5251, 5257,
+    5249, 3515, 5254, 3900, 5248, 5253, 4389, 2550, 3219, 5245, 1981, 5256, 2987, 1605, 5250, 1718, 5255, 2031, 5252, 5258,
+    5260, 5270, 5268, 5265, 5264, 4406, 5266, 2032, 2320, 2778, 5273, 5259, 5263, 5246, 1720, 5267, 5269, 3312, 2406, 1654,
+    5261, 5272, 5271, 2033, 3175, 1798, 2146, 5262, 5274, 5277, 5279, 2619, 5285, 3438, 5275, 5283, 1719, 5281, 5282, 5278,
+    5280, 2277, 4233, 1843, 1592, 5284, 3673, 1451, 3807, 5243, 5290, 5294, 4195, 5287, 3529, 5292, 2862, 5293, 3605, 4454,
+    5289, 5295, 2395, 3017, 1490, 5288, 5286, 3129, 5276, 2515, 3204, 5307, 3130, 5302, 5299, 5300, 2660, 5303, 5306, 5301,
+    2692, 5304, 5298, 4218, 4217, 5308, 5309, 1491, 5297, 2096, 1444, 1844, 5305, 5313, 5312, 5317, 5318, 5316, 5319, 5311,
+    5315, 5320, 5321, 5310, 2588, 5314, 3220, 2321, 5296, 2900, 5334, 4007, 5324, 5325, 5326, 5333, 5332, 4125, 1845, 5330,
+    2148, 1747, 5327, 4342, 5329, 1492, 5331, 5322, 5328, 5335, 2147, 5323, 4284, 4234, 5338, 5342, 3166, 4407, 5343, 5340,
+    5337, 5336, 5341, 3950, 3570, 2149, 5344, 5339, 5345, 2203, 1647, 5353, 1846, 5351, 5352, 2407, 5350, 5348, 5347, 5354,
+    5346, 5356, 1721, 5358, 5357, 3366, 5361, 5359, 5349, 2204, 5360, 5364, 5363, 5365, 5362, 5366, 5367, 5368, 4008, 5370,
+    5369, 2718, 2988, 1700, 1722, 5371, 1469, 3018, 5372, 7233, 5376, 2177, 5377, 3053, 5378, 5379, 1945, 5380, 5381, 5382,
+    3221, 2251, 4191, 4059, 2762, 5383, 3054, 7419, 3808, 2664, 2443, 5384, 3205, 3941, 3247, 5387, 5385, 5388, 5386, 5389,
+    3951, 1461, 3901, 3809, 5390, 5393, 2803, 1946, 5391, 5398, 2804, 5392, 3683, 4285, 5394, 5395, 5399, 3530, 5396, 2322,
+    3036, 5413, 3762, 3248, 3810, 5483, 4024, 3439, 4117, 5402, 1631, 3338, 5411, 3283, 5405, 5412, 5407, 5414, 5410, 5409,
+    3727, 5403, 1723, 5401, 2001, 3249, 5397, 5400, 2323, 3033, 2805, 5408, 3697, 2002, 1767, 1799, 2880, 5416, 5421, 5417,
+    2205, 5422, 2497, 2377, 2693, 5404, 2589, 5419, 2551, 5420, 1474, 5415, 3367, 2003, 2034, 5418, 1445, 2433, 2901, 3440,
+    3794, 5424, 3133, 3176, 2506, 5425, 5427, 5423, 3999, 3387, 3131, 4025, 2636, 5440, 5438, 2968, 2206, 5432, 2807, 3622,
+    3664, 5430, 3132, 2678, 5435, 2806, 5429, 5434, 3698, 5428, 2112, 1788, 5436, 4329, 2444, 3284, 5433, 3034, 2324, 2948,
+    1606, 3099, 5431, 1956, 2150, 3405, 5437, 3134, 5441, 5443, 3189, 5449, 5444, 5446, 3872, 3441, 5447, 4235, 4263, 1847,
+    1452, 5445, 5442, 1910, 1607, 5448, 4264, 5452, 3193, 5459, 5453, 5450, 5457, 5426, 5454, 5458, 3776, 3531, 5451, 5455,
+    2151, 2479, 3035, 5463, 3461, 5460, 4096, 5461, 5462, 4172, 2976, 2178, 5469, 2516, 5466, 5465, 3665, 3571, 3472, 5467,
+    5468, 3919, 3684, 2498, 3055, 4079, 1768, 5475, 5470, 4265, 5477, 5473, 5474, 3136, 5472, 5406, 5476, 5471, 5481, 5482,
+    3462, 5484, 2499, 5479, 1947, 5485, 5478, 5489, 5488, 5487, 5490, 5492, 2863, 5491, 5495, 5493, 5494, 5456, 5497, 5496,
+    5464, 5498, 5486, 2552, 5499, 5500, 5502, 5501, 5503, 1724, 2325, 4026, 2989, 2252, 5505, 5508, 3889, 1982, 5507, 5506,
+    3699, 5509, 2035, 5511, 5510, 1848, 2517, 3606, 2152, 2964, 5512, 2990, 3463, 3902, 5513, 5514, 5515, 3958, 5052, 3012,
+    3883, 2454, 3811, 3777, 3500, 4351, 5517, 2638, 5518, 1460, 2066, 3019, 3904, 5519, 2529, 3302, 2554, 2902, 5520, 4027,
+    1623, 2555, 5523, 5521, 5524, 4343, 5522, 3065, 5525, 3184, 5526, 1912, 5528, 5527, 5529, 5530, 1913, 3642, 3285, 1996,
+    2556, 3137, 2747, 1454, 5531, 1632, 5535, 2326, 5534, 2409, 2808, 5533, 2809, 4158, 2408, 1493, 3020, 5540, 2991, 1574,
+    2740, 4102, 2480, 2810, 2981, 5539, 5537, 5538, 3339, 5573, 5544, 2590, 2327, 5542, 5543, 2903, 5541, 2510, 5546, 5545,
+    5550, 5551, 5547, 1729, 5548, 5549, 3795, 3905, 2153, 5552, 2992, 2811, 3313, 2053, 5553, 5557, 1673, 5554, 5556, 5555,
+    2763, 3303, 1475, 5558, 5559, 3368, 4399, 2530, 4009, 4060, 5569, 5561, 5564, 5563, 5560, 5568, 3612, 5562, 5570, 2764,
+    5571, 4266, 3736, 5572, 5574, 5575, 5576, 2056, 1575, 2328, 5577, 5578, 2769, 3138, 4758, 3101, 3100, 3222, 2437, 4592,
+    2190, 4236, 4028, 3934, 5579, 2481, 3389, 5580, 4430, 4061, 3369, 5581, 1914, 5582, 5583, 4184, 4130, 4118, 4091, 2500,
+    5585, 2665, 4080, 5587, 5590, 5589, 1911, 1984, 5586, 5588, 5591, 2969, 4315, 1479, 2462, 3194, 2651, 2865, 5594, 3501,
+    5592, 3177, 5593, 2864, 4187, 5595, 5596, 4296, 5601, 2329, 3700, 5598, 3532, 5532, 5536, 1966, 3686, 5600, 2812, 3778,
+    5606, 3832, 5597, 5603, 5602, 3021, 4109, 4369, 4103, 1674, 2557, 4455, 5605, 2965, 5604, 5599, 2253, 5611, 5609, 1675,
+    5607, 5613, 5619, 3206, 3967, 5621, 3841, 5620, 3728, 4062, 1849, 3061, 2719, 3409, 4237, 5616, 5615, 5617, 5614, 5622,
+    5612, 5610, 5618, 5608, 3340, 4214, 2628, 2482, 2424, 4111, 1760, 3404, 3592, 1576, 3056, 2994, 2121, 5624, 2330, 1820,
+    5626, 1812, 5633, 5629, 3057, 1770, 2410, 1769, 2445, 5627, 2181, 2154, 3533, 5625, 1476, 5628, 5630, 2059, 2123, 1850,
+    1962, 5634, 2487, 4113, 2518, 5635, 3855, 5647, 1649, 5636, 5653, 5637, 4352, 5644, 3710, 5652, 5639, 1458, 5641, 2331,
+    5643, 5642, 5638, 5649, 2813, 4971, 2278, 4316, 5640, 3442, 1730, 2411, 5632, 5648, 1793, 5646, 5650, 3534, 1916, 5680,
+    4167, 5655, 1915, 5662, 4063, 5663, 5665, 5669, 5657, 3273, 3535, 5673, 5660, 5670, 5664, 2904, 5674, 2993, 5672, 1851,
+    4463, 5654, 5668, 1494, 5656, 4152, 5661, 2881, 3397, 5651, 5667, 2970, 5677, 1809, 2207, 5679, 5658, 5678, 5671, 5659,
+    5675, 5676, 5693, 3596, 5666, 5689, 5691, 3414, 4267, 3926, 5686, 3208, 5692, 3102, 5683, 5696, 5695, 3629, 5694, 3624,
+    5698, 5685, 2054, 5688, 2748, 3712, 5690, 2057, 5682, 5684, 5681, 4431, 1785, 5687, 5697, 1748, 2469, 1596, 5714, 4432,
+    5717, 2905, 5716, 5715, 5712, 5700, 5729, 5699, 5718, 5710, 5705, 5702, 5703, 5711, 7968, 5708, 2332, 3398, 3140, 5706,
+    5701, 5704, 4268, 4106, 5709, 5719, 5727, 5720, 5733, 5731, 5726, 5725, 3406, 3141, 5723, 5721, 5728, 5734, 3827, 5740,
+    5735, 5738, 5732, 3348, 3863, 5722, 5730, 2814, 4173, 5750, 5737, 2208, 1633, 1790, 5713, 2815, 5742, 5749, 2679, 1810,
+    3277, 5739, 5744, 5748, 2036, 1963, 5746, 1920, 3593, 5745, 5747, 5741, 5743, 1792, 3304, 5754, 5752, 2279, 5751, 5760,
+    5623, 5753, 5755, 5756, 5771, 5767, 5645, 5766, 5765, 5762, 5736, 5764, 5763, 5769, 4421, 5772, 2105, 5768, 5770, 3749,
+    5773, 5777, 5774, 4307, 5775, 5724, 5778, 5779, 1556, 5781, 2183, 2591, 2067, 1634, 4286, 5783, 5782, 5785, 1948, 2068,
+    1852, 5788, 5787, 5789, 1676, 3286, 5790, 1853, 5792, 5791, 5793, 5794, 5795, 2558, 2995, 2399, 3920, 4000, 4451, 2581,
+    2446, 4400, 5796, 5797, 2560, 5798, 5799, 5801, 5800, 4087, 2749, 2666, 2531, 5802, 5804, 2882, 5803, 5805, 5806, 5807,
+    5808, 5809, 5811, 5810, 5812, 1635, 3305, 5813, 2501, 1771, 5814, 3489, 4938, 1922, 5815, 5816, 4010, 4104, 3589, 5817,
+    3812, 3833, 4177, 5818, 5820, 5819, 5822, 5821, 5825, 2561, 4143, 5826, 5827, 1923, 5828, 5830, 5829, 2949, 3864, 1577,
+    3779, 3443, 2720, 1985, 3780, 2604, 5832, 1854, 1624, 3632, 5831, 2333, 3314, 5833, 5841, 5834, 3199, 1986, 5842, 2184,
+    1924, 5840, 5838, 5835, 4288, 3390, 3607, 5836, 5844, 5843, 2114, 1643, 2425, 5837, 5839, 4086, 3250, 4119, 5852, 5853,
+    1677, 3942, 4219, 5855, 2593, 2816, 5848, 5854, 1608, 2037, 5845, 5850, 3058, 3729, 3813, 5847, 4032, 5849, 5858, 5856,
+    5851, 4033, 3687, 1987, 3460, 3341, 5859, 5857, 3223, 5846, 1578, 4269, 5870, 5869, 3060, 5866, 4300, 3572, 5860, 3395,
+    1579, 2334, 5863, 2694, 5868, 5867, 5862, 5865, 1800, 5864, 3688, 4332, 2866, 3059, 5876, 5874, 3884, 5871, 5873, 1561,
+    2335, 4433, 1756, 3906, 4289, 1731, 2906, 5875, 5880, 2817, 4239, 5877, 5872, 5878, 4380, 3539, 3584, 1749, 1588, 5884,
+    5887, 4353, 4292, 5894, 5888, 5885, 4370, 5891, 2729, 5893, 5898, 3537, 5896, 5890, 3287, 5897, 5886, 5892, 5899, 1530,
+    5889, 5900, 2907, 2750, 3939, 2412, 5881, 5895, 3481, 2996, 1801, 2447, 2818, 5883, 2721, 2155, 5882, 5904, 2765, 2232,
+    5919, 5913, 2004, 3502, 5908, 5917, 1453, 1553, 1655, 5910, 3178, 5901, 5903, 2336, 5920, 5915, 5907, 5914, 4137, 5912,
+    5916, 2254, 2819, 3288, 5906, 4238, 5909, 5902, 3538, 5905, 5911, 4464, 2620, 4126, 5921, 3756, 5933, 2233, 2752, 5923,
+    4333, 2337, 5936, 1516, 5934, 5922, 5928, 5930, 4270, 5925, 3469, 5927, 5935, 5929, 4165, 5924, 2592, 5948, 1802, 5926,
+    5931, 5932, 3242, 3224, 5940, 5946, 5944, 3464, 5954, 5941, 5942, 5918, 2009, 3865, 2621, 2391, 4434, 5938, 5953, 1609,
+    3142, 3737, 1855, 4408, 4127, 3408, 5945, 5947, 3089, 5952, 5943, 5937, 1857, 2185, 5966, 5961, 3062, 1795, 2753, 5970,
+    5963, 3370, 5960, 3415, 5995, 5957, 5956, 5965, 5959, 5958, 5964, 2975, 5955, 5967, 5968, 1856, 5973, 5972, 5974, 5977,
+    3490, 5971, 5975, 2179, 3255, 5969, 3674, 5976, 5981, 5979, 5982, 5985, 5978, 2378, 3655, 5879, 4308, 5980, 5984, 3251,
+    5983, 5962, 7561, 5988, 5992, 5990, 5986, 5987, 5991, 5989, 3885, 5997, 5994, 5993, 5996, 3602, 5998, 3349, 3243, 2979,
+    5999, 6001, 6000, 5939, 6002, 3621, 6003, 1678, 3540, 1732, 1988, 2652, 2448, 4422, 2950, 1610, 6005, 6004, 6008, 3289,
+    6011, 6006, 6010, 6009, 3487, 1495, 4403, 6013, 1543, 6016, 6014, 6012, 6007, 4034, 6018, 6017, 1611, 6020, 3952, 6019,
+    4147, 2821, 3090, 2820, 4409, 6026, 3063, 6022, 6027, 1612, 6025, 3713, 6021, 6024, 2822, 3791, 6028, 2639, 3064, 6031,
+    6023, 2118, 6029, 4271, 6032, 7972, 2734, 6033, 6034, 3661, 6036, 6037, 3666, 3541, 6039, 6041, 4371, 6038, 6040, 1613,
+    6035, 4858, 6042, 3143, 2519, 6044, 6043, 2883, 4759, 6045, 6047, 6030, 6046, 6048, 3738, 6049, 6050, 6051, 6052, 3420,
+    6054, 6053, 6055, 6056, 2653, 3907, 4202, 6057, 6058, 3125, 2594, 6059, 6060, 6061, 3984, 3781, 6062, 3702, 3371, 6063,
+    1701, 1997, 4164, 4148, 1650, 4435, 4081, 3944, 2997, 6064, 3585, 2209, 6065, 2450, 6067, 6066, 6068, 6069, 6070, 1949,
+    6071, 6072, 2210, 3782, 6074, 2867, 6073, 2038, 6075, 6077, 6076, 6078, 2255, 6079, 2087, 3103, 2397, 6081, 6082, 6080,
+    2667, 3590, 2039, 6084, 3275, 6083, 4436, 3714, 6087, 6089, 6086, 4178, 6088, 6090, 4354, 6094, 6093, 3350, 3660, 2211,
+    6092, 6091, 4240, 4241, 6095, 1614, 2390, 2562, 6096, 6097, 6099, 2722, 6101, 6100, 6102, 1772, 6104, 6103, 6106, 6105,
+    2234, 4326, 2058, 1636, 2088, 1887, 4390, 6108, 6110, 6111, 1679, 6107, 2520, 3391, 6109, 6114, 2668, 6112, 2141, 3783,
+    6113, 6140, 6119, 2235, 1989, 6116, 4317, 4334, 3252, 6118, 6120, 4372, 2069, 3834, 3689, 6121, 6123, 6126, 6122, 6125,
+    2280, 1580, 6127, 2960, 6124, 4378, 6130, 7970, 6128, 6131, 6117, 6129, 2426, 6132, 6133, 4318, 6134, 6135, 6115, 6136,
+    1858, 2595, 6137, 6138, 6139, 1562, 6144, 3866, 6145, 1826, 6146, 6147, 6148, 6150, 6151, 6149, 3890, 6153, 6152, 6155,
+    6154, 6156, 6157, 6159, 6158, 2393, 6161, 6160, 1859, 2930, 3483, 6162, 2998, 2521, 1625, 6163, 4272, 4001, 6164, 3491,
+    4242, 2338, 2908, 3306, 4722, 3372, 1702, 6165, 6166, 6171, 6169, 6168, 5504, 1733, 6167, 1496, 3752, 3784, 4335, 6172,
+    6170, 3323, 2980, 3753, 3852, 6174, 4330, 2156, 6175, 6173, 3796, 6176, 6177, 1497, 2868, 6182, 6179, 3627, 6178, 1925,
+    6185, 6180, 6181, 6184, 6183, 3844, 3105, 3104, 1950, 6186, 6187, 6188, 6190, 6189, 1589, 6198, 3814, 6192, 6194, 6196,
+    2909, 6197, 6195, 2622, 6191, 6193, 3873, 2823, 6200, 6199, 6201, 2596, 2413, 3543, 6202, 3401, 6204, 4319, 6203, 3145,
+    6210, 6212, 6213, 3315, 6211, 6208, 6205, 6206, 6209, 6216, 6214, 6215, 6217, 6219, 6220, 6221, 6222, 6218, 6224, 6223,
+    6225, 4355, 6228, 6226, 6227, 1888, 4220, 3976, 6230, 6229, 6231, 6232, 6236, 6233, 6234, 6235, 6237, 6238, 6239, 6240,
+    6241, 3757, 3503, 6242, 3730, 3859, 6243, 6244, 3465, 1734, 2339, 6245, 6246, 6247, 2504, 6249, 6248, 6250, 6251, 3815,
+    6252, 6253, 7945, 6254, 6255, 6256, 2509, 6257, 3701, 4094, 1581, 1590, 6258, 6260, 6259, 3536, 2999, 5784, 6261, 4159,
+    6262, 1860, 3797, 6263, 6264, 6265, 4186, 4179, 3388, 3146, 6267, 2754, 2824, 6270, 6269, 6268, 3835, 1861, 2215, 6276,
+    6273, 2910, 4144, 6272, 6274, 6275, 6271, 6277, 6278, 3373, 1889, 3333, 6279, 6280, 6283, 2951, 3586, 6284, 4082, 6281,
+    6282, 6287, 6286, 6285, 6289, 6288, 6290, 6292, 6291, 3979, 2741, 4356, 6293, 3573, 6294, 6295, 6299, 6297, 6298, 6296,
+    6300, 6301, 6302, 6303, 4149, 6304, 4206, 6305, 3309, 3722, 2089, 3290, 6306, 2040, 3022, 6307, 2427, 6308, 6309, 2212,
+    2451, 6311, 3509, 2452, 1965, 4035, 3690, 3510, 2363, 6313, 2825, 4336, 2340, 2213, 3745, 6315, 6317, 2281, 6316, 3444,
+    6319, 1750, 6314, 3816, 1551, 2474, 4465, 6318, 6320, 3977, 3031, 6322, 6323, 6321, 1773, 6329, 6328, 2597, 6330, 6325,
+    6331, 6326, 3798, 6324, 6327, 6337, 6336, 4097, 6332, 1513, 6339, 6338, 2826, 6340, 3106, 6342, 6341, 6343, 6310, 6312,
+    6345, 6344, 2598, 4391, 2640, 6346, 2134, 1951, 1926, 2563, 4243, 6352, 6351, 3107, 6348, 6350, 2730, 2911, 6349, 6347,
+    3657, 2827, 3867, 2453, 3544, 6353, 6354, 6376, 2070, 4444, 3092, 6355, 1680, 3445, 3935, 6356, 2010, 6357, 6359, 6360,
+    3656, 6361, 6362, 6363, 2071, 1681, 3587, 2695, 2564, 6364, 2696, 1672, 3874, 6365, 3817, 3108, 6368, 6369, 3721, 2912,
+    6366, 3329, 6367, 2828, 1498, 1928, 6370, 3446, 6371, 3013, 4139, 3842, 6372, 6373, 3316, 4357, 6375, 6374, 2669, 6377,
+    1518, 6380, 6378, 1682, 2157, 6379, 2341, 2386, 4004, 6381, 4083, 6383, 3023, 1582, 1656, 1450, 6382, 6384, 6385, 2869,
+    6386, 1774, 6388, 2186, 1990, 6389, 2099, 6390, 3066, 3595, 3038, 2483, 6391, 3330, 3147, 6393, 6395, 6392, 6394, 2113,
+    6396, 2117, 1991, 4273, 6398, 6400, 1549, 6403, 1814, 6402, 6401, 6405, 6397, 6406, 4327, 6407, 6408, 4978, 6410, 6409,
+    6411, 6412, 4339, 6413, 7661, 2829, 6414, 6415, 2742, 3574, 6416, 3271, 6417, 3291, 6418, 2019, 4638, 3324, 2609, 1862,
+    6419, 6432, 6422, 1992, 6421, 6434, 6420, 2830, 6424, 6425, 3466, 6426, 1789, 2937, 3908, 6428, 3238, 6423, 6427, 6429,
+    2489, 6436, 3853, 3748, 3545, 2072, 6435, 6433, 3763, 6430, 3325, 3547, 3546, 2484, 6454, 6438, 6440, 6443, 6444, 6441,
+    6442, 6439, 6437, 6431, 3981, 1683, 6451, 6448, 6453, 6452, 3731, 4133, 2522, 6446, 6455, 6450, 6449, 6445, 6447, 1863,
+    3292, 3067, 3744, 6460, 3746, 3039, 6457, 3789, 6461, 3985, 3322, 6456, 6458, 6459, 6462, 2626, 3588, 6467, 6466, 6463,
+    4437, 6472, 6476, 6473, 6469, 6470, 6475, 6464, 4755, 6471, 6465, 6474, 6480, 1864, 6477, 6478, 6479, 6482, 6481, 3828,
+    6483, 4410, 4011, 6488, 6485, 6484, 3024, 6487, 6489, 6486, 6493, 6490, 6491, 6468, 6492, 6494, 6495, 3972, 6496, 4192,
+    2060, 2120, 6497, 3954, 2952, 4142, 6498, 4337, 3732, 3109, 3667, 2732, 1470, 6503, 6501, 6499, 1823, 2831, 6504, 6502,
+    6500, 6508, 6507, 6506, 6505, 6509, 6510, 3000, 6511, 6513, 6512, 2256, 3095, 6515, 3548, 6514, 6516, 3955, 3148, 2342,
+    6517, 4358, 6519, 6520, 6521, 6522, 2565, 6523, 2158, 1994, 1929, 6528, 4209, 2343, 6524, 6531, 4196, 3675, 3858, 2755,
+    6530, 2641, 2344, 2566, 1993, 3956, 6529, 3110, 4065, 2485, 2567, 3419, 6534, 4381, 2455, 6535, 2913, 6537, 2832, 2414,
+    6536, 2697, 2236, 3111, 6532, 6538, 6533, 2159, 6541, 6545, 2187, 6540, 6549, 2345, 4301, 1466, 6546, 1995, 6543, 6544,
+    3549, 6542, 6539, 1735, 3042, 2214, 6551, 6548, 6550, 6547, 2160, 3185, 6552, 3150, 6565, 6561, 6555, 6559, 2680, 1499,
+    6554, 6562, 6566, 2346, 4180, 3412, 6556, 6564, 6553, 3293, 6558, 1467, 4168, 6557, 2073, 3818, 3149, 4366, 2767, 6606,
+    6567, 3068, 6563, 6568, 6570, 3447, 6573, 6569, 3986, 1865, 4169, 1500, 6572, 4411, 6571, 1615, 3626, 6574, 6581, 6575,
+    6582, 6578, 3739, 2632, 6580, 6577, 6583, 6576, 2723, 4036, 2731, 6579, 6592, 6587, 6590, 6588, 6593, 6586, 6560, 3025,
+    3785, 6589, 6584, 3072, 2161, 2698, 2884, 3093, 6596, 6598, 6599, 6595, 6597, 6585, 6594, 6602, 6601, 4122, 2122, 6600,
+    6604, 6603, 6607, 6609, 2523, 6605, 6610, 6611, 6612, 6618, 3482, 6614, 6613, 6615, 6616, 6617, 6619, 6620, 1866, 6621,
+    6622, 6623, 6624, 6625, 6626, 6627, 6628, 6630, 6629, 6631, 6632, 6633, 6636, 6634, 6635, 2463, 2162, 3317, 3761, 2768,
+    3692, 3819, 6637, 5355, 6638, 6640, 4293, 6639, 6642, 6641, 4274, 6643, 3836, 6644, 6647, 6646, 6645, 6648, 2129, 3073,
+    1952, 6652, 6649, 6650, 6653, 6654, 6651, 1544, 1637, 6656, 6657, 6658, 4290, 2699, 6660, 6659, 2953, 6661, 6662, 6663,
+    1891, 1867, 6664, 6665, 4092, 4291, 4275, 4438, 2348, 6668, 2642, 6667, 6669, 2599, 3215, 6670, 2347, 4181, 6671, 6672,
+    6673, 6674, 6675, 2600, 4203, 6677, 3294, 6676, 6679, 6678, 6680, 3001, 6681, 6682, 3959, 6683, 3151, 6684, 6685, 4412,
+    6688, 6687, 6686, 3374, 6689, 2885, 6690, 6691, 4439, 6692, 6693, 6695, 6694, 3747, 3639, 4445, 3751, 6697, 2833, 3849,
+    6698, 6696, 1868, 2258, 2568, 3820, 2216, 4066, 6701, 6699, 2349, 2350, 1511, 2470, 3704, 1501, 6706, 3295, 3703, 3225,
+    6708, 6704, 6707, 6702, 6705, 4037, 2259, 1531, 6703, 6710, 6711, 3575, 2041, 6725, 3676, 2569, 2042, 3014, 4453, 4140,
+    6709, 3026, 1970, 6712, 6714, 6713, 6715, 3269, 3677, 3375, 6722, 6721, 6716, 2932, 3909, 6724, 6723, 2351, 4466, 6740,
+    6728, 6729, 2670, 6727, 2392, 6726, 6730, 3376, 3936, 3074, 3226, 6734, 6735, 6731, 6732, 6733, 2352, 6741, 6737, 3910,
+    4108, 3847, 6736, 6739, 6738, 4067, 6742, 6743, 3094, 6744, 6746, 6750, 6747, 6745, 3678, 6748, 6749, 1648, 6756, 6751,
+    6752, 6753, 3167, 6755, 6754, 6757, 6758, 6759, 2914, 1703, 6760, 4373, 2601, 2700, 2570, 3318, 6761, 6762, 1552, 6763,
+    6764, 6765, 6766, 6767, 2043, 5480, 6768, 3043, 6769, 2633, 6770, 4526, 6771, 3996, 1882, 3075, 2743, 3921, 2701, 6772,
+    2353, 6773, 3786, 6788, 6775, 3207, 3733, 2237, 6774, 3076, 6776, 3448, 6778, 6777, 6780, 6779, 6781, 6784, 6782, 1869,
+    6785, 6786, 6787, 2415, 4359, 6789, 2886, 1616, 6790, 6791, 6792, 1520, 6793, 6794, 3911, 2629, 6796, 1736, 1456, 6795,
+    6798, 3693, 2915, 1684, 4038, 2172, 2074, 6797, 1704, 1825, 1617, 6802, 4392, 3227, 3875, 6814, 1685, 6812, 6810, 6801,
+    6799, 6800, 2657, 2090, 3351, 3599, 1584, 6804, 6803, 6809, 6805, 6808, 4174, 6807, 1686, 1821, 6811, 6813, 2163, 6817,
+    6826, 6827, 1449, 6834, 1519, 6825, 6824, 6819, 6818, 6816, 6815, 3331, 3257, 6821, 6820, 6823, 3152, 2164, 1568, 6822,
+    2354, 3153, 6840, 6841, 1687, 1644, 6838, 6828, 6836, 6843, 6837, 6835, 6806, 6833, 6829, 1870, 6831, 6842, 6832, 6844,
+    6830, 3740, 4297, 6839, 6861, 6853, 2971, 1957, 2075, 6848, 1689, 2834, 6851, 2456, 3504, 6856, 4012, 6847, 1688, 2260,
+    3848, 6857, 6845, 6854, 6864, 6849, 6850, 3576, 6855, 6852, 4039, 6858, 1502, 6846, 6860, 6859, 3723, 6866, 6877, 1822,
+    6880, 6862, 6867, 4302, 6876, 4276, 4328, 3352, 1803, 3922, 6882, 3551, 1455, 6875, 6871, 3154, 6865, 6873, 6878, 3659,
+    1448, 6870, 6879, 3928, 6874, 6869, 2835, 2702, 2602, 4182, 3878, 6885, 6894, 6872, 1815, 2870, 6883, 6888, 3155, 6884,
+    6891, 3326, 6892, 4277, 6881, 1751, 6887, 6890, 4138, 6893, 6886, 6889, 4040, 4416, 6897, 6904, 6896, 2625, 6863, 3980,
+    4128, 6903, 6902, 6898, 6899, 1557, 6901, 6895, 3411, 6900, 1532, 3168, 3969, 6905, 6912, 3799, 6908, 2836, 2631, 6914,
+    2044, 6915, 3929, 6907, 6868, 6906, 4462, 3552, 3923, 6922, 6928, 6929, 6916, 3734, 6926, 6918, 6920, 6930, 6919, 6923,
+    1618, 3619, 6924, 6927, 6917, 3077, 6921, 2502, 2916, 2127, 4210, 4215, 2770, 6934, 6932, 4461, 6931, 4309, 6933, 6935,
+    6936, 6939, 6937, 3553, 6938, 3787, 6925, 2771, 6940, 6945, 3156, 6944, 6913, 6946, 3112, 6941, 6943, 6942, 5776, 5761,
+    6948, 6947, 4310, 6266, 6949, 6950, 6951, 2261, 1971, 6953, 4668, 2005, 4344, 2097, 6954, 6955, 3342, 6956, 3640, 1464,
+    1697, 6961, 6962, 6957, 2524, 6958, 3681, 6959, 6960, 6970, 6964, 6967, 6963, 6965, 6966, 2646, 6968, 3296, 2165, 1761,
+    6971, 1758, 6977, 6972, 6976, 3768, 6973, 6974, 3879, 3800, 6978, 3259, 6988, 6984, 1705, 6982, 4041, 6983, 6980, 6981,
+    6986, 6989, 6987, 6985, 6979, 3319, 6996, 4136, 6994, 6995, 6990, 6992, 6993, 6991, 3044, 4440, 7000, 7001, 7007, 2889,
+    7003, 7006, 6998, 6997, 7008, 1690, 7004, 7009, 7005, 7002, 3377, 6999, 3720, 7013, 4250, 7012, 7011, 7020, 7014, 7022,
+    4294, 7025, 7016, 7017, 7021, 7024, 7023, 7015, 7018, 7035, 7028, 7026, 7027, 7032, 7033, 1737, 1953, 7031, 7010, 7030,
+    7034, 7029, 7036, 7038, 7037, 7040, 7039, 6969, 7044, 7041, 7042, 7043, 7045, 2188, 7047, 7046, 2703, 2355, 5861, 7048,
+    2736, 1752, 7049, 1585, 2837, 7050, 2356, 7051, 1503, 3868, 7052, 2954, 7059, 7056, 3343, 7057, 7054, 2076, 7053, 7060,
+    2133, 3228, 7066, 7062, 3187, 7061, 7064, 7055, 7065, 7067, 3821, 7063, 7068, 7070, 2257, 7058, 1471, 7069, 2457, 4404,
+    7071, 7072, 3157, 4320, 7073, 4244, 7074, 7075, 4002, 7076, 2430, 4321, 7081, 7082, 2838, 7080, 4295, 7077, 7079, 3003,
+    2974, 7078, 7083, 3937, 7085, 7084, 1804, 4042, 7086, 7098, 7088, 7089, 7090, 7091, 7095, 7096, 7094, 7092, 7087, 7093,
+    7097, 7605, 1638, 7100, 2077, 7099, 7105, 7104, 7107, 7106, 7108, 2704, 7109, 7110, 7111, 3004, 4278, 7112, 3938, 3685,
+    7113, 7114, 2217, 1931, 7115, 2571, 3680, 7116, 1775, 7117, 7119, 4311, 7118, 2917, 7120, 7121, 7122, 1871, 7123, 7124,
+    7125, 7126, 1776, 7127, 7128, 7129, 1712, 2887, 7130, 7131, 7132, 2238, 3449, 7133, 2166, 2933, 7136, 3554, 7135, 2128,
+    7134, 3253, 1932, 7137, 7138, 2839, 2189, 7139, 4043, 3037, 2006, 4211, 3113, 7140, 2918, 3344, 2840, 7141, 7144, 7145,
+    2428, 3200, 7143, 2841, 3869, 7142, 2572, 1586, 7149, 2167, 2574, 2573, 4460, 7148, 7147, 3078, 1964, 4450, 1753, 2842,
+    7146, 7151, 7152, 7150, 2262, 4255, 2575, 3654, 7155, 3006, 3297, 4245, 7158, 2282, 3005, 7154, 7159, 2283, 7156, 7157,
+    7153, 3040, 3591, 3278, 1691, 3822, 1954, 3378, 7162, 7160, 3307, 3007, 1872, 7161, 2938, 4360, 4447, 7163, 7175, 3379,
+    7174, 7171, 7179, 7172, 7168, 3450, 7166, 7164, 4224, 2576, 7169, 7165, 7173, 2772, 2239, 3256, 4068, 1593, 1504, 3555,
+    7177, 7176, 3620, 7181, 7170, 7180, 7182, 2218, 7178, 2357, 2643, 7183, 4279, 7186, 7189, 7187, 3860, 7184, 2078, 7188,
+    7190, 7194, 7191, 7193, 7192, 7195, 2607, 7197, 7196, 3912, 7199, 2168, 7198, 7200, 7201, 1955, 6655, 2871, 7202, 2284,
+    7203, 7204, 2525, 5516, 7205, 7206, 2705, 7207, 7208, 7209, 7210, 7211, 3274, 7212, 7214, 7213, 3556, 7215, 4044, 7216,
+    7217, 7218, 7219, 3608, 2843, 7220, 2379, 4524, 7221, 7222, 3870, 7223, 7231, 7224, 7226, 7225, 7227, 4069, 7228, 7229,
+    7230, 7232, 1740, 3429, 3913, 2464, 2358, 3886, 1693, 3788, 7235, 1873, 3027, 7234, 7239, 3353, 4193, 7237, 7238, 1933,
+    7240, 3715, 3229, 3823, 3484, 7236, 4070, 1706, 7242, 4423, 3392, 4452, 2577, 7241, 3183, 7258, 3079, 3638, 3887, 7245,
+    2526, 2578, 2844, 3717, 2219, 7244, 7243, 3914, 2623, 3505, 7247, 7248, 2359, 7246, 7249, 7250, 7252, 3169, 7251, 1892,
+    7254, 7253, 7255, 7257, 7259, 7260, 3028, 2637, 7261, 1777, 7262, 3158, 7263, 7264, 3915, 1934, 7265, 3380, 1594, 7266,
+    2671, 2966, 3179, 7269, 7268, 7267, 7275, 7273, 7270, 7272, 7271, 7274, 2007, 7278, 3029, 7279, 2263, 7276, 7277, 4424,
+    3381, 3080, 7280, 7283, 7281, 7282, 4280, 3557, 7286, 7284, 7285, 7287, 7304, 7290, 7291, 7289, 7288, 3451, 7296, 7300,
+    7297, 7292, 7298, 7299, 7306, 7301, 3030, 7303, 7305, 7302, 7308, 2706, 7307, 7309, 7310, 7313, 7312, 7311, 7315, 7314,
+    4212, 7317, 7316, 7318, 7319, 7321, 7320, 2919, 7322, 2091, 7323, 7325, 7326, 7327, 7324, 7328, 2644, 7329, 1935, 2130,
+    2220, 7330, 3630, 3485, 7331, 7334, 2610, 7333, 7332, 2169, 7335, 1778, 7337, 2458, 7336, 7345, 7339, 7341, 4003, 7338,
+    7340, 7344, 7342, 1936, 7343, 7346, 3705, 4374, 2707, 7347, 4225, 7349, 7348, 7352, 4256, 7351, 1805, 7350, 7355, 7354,
+    7353, 3473, 7356, 7357, 7358, 2380, 2116, 7360, 7361, 7362, 2920, 7363, 2603, 7364, 7365, 4703, 4702, 7366, 6608, 7367,
+    3267, 2890, 3679, 7368, 3987, 3410, 2398, 3272, 1545, 4120, 2934, 2173, 2079, 3988, 7369, 7371, 7370, 1694, 3636, 7372,
+    3735, 3474, 7373, 2737, 7375, 4160, 7390, 7377, 7378, 3399, 3230, 3159, 3558, 7376, 1972, 7385, 7382, 7395, 3559, 3328,
+    7379, 3452, 3506, 7380, 7384, 2944, 3719, 3402, 3008, 7383, 3180, 3170, 7381, 1447, 4417, 7386, 3231, 2708, 2921, 7388,
+    7387, 1517, 7389, 3854, 7397, 3609, 2955, 3320, 2102, 7396, 4246, 1566, 3989, 1695, 7391, 7392, 7393, 7394, 3577, 3266,
+    1505, 7398, 7399, 7969, 3195, 7400, 1619, 3115, 2221, 4281, 7401, 3467, 3160, 2645, 7402, 7405, 2757, 7403, 3082, 3081,
+    1506, 4361, 7407, 3824, 7409, 7408, 7406, 6404, 1874, 7374, 7411, 7410, 7412, 4247, 3615, 4045, 7413, 2647, 7414, 7415,
+    7416, 3456, 1512, 2360, 4441, 7420, 2131, 7417, 7418, 3924, 1779, 4248, 2045, 3507, 7421, 7422, 7423, 3457, 7425, 7424,
+    3601, 7426, 2709, 2654, 3706, 3345, 2672, 2956, 7427, 7428, 2940, 7429, 7430, 7431, 4303, 2710, 7433, 7432, 2361, 2387,
+    2527, 7436, 2758, 7435, 7434, 3239, 2285, 3009, 3758, 2712, 7437, 2845, 7440, 7438, 7439, 7442, 7441, 2872, 7443, 7444,
+    7445, 3790, 2449, 2655, 7446, 7447, 4322, 2724, 4204, 4362, 7448, 2080, 7449, 3458, 7452, 1816, 2922, 7450, 7451, 3422,
+    4084, 2106, 7454, 7455, 7453, 7457, 3613, 1762, 7461, 7458, 7460, 7456, 7534, 7459, 4393, 2264, 7469, 3475, 7464, 7467,
+    7465, 7470, 7471, 7463, 7476, 1620, 7462, 3755, 7466, 2846, 2362, 4071, 2082, 2725, 3578, 3084, 7474, 7468, 7473, 4161,
+    3382, 7475, 7472, 3083, 7479, 7478, 7477, 4046, 2779, 7480, 3997, 1587, 3877, 3346, 2008, 7482, 2364, 2507, 7481, 2957,
+    2958, 7488, 7490, 2873, 7489, 7491, 2065, 3876, 2656, 4418, 7484, 2486, 4446, 7493, 7492, 7494, 7483, 3623, 3508, 3413,
+    7499, 3298, 7495, 7496, 2124, 7498, 2222, 7497, 2847, 1817, 7503, 2429, 3161, 3400, 1754, 7501, 7502, 3393, 7500, 7504,
+    7510, 7513, 7512, 3468, 7505, 7506, 7509, 7511, 2046, 7514, 7508, 7507, 7518, 7519, 7520, 7517, 7516, 2848, 3560, 7515,
+    7524, 7522, 7523, 7521, 3254, 7525, 7526, 7528, 1875, 7527, 4216, 7539, 7529, 7532, 7530, 7531, 7533, 7535, 7536, 7537,
+    7540, 7538, 7541, 7543, 7542, 3383, 4197, 7544, 3085, 7545, 3970, 7546, 1738, 1563, 1877, 1876, 7547, 7548, 7549, 7550,
+    7552, 1878, 1780, 2365, 3764, 7554, 7553, 7555, 1595, 7558, 7557, 7556, 7559, 7562, 1477, 7560, 7564, 7563, 7566, 7565,
+    7567, 3564, 7568, 7569, 7571, 7570, 3916, 7572, 7573, 2467, 7574, 7575, 4072, 3114, 1442, 3209, 7576, 3917, 7579, 7577,
+    2366, 7578, 2240, 3971, 7581, 7583, 7582, 7584, 1536, 2935, 2780, 1879, 7585, 3718, 7587, 1537, 7586, 3394, 4363, 3561,
+    7580, 4324, 2223, 4282, 2103, 4338, 2119, 3232, 6720, 7588, 1739, 2959, 1781, 7590, 7591, 7589, 2180, 2459, 2849, 1538,
+    4375, 7593, 7404, 7592, 7596, 7594, 7595, 7597, 7598, 4394, 7599, 7600, 3015, 3769, 2973, 1893, 4249, 1707, 2711, 2265,
+    7603, 7602, 2579, 7604, 7601, 2503, 7608, 7019, 4756, 2967, 7606, 4323, 3631, 1546, 3041, 2612, 3957, 1567, 4395, 4299,
+    7609, 3492, 2681, 7610, 7611, 2923, 7612, 4396, 7607, 7614, 7616, 7615, 7613, 7617, 7618, 3162, 1696, 7619, 4150, 7620,
+    7621, 4425, 5584, 7622, 7623, 7624, 7628, 7625, 7626, 7627, 7629, 3010, 4213, 3011, 7630, 3825, 7631, 7922, 4170, 7632,
+    7633, 7634, 1782, 7636, 2936, 7637, 2115, 7638, 7642, 7640, 7641, 1811, 7639, 7643, 7644, 1478, 7645, 7646, 2850, 7647,
+    1958, 7650, 7649, 7648, 7185, 3994, 7651, 7652, 7653, 7654, 7655, 7656, 1880, 7657, 7658, 3650, 7660, 1657, 7663, 7662,
+    1539, 2047, 3973, 3384, 2400, 2368, 2759, 2939, 7665, 7664, 4257, 1894, 3792, 3610, 2972, 4364, 2170, 7668, 7667, 4074,
+    3562, 1583, 7669, 7666, 3888, 4298, 7670, 7671, 7673, 3240, 1786, 1787, 7672, 1895, 2224, 1896, 3486, 4382, 2266, 7674,
+    7675, 7676, 7680, 7682, 7681, 3927, 7683, 7684, 7685, 7686, 7688, 7687, 7689, 3826, 6666, 2888, 1937, 7690, 7691, 4714,
+    5786, 3793, 1529, 1465, 2580, 4047, 2876, 7692, 4189, 7693, 4283, 1569, 2528, 7694, 1708, 7695, 7696, 7698, 7699, 7701,
+    7697, 7700, 1881, 7702, 7703, 7704, 7705, 7706, 7708, 7707, 7710, 7713, 7709, 7711, 7712, 7714, 2048, 2673, 7715, 7716,
+    2369, 7717, 1757, 3694, 7718, 7719, 3321, 3625, 7720, 3741, 3210, 1591, 2092, 2093, 3347, 7725, 2094, 1709, 7724, 7722,
+    7723, 7721, 7735, 7726, 7727, 7728, 7729, 7731, 7730, 2744, 7732, 7734, 1938, 7733, 3163, 2225, 7736, 3211, 7737, 3563,
+    7738, 7744, 7741, 7740, 7742, 7739, 7746, 7745, 7748, 2049, 7747, 7749, 7750, 7752, 7751, 7753, 7755, 7754, 2396, 7756,
+    7757, 1755, 7758, 7759, 2961, 7760, 7761, 7762, 7763, 2370, 7764, 7765, 7766, 7767, 7768, 3759, 7770, 3845, 7771, 7769,
+    7773, 7772, 7774, 7775, 7776, 7777, 7778, 7779, 7780, 7781, 7782, 7783, 7784, 7785, 7786, 7787, 7788, 5780, 7789, 6518,
+    1939, 1728, 2416, 7791, 7790, 4131, 7793, 7794, 7792, 7795, 4098, 7796, 2011, 4420, 7797, 7799, 1468, 7800, 3945, 7798,
+    7801, 7802, 7803, 7804, 7805, 4110, 2508, 2488, 3086, 7806, 7809, 7807, 7810, 2287, 7808, 7811, 7812, 7813, 7817, 2505,
+    3234, 7818, 7815, 7814, 7816, 2174, 7822, 7821, 7820, 1457, 7832, 7828, 7829, 7825, 7831, 7827, 1794, 4459, 7830, 7826,
+    7824, 7823, 7834, 7837, 7836, 7835, 3880, 7833, 1521, 7838, 7840, 1807, 7819, 1558, 7842, 7841, 7839, 3276, 4112, 4376,
+    7843, 7844, 7845, 7846, 7847, 3385, 7848, 3765, 7853, 7849, 7850, 4048, 4162, 3598, 7854, 7855, 3580, 7852, 7851, 1640,
+    7863, 7862, 1621, 7860, 7859, 7857, 1819, 7856, 2608, 1639, 2371, 7866, 7865, 7864, 7861, 7867, 7868, 7876, 7875, 7877,
+    1548, 7872, 7873, 2388, 4151, 7874, 4049, 7882, 7878, 7883, 7880, 7879, 2171, 7884, 7885, 7886, 7881, 7858, 7887, 3423,
+    7891, 7892, 7890, 7889, 7895, 7888, 7893, 7894, 7897, 7896, 7899, 7900, 7901, 4456, 7898, 3241, 2475, 7902, 7903, 7904,
+    7905, 7906, 2226, 7907, 7908, 2605, 7909, 7910, 7911, 7912, 7915, 7913, 4443, 7914, 4397, 7916, 4377, 7917, 3742, 7918,
+    7920, 7921, 7919, 2381, 4171, 4099, 5173, 5824, 4123, 1641, 7923, 1967, 7924, 7925, 7926, 2389, 7927, 6098, 4185, 3233,
+    7928, 7930, 7929, 7931, 7932, 7933, 7934, 7936, 7937, 7938, 7939, 7940, 7941, 7942, 7943, 7944, 3459, 2267, 7946, 3116,
+    7947, 7948, 3840, 7949, 7950, 6358, 7256, 7659, 7951, 7952, 7954, 7955, 7956, 4398, 7953, 7957, 7958, 7960, 7959, 7962,
+    7963, 7961, 4340, 7964, 7965, 6387, 7966,    9,   84,   80,   83,   85,   41,   42,   86,   59,    3,    4,   30,  207,
+     208,  209,  210,  211,  212,  213,  214,  215,  216,    6,    7,   67,   65,   68,    8,   87,  224,  225,  226,  227,
+     228,  229,  230,  231,  232,  233,  234,  235,  236,  237,  238,  239,  240,  241,  242,  243,  244,  245,  246,  247,
+     248,  249,   45,   31,   46,   15,   17,   13,  257,  258,  259,  260,  261,  262,  263,  264,  265,  266,  267,  268,
+     269,  270,  271,  272,  273,  274,  275,  276,  277,  278,  279,  280,  281,  282,   47,   34,   48,   81,   82,  138,
+      16,   79
+};
+
+/* Bytes of the UTF-8 character at the start of text (1 for a byte that doesn't start a valid sequence) */
+size_t get_utf8_character_bytes(const unsigned char text[], size_t remaining_bytes) {
+    size_t bytes = 1;
+    if (text[0] >= 0xC2 && text[0] <= 0xDF)
+        bytes = 2;
+    else if (text[0] >= 0xE0 && text[0] <= 0xEF)
+        bytes = 3;
+    else if (text[0] >= 0xF0 && text[0] <= 0xF4)
+        bytes = 4;
+
+    if (bytes > remaining_bytes)
+        return 1;
+    for (size_t i = 1; i < bytes; i++) {
+        if ((text[i] & 0xC0) != 0x80)
+            return 1;
+    }
+    return bytes;
+}
+
+/* Decodes the UTF-8 character at the start of text (strictly: no overlong forms, surrogates or code points after U+10FFFF).
+ * Returns the code point and sets its bytes, -1 if the bytes are not a valid character. */
+long get_utf8_code_point(const unsigned char text[], size_t remaining_bytes, size_t *bytes) {
+    /* Fast path for the 3 bytes characters (all the Kanji ones) */
+    if (text[0] >= 0xE0 && text[0] <= 0xEF && remaining_bytes >= 3 && ((text[1] & text[2]) & 0xC0) == 0x80 && ((text[1] | text[2]) & 0x40) == 0) {
+        long code_point = (long) (text[0] & 0x0F) << 12 | (text[1] & 0x3F) << 6 | (text[2] & 0x3F);
+        *bytes = 3;
+        return code_point < 0x800 || (code_point >= 0xD800 && code_point <= 0xDFFF) ? -1 : code_point;
+    }
 
-    size_t output_remaining_bytes = input_bytes;
-    size_t input_remaining_bytes = input_bytes;
+    *bytes = get_utf8_character_bytes(text, remaining_bytes);
+    switch (*bytes) {
+        case 1:
+            return text[0] < 0x80 ? text[0] : -1;
+        case 2:
+            return (long) (text[0] & 0x1F) << 6 | (text[1] & 0x3F);
+        case 3: {
+            long code_point = (long) (text[0] & 0x0F) << 12 | (text[1] & 0x3F) << 6 | (text[2] & 0x3F);
+            return code_point < 0x800 || (code_point >= 0xD800 && code_point <= 0xDFFF) ? -1 : code_point;
+        }
+        default: {
+            long code_point = (long) (text[0] & 0x07) << 18 | (text[1] & 0x3F) << 12 | (text[2] & 0x3F) << 6 | (text[3] & 0x3F);
+            return code_point < 0x10000 || code_point > 0x10FFFF ? -1 : code_point;
+        }
+    }
+}
 
-    iconv_t converter;
+/* Kanji mode value of a code point from the compact table, -1 if it is not a JIS X 0208 character */
+int search_code_point_kanji_value(long code_point) {
+    if (code_point < 0 || code_point >= UNICODE_PAGES * 256)
+        return -1;
+
+    /* Branchless binary search of the low byte in the page of the code point (the last entry not greater than it) */
+    unsigned char low_byte = code_point & 0xFF;
+    int count = KANJI_PAGE_START[(code_point >> 8) + 1] - KANJI_PAGE_START[code_point >> 8];
+    if (count == 0)
+        return -1;
+    const unsigned char *candidate = KANJI_UNICODE_LOW_BYTES + KANJI_PAGE_START[code_point >> 8];
+    while (count > 1) {
+        int half = count / 2;
+        candidate = candidate[half] <= low_byte ? candidate + half : candidate;
+        count -= half;
+    }
+    return *candidate == low_byte ? KANJI_VALUES[candidate - KANJI_UNICODE_LOW_BYTES] : -1;
+}
 
-    /* NOTE: Assuming converted formats occupy less space than the original;
-     * if that is not the case the message will be cut (this may happen if the encoding characters somehow are bigger than their UTF-8 variants)
-     */
-    char temp[input_bytes];
-    char *temp_buffer = temp;
+/* Direct map from the code points of the compact table to their Kanji mode value + 1 (0 if there is none), built on first use and shared by all threads */
+_Atomic(unsigned short*) kanji_value_map;
+
+/* Gets the direct map (NULL if it could not be allocated) */
+const unsigned short *get_kanji_value_map() {
+    unsigned short *value_map = atomic_load_explicit(&kanji_value_map, memory_order_acquire);
+    if (value_map)
+        return value_map;
+
+    value_map = calloc(UNICODE_PAGES * 256, sizeof(unsigned short));
+    if (!value_map)
+        return NULL;
+    for (int page = 0; page < UNICODE_PAGES; page++) {
+        for (int i = KANJI_PAGE_START[page]; i < KANJI_PAGE_START[page + 1]; i++)
+            value_map[page << 8 | KANJI_UNICODE_LOW_BYTES[i]] = KANJI_VALUES[i] + 1;
+    }
 
-    /* Covert to get input size */
-    converter = iconv_open(encoding, "UTF-8");
-    iconv(converter, &input, &input_remaining_bytes, &temp_buffer, &output_remaining_bytes);
-    iconv_close(converter);
+    /* If another thread published its map first, use that one */
+    unsigned short *expected = NULL;
+    if (!atomic_compare_exchange_strong_explicit(&kanji_value_map, &expected, value_map, memory_order_acq_rel, memory_order_acquire)) {
+        free(value_map);
+        return expected;
+    }
+    return value_map;
+}
 
-    return input_bytes - output_remaining_bytes;
+/* Kanji mode value of a code point, -1 if it is not a JIS X 0208 character */
+int get_code_point_kanji_value(long code_point) {
+    const unsigned short *value_map = get_kanji_value_map();
+    if (!value_map)
+        return search_code_point_kanji_value(code_point);
+    return code_point >= 0 && code_point < UNICODE_PAGES * 256 ? value_map[code_point] - 1 : -1;
 }
 
-/* Converts the input if a new format is needed */
-void convert_input(char *to_covert, char *converted, size_t input_bytes, size_t output_bytes, char* encoding) {
+/* Shift-JIS double byte code of a Kanji mode value (the inverse of get_kanji_value) */
+unsigned int get_kanji_shift_jis_code(int value) {
+    unsigned int code = (value / 0xC0) << 8 | (value % 0xC0);
+    return code + (code < 0x1F00 ? 0x8140 : 0xC140);
+}
 
-    size_t input_remaining_bytes = input_bytes;
-    size_t output_remaining_bytes = output_bytes;
+/* Shift-JIS single byte of a code point: ASCII (the yen sign and the overline share backslash and tilde) and half width katakana; 0 if it has none */
+unsigned char get_shift_jis_byte(long code_point) {
+    if (code_point > 0 && code_point < 0x80)
+        return code_point;
+    if (code_point == 0xA5)
+        return 0x5C;
+    if (code_point == 0x203E)
+        return 0x7E;
+    if (code_point >= 0xFF61 && code_point <= 0xFF9F)
+        return code_point - 0xFF61 + 0xA1;
+    return 0;
+}
 
-    iconv_t converter;
+/* Kanji mode value of a UTF-8 character, -1 if it is not a Kanji character */
+int get_utf8_kanji_value(const unsigned char character[], size_t bytes) {
+    size_t code_point_bytes;
+    long code_point = get_utf8_code_point(character, bytes, &code_point_bytes);
+    return code_point_bytes == bytes ? get_code_point_kanji_value(code_point) : -1;
+}
 
-    converter = iconv_open(encoding, "UTF-8");
-    iconv(converter, &to_covert, &input_remaining_bytes, &converted, &output_remaining_bytes);
-    iconv_close(converter);
+/* Portable ASCII prefix, also used for the tails of the vector ones */
+size_t get_ascii_prefix_bytes_scalar(const unsigned char text[], size_t bytes) {
+    size_t i = 0;
+    while (i < bytes && text[i] < 0x80)
+        i++;
+    return i;
 }
 
+#ifdef QRCODE_X86_SIMD
+/* SSE2 ASCII prefix: 16 bytes at a time, the top bits of the bytes tell where the first non ASCII one is */
+__attribute__((target("sse2")))
+size_t get_ascii_prefix_bytes_sse2(const unsigned char text[], size_t bytes) {
+    size_t i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        int non_ascii = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*) (text + i)));
+        if (non_ascii)
+            return i + __builtin_ctz(non_ascii);
+    }
+    return i + get_ascii_prefix_bytes_scalar(text + i, bytes - i);
+}
 
-/* Gets the generator polynomial from the given error correction codeblocks */
-void get_generator_polynomial(unsigned char destinantion[], int ec_codeblocks) {
+/* AVX2 ASCII prefix: same as the SSE2 one, 32 bytes at a time */
+__attribute__((target("avx2")))
+size_t get_ascii_prefix_bytes_avx2(const unsigned char text[], size_t bytes) {
+    size_t i = 0;
+    for (; i + 32 <= bytes; i += 32) {
+        unsigned int non_ascii = _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*) (text + i)));
+        if (non_ascii)
+            return i + __builtin_ctz(non_ascii);
+    }
+    return i + get_ascii_prefix_bytes_scalar(text + i, bytes - i);
+}
+#endif
 
-    int generator_size = ec_codeblocks + 1;
-    unsigned char temp1[generator_size];
-    unsigned char temp2[generator_size];
+/* Number of ASCII bytes at the start of the text, with the fastest kernel supported by the running cpu */
+size_t get_ascii_prefix_bytes(const unsigned char text[], size_t bytes) {
+#ifdef QRCODE_X86_SIMD
+    if (__builtin_cpu_supports("avx2"))
+        return get_ascii_prefix_bytes_avx2(text, bytes);
+    if (__builtin_cpu_supports("sse2"))
+        return get_ascii_prefix_bytes_sse2(text, bytes);
+#endif
+    return get_ascii_prefix_bytes_scalar(text, bytes);
+}
 
-    for (int i = 0 ; i < generator_size; i++) {
-        destinantion[i] = 0;
-        temp1[i] = 0;
-        temp2[i] = 0;
+/* Converts a UTF-8 text to the charset in one pass. The output goes in *buffer (of *capacity bytes); if it is growable the buffer is allocated
+ * or grown as needed (the caller frees it). Returns the converted bytes, SIZE_MAX if the buffer is too small (and not growable) or can't be allocated.
+ * ASCII runs are copied as they are, since both charsets keep ASCII.
+ * NOTE: The conversion stops at the first character that is not valid UTF-8 or has no equivalent in the charset; language tags (U+E0000-U+E007F) are dropped */
+size_t convert_text(enum CHARSET charset, const char text[], size_t bytes, char **buffer, size_t *capacity, bool is_growable) {
+    /* Shift-JIS and ISO-8859-1 characters never take more bytes than in UTF-8 */
+    if (is_growable && *capacity < bytes + 1) {
+        char *grown = realloc(*buffer, bytes + 1);
+        if (!grown) { fprintf(stderr, "QRCODE ERROR: Memory Error\n"); return SIZE_MAX; }
+        *buffer = grown;
+        *capacity = bytes + 1;
     }
 
-    /* Polynomial sum in 2 steps */
-    for (int i = 0 ; i < ec_codeblocks; i++) {
-        for (int j = generator_size - 2 - i; j < generator_size - 1; j++) {
-            temp1[j] = log_lookup_table[(destinantion[j+1] + 0) % 255];
+    const unsigned char *input = (const unsigned char*) text;
+    unsigned char *output = (unsigned char*) *buffer;
+    size_t converted_bytes = 0;
+    for (size_t i = 0; i < bytes;) {
+        size_t character_bytes;
+
+        if (input[i] < 0x80) {
+            size_t ascii_bytes = get_ascii_prefix_bytes(input + i, bytes - i);
+            if (converted_bytes + ascii_bytes > *capacity) { fprintf(stderr, "QRCODE ERROR: Input too large: converted text is more than %lu bytes. Can't generate code...\n", *capacity); return SIZE_MAX; }
+            memcpy(output + converted_bytes, input + i, ascii_bytes);
+            converted_bytes += ascii_bytes;
+            i += ascii_bytes;
+            continue;
         }
-        for(int j = generator_size - 1 - i; j < generator_size; j++) {
-            temp2[j] = log_lookup_table[(destinantion[j] + i) % 255];
+
+        long code_point = get_utf8_code_point(input + i, bytes - i, &character_bytes);
+        if (code_point < 0)
+            break;
+        /* Converted character (up to 2 bytes), in the low bytes */
+        unsigned int character = 0;
+        size_t converted_character_bytes = 1;
+        int kanji_value = charset == CHARSET_SHIFT_JIS ? get_code_point_kanji_value(code_point) : -1;
+        if (charset == CHARSET_ISO_8859_1 && code_point <= 0xFF) {
+            character = code_point;
+        } else if (kanji_value >= 0) {
+            character = get_kanji_shift_jis_code(kanji_value);
+            converted_character_bytes = 2;
+        } else if (charset == CHARSET_SHIFT_JIS && get_shift_jis_byte(code_point)) {
+            character = get_shift_jis_byte(code_point);
+        } else if (code_point >= 0xE0000 && code_point <= 0xE007F) {
+            converted_character_bytes = 0;
+        } else {
+            break;
         }
-        for (int j = 0; j < generator_size; j++) {
-            destinantion[j] = log_reverse_lookup_table[temp1[j] ^ temp2[j]] % 255;
+
+        if (converted_bytes + converted_character_bytes > *capacity) { fprintf(stderr, "QRCODE ERROR: Input too large: converted text is more than %lu bytes. Can't generate code...\n", *capacity); return SIZE_MAX; }
+        if (converted_character_bytes == 2)
+            output[converted_bytes++] = character >> 8;
+        if (converted_character_bytes >= 1)
+            output[converted_bytes++] = character & 0xFF;
+        i += character_bytes;
+    }
+    return converted_bytes;
+}
+
+/* Multiplies two elements of GF(256) */
+unsigned char gf_multiply(unsigned char a, unsigned char b) {
+    if (a == 0 || b == 0)
+        return 0;
+    return GF_EXP_TABLE[GF_LOG_TABLE[a] + GF_LOG_TABLE[b]];
+}
+
+/* Gets the generator polynomial (as exponents of alpha) for the given number of error correction codewords per block */
+const unsigned char *get_generator_polynomial(int ec_codeblocks) {
+    return RS_GENERATOR_POLYNOMIAL_EXPONENTS[ec_codeblocks];
+}
+
+/* Reed-Solomon encoder for a fixed number of correction codewords per block.
+ * The generator coefficients (without the leading one) are premultiplied by every possible low and high nibble of a field element,
+ * so that multiplying the whole generator by a factor is just the XOR of two rows.
+ * The same products are also kept per coefficient, as 16 entries shuffle tables used when encoding many blocks side by side. */
+#define RS_VECTOR_SIZE 32
+#define RS_NIBBLE_VALUES 16
+enum RS_KERNEL {RS_KERNEL_SCALAR, RS_KERNEL_SSSE3, RS_KERNEL_AVX2};
+typedef struct reed_solomon_encoder {
+    int correction_codewords;
+    enum RS_KERNEL kernel;
+    unsigned char low_nibble_products[RS_NIBBLE_VALUES][RS_VECTOR_SIZE];
+    unsigned char high_nibble_products[RS_NIBBLE_VALUES][RS_VECTOR_SIZE];
+    unsigned char coefficient_low_products[RS_VECTOR_SIZE][RS_NIBBLE_VALUES];
+    unsigned char coefficient_high_products[RS_VECTOR_SIZE][RS_NIBBLE_VALUES];
+} reed_solomon_encoder_t;
+
+/* Selects the fastest kernel supported by the running cpu */
+enum RS_KERNEL reed_solomon_select_kernel() {
+#ifdef QRCODE_X86_SIMD
+    if (__builtin_cpu_supports("avx2"))
+        return RS_KERNEL_AVX2;
+    if (__builtin_cpu_supports("ssse3"))
+        return RS_KERNEL_SSSE3;
+#endif
+    return RS_KERNEL_SCALAR;
+}
+
+/* Prepares an encoder for the given number of correction codewords per block */
+void reed_solomon_encoder_init(reed_solomon_encoder_t *encoder, int correction_codewords) {
+    encoder->correction_codewords = correction_codewords;
+    encoder->kernel = reed_solomon_select_kernel();
+    memset(encoder->low_nibble_products, 0, sizeof(encoder->low_nibble_products));
+    memset(encoder->high_nibble_products, 0, sizeof(encoder->high_nibble_products));
+    memset(encoder->coefficient_low_products, 0, sizeof(encoder->coefficient_low_products));
+    memset(encoder->coefficient_high_products, 0, sizeof(encoder->coefficient_high_products));
+    for (int n = 0; n < RS_NIBBLE_VALUES; n++) {
+        for (int j = 0; j < correction_codewords; j++) {
+            unsigned char coefficient = RS_GENERATOR_POLYNOMIAL_COEFFICIENTS[correction_codewords][j + 1];
+            encoder->low_nibble_products[n][j] = gf_multiply(coefficient, n);
+            encoder->high_nibble_products[n][j] = gf_multiply(coefficient, n << 4);
+            encoder->coefficient_low_products[j][n] = encoder->low_nibble_products[n][j];
+            encoder->coefficient_high_products[j][n] = encoder->high_nibble_products[n][j];
         }
     }
 }
 
-/* Computes the correction bits from the given message and generator polynomial */
-void get_correction_words(unsigned char message_polynomial[], int message_size, unsigned char generator_polynomial[], int generator_polynomial_size, unsigned char destination[]) {
+/* Scalar kernel: the remainder is shifted one codeword at a time and the premultiplied generator is added to it */
+void reed_solomon_encode_scalar(const reed_solomon_encoder_t *encoder, const unsigned char message[], int message_size, unsigned char remainder[RS_VECTOR_SIZE]) {
+    int last = encoder->correction_codewords - 1;
+    memset(remainder, 0, RS_VECTOR_SIZE);
+    for (int i = 0; i < message_size; i++) {
+        unsigned char factor = message[i] ^ remainder[0];
+        const unsigned char *low = encoder->low_nibble_products[factor & 0x0F];
+        const unsigned char *high = encoder->high_nibble_products[factor >> 4];
+        for (int j = 0; j < last; j++)
+            remainder[j] = remainder[j + 1] ^ low[j] ^ high[j];
+        remainder[last] = low[last] ^ high[last];
+    }
+}
 
-    int pol_dim = message_size + generator_polynomial_size - 1;
-    unsigned char polynomial[pol_dim];
-    unsigned char temp_polynomial[pol_dim];
-    unsigned char temp_computation[pol_dim];
+#ifdef QRCODE_X86_SIMD
+/* SSSE3 kernel: the remainder is kept in two 16 bytes registers */
+__attribute__((target("ssse3")))
+void reed_solomon_encode_ssse3(const reed_solomon_encoder_t *encoder, const unsigned char message[], int message_size, unsigned char remainder[RS_VECTOR_SIZE]) {
+    __m128i remainder_low = _mm_setzero_si128();
+    __m128i remainder_high = _mm_setzero_si128();
+    for (int i = 0; i < message_size; i++) {
+        unsigned char factor = message[i] ^ (unsigned char) _mm_cvtsi128_si32(remainder_low);
+        const unsigned char *low = encoder->low_nibble_products[factor & 0x0F];
+        const unsigned char *high = encoder->high_nibble_products[factor >> 4];
+        remainder_low = _mm_alignr_epi8(remainder_high, remainder_low, 1);
+        remainder_high = _mm_srli_si128(remainder_high, 1);
+        remainder_low = _mm_xor_si128(remainder_low, _mm_xor_si128(_mm_loadu_si128((const __m128i*) low), _mm_loadu_si128((const __m128i*) high)));
+        remainder_high = _mm_xor_si128(remainder_high, _mm_xor_si128(_mm_loadu_si128((const __m128i*) (low + 16)), _mm_loadu_si128((const __m128i*) (high + 16))));
+    }
+    _mm_storeu_si128((__m128i*) remainder, remainder_low);
+    _mm_storeu_si128((__m128i*) (remainder + 16), remainder_high);
+}
 
-    /* Copy values */
-    for (int i = 0; i < pol_dim; i++) {
-        if (i <= generator_polynomial_size)
-            temp_polynomial[i] = generator_polynomial[i];
-        else
-            temp_polynomial[i] = 0;
+/* AVX2 kernel: the whole remainder fits in one register */
+__attribute__((target("avx2")))
+void reed_solomon_encode_avx2(const reed_solomon_encoder_t *encoder, const unsigned char message[], int message_size, unsigned char remainder[RS_VECTOR_SIZE]) {
+    __m256i remainder_vector = _mm256_setzero_si256();
+    for (int i = 0; i < message_size; i++) {
+        unsigned char factor = message[i] ^ (unsigned char) _mm256_cvtsi256_si32(remainder_vector);
+        /* Shift by one byte across the two 128 bits lanes */
+        remainder_vector = _mm256_alignr_epi8(_mm256_permute2x128_si256(remainder_vector, remainder_vector, 0x81), remainder_vector, 1);
+        remainder_vector = _mm256_xor_si256(remainder_vector, _mm256_xor_si256(
+                    _mm256_loadu_si256((const __m256i*) encoder->low_nibble_products[factor & 0x0F]),
+                    _mm256_loadu_si256((const __m256i*) encoder->high_nibble_products[factor >> 4])));
     }
-    for (int i = 0; i < pol_dim; i++) {
-        if (i < message_size)
-            polynomial[i] = message_polynomial[i];
-        else
-            polynomial[i] = 0;
+    _mm256_storeu_si256((__m256i*) remainder, remainder_vector);
+}
+#endif
+
+/* Computes the correction codewords of a message block (the remainder of message * x^n divided by the generator polynomial) */
+void get_correction_words(const reed_solomon_encoder_t *encoder, const unsigned char message[], int message_size, unsigned char destination[]) {
+    unsigned char remainder[RS_VECTOR_SIZE];
+    switch (encoder->kernel) {
+#ifdef QRCODE_X86_SIMD
+        case RS_KERNEL_AVX2:
+            reed_solomon_encode_avx2(encoder, message, message_size, remainder);
+            break;
+        case RS_KERNEL_SSSE3:
+            reed_solomon_encode_ssse3(encoder, message, message_size, remainder);
+            break;
+#endif
+        default:
+            reed_solomon_encode_scalar(encoder, message, message_size, remainder);
+            break;
     }
+    memcpy(destination, remainder, encoder->correction_codewords);
+}
 
-    /* Compute correction bits */
-    int polynomial_pos = 0;
+/* Maximum number of data codewords in a block */
+#define RS_MAX_BLOCK_DATA_CODEWORDS 123
+
+#ifdef QRCODE_X86_SIMD
+/* Batch SSSE3 kernel: every byte lane holds a different block, the remainder is one register per correction codeword
+ * and the generator coefficients multiply all lanes at once with two nibble shuffles */
+#define RS_SSSE3_LANES 16
+__attribute__((target("ssse3")))
+void reed_solomon_encode_batch_ssse3(const reed_solomon_encoder_t *encoder, const unsigned char *messages[RS_SSSE3_LANES], int message_size, unsigned char *destinations[RS_SSSE3_LANES]) {
+    int last = encoder->correction_codewords - 1;
+    const __m128i nibble_mask = _mm_set1_epi8(0x0F);
+    __m128i remainder[RS_MAX_CORRECTION_CODEWORDS];
+    for (int j = 0; j <= last; j++)
+        remainder[j] = _mm_setzero_si128();
+
+    unsigned char lanes[RS_SSSE3_LANES];
     for (int i = 0; i < message_size; i++) {
-        if (polynomial[i] != 0)  {
-            for (int j = polynomial_pos; j < polynomial_pos + generator_polynomial_size; j++) {
-                temp_computation[j] = (temp_polynomial[j] + log_reverse_lookup_table[polynomial[i]]) % 255;
-            }
-            for (int j = polynomial_pos; j < polynomial_pos + generator_polynomial_size; j++) {
-                polynomial[j] = log_lookup_table[temp_computation[j]] ^ polynomial[j];
-            }
+        for (int l = 0; l < RS_SSSE3_LANES; l++)
+            lanes[l] = messages[l][i];
+        __m128i factor = _mm_xor_si128(_mm_loadu_si128((const __m128i*) lanes), remainder[0]);
+        __m128i factor_low = _mm_and_si128(factor, nibble_mask);
+        __m128i factor_high = _mm_and_si128(_mm_srli_epi16(factor, 4), nibble_mask);
+        for (int j = 0; j <= last; j++) {
+            __m128i product = _mm_xor_si128(
+                    _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) encoder->coefficient_low_products[j]), factor_low),
+                    _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) encoder->coefficient_high_products[j]), factor_high));
+            remainder[j] = j < last ? _mm_xor_si128(remainder[j + 1], product) : product;
         }
-        polynomial_pos++;
+    }
+
+    for (int j = 0; j <= last; j++) {
+        _mm_storeu_si128((__m128i*) lanes, remainder[j]);
+        for (int l = 0; l < RS_SSSE3_LANES; l++)
+            destinations[l][j] = lanes[l];
+    }
+}
 
-        /* Shift temp polynomial */
-        for (int j = pol_dim - 1; j > 0; j--) {
-            temp_polynomial[j] = temp_polynomial[j-1];
+/* Batch AVX2 kernel: same as the SSSE3 one, with 32 blocks at a time */
+#define RS_AVX2_LANES 32
+__attribute__((target("avx2")))
+void reed_solomon_encode_batch_avx2(const reed_solomon_encoder_t *encoder, const unsigned char *messages[RS_AVX2_LANES], int message_size, unsigned char *destinations[RS_AVX2_LANES]) {
+    int last = encoder->correction_codewords - 1;
+    const __m256i nibble_mask = _mm256_set1_epi8(0x0F);
+    __m256i remainder[RS_MAX_CORRECTION_CODEWORDS];
+    for (int j = 0; j <= last; j++)
+        remainder[j] = _mm256_setzero_si256();
+
+    unsigned char lanes[RS_AVX2_LANES];
+    for (int i = 0; i < message_size; i++) {
+        for (int l = 0; l < RS_AVX2_LANES; l++)
+            lanes[l] = messages[l][i];
+        __m256i factor = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*) lanes), remainder[0]);
+        __m256i factor_low = _mm256_and_si256(factor, nibble_mask);
+        __m256i factor_high = _mm256_and_si256(_mm256_srli_epi16(factor, 4), nibble_mask);
+        for (int j = 0; j <= last; j++) {
+            __m256i product = _mm256_xor_si256(
+                    _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) encoder->coefficient_low_products[j])), factor_low),
+                    _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) encoder->coefficient_high_products[j])), factor_high));
+            remainder[j] = j < last ? _mm256_xor_si256(remainder[j + 1], product) : product;
         }
-        temp_polynomial[0] = 0;
     }
 
-    /* Fill destination with results */
-    int count = 0;
-    for (int i = polynomial_pos; i < polynomial_pos + generator_polynomial_size - 1; i++) {
-        destination[count] = polynomial[i];
-        count++;
+    for (int j = 0; j <= last; j++) {
+        _mm256_storeu_si256((__m256i*) lanes, remainder[j]);
+        for (int l = 0; l < RS_AVX2_LANES; l++)
+            destinations[l][j] = lanes[l];
+    }
+}
+#endif
+
+/* Computes the correction codewords of many message blocks of the same size (block i is messages[i], its correction goes to destinations[i]) */
+void get_correction_words_batch(const reed_solomon_encoder_t *encoder, const unsigned char *messages[], int message_size, int block_count, unsigned char *destinations[]) {
+    int block = 0;
+#ifdef QRCODE_X86_SIMD
+    int lanes = encoder->kernel == RS_KERNEL_AVX2 ? RS_AVX2_LANES : (encoder->kernel == RS_KERNEL_SSSE3 ? RS_SSSE3_LANES : 0);
+    if (lanes > 0 && message_size <= RS_MAX_BLOCK_DATA_CODEWORDS) {
+        /* Unused lanes of the last group encode an empty message into a scratch destination */
+        static const unsigned char empty_message[RS_MAX_BLOCK_DATA_CODEWORDS] = {0};
+        unsigned char scratch_destination[RS_VECTOR_SIZE];
+        const unsigned char *lane_messages[RS_AVX2_LANES];
+        unsigned char *lane_destinations[RS_AVX2_LANES];
+
+        /* A single leftover block is faster on its own */
+        while (block_count - block > 1) {
+            for (int l = 0; l < lanes; l++) {
+                lane_messages[l] = block + l < block_count ? messages[block + l] : empty_message;
+                lane_destinations[l] = block + l < block_count ? destinations[block + l] : scratch_destination;
+            }
+            if (encoder->kernel == RS_KERNEL_AVX2)
+                reed_solomon_encode_batch_avx2(encoder, lane_messages, message_size, lane_destinations);
+            else
+                reed_solomon_encode_batch_ssse3(encoder, lane_messages, message_size, lane_destinations);
+            block += lanes;
+        }
     }
+#endif
+    for (; block < block_count; block++)
+        get_correction_words(encoder, messages[block], message_size, destinations[block]);
+}
 
+/* Gets the value of a module of a matrix plane */
+bool get_matrix_module(const uint64_t plane[], int words_per_row, int row, int column) {
+    return (plane[row*words_per_row + column / QRCODE_MATRIX_WORD_BITS] >> (column % QRCODE_MATRIX_WORD_BITS)) & 1;
 }
 
-/* Populates a qrcode with patterns and data bits */
-void populate_qrcode(cell_t qrcode[], unsigned char data[], int version, int correction_level, int mask) {
+/* Sets the value of a module of a matrix plane */
+void set_matrix_module(uint64_t plane[], int words_per_row, int row, int column, bool value) {
+    uint64_t bit = (uint64_t) 1 << (column % QRCODE_MATRIX_WORD_BITS);
+    if (value)
+        plane[row*words_per_row + column / QRCODE_MATRIX_WORD_BITS] |= bit;
+    else
+        plane[row*words_per_row + column / QRCODE_MATRIX_WORD_BITS] &= ~bit;
+}
 
-    int qrcode_size = get_qrcode_size(version);
+/* Sets a module of the matrix and locks it */
+void set_function_module(qrcode_matrix_t *qrcode, int row, int column, bool value) {
+    set_matrix_module(qrcode->value, qrcode->words_per_row, row, column, value);
+    set_matrix_module(qrcode->function, qrcode->words_per_row, row, column, LOCKED);
+}
+
+/* Returns true if a module of the matrix is locked */
+bool is_module_locked(const qrcode_matrix_t *qrcode, int row, int column) {
+    return get_matrix_module(qrcode->function, qrcode->words_per_row, row, column);
+}
 
-    /* finder patterns */
-    /* fill outer white; lock all for later */
-    for (int i = 0; i < 8; i++) {
-        for (int j = 0; j < 8; j++) {
-            qrcode[qrcode_size*i + j].value = 0;
-            qrcode[qrcode_size*i + j].locked = 1;
-            qrcode[qrcode_size*(qrcode_size - 1 - i) + j].value = QRCODE_WHITE;
-            qrcode[qrcode_size*(qrcode_size - 1 - i) + j].locked = LOCKED;
-            qrcode[qrcode_size*(i) + qrcode_size - 1 - j].value = QRCODE_WHITE;
-            qrcode[qrcode_size*(i) + qrcode_size - 1 - j].locked = LOCKED;
+/* Gets the position of a Format Information bit (bit 0 is the most significant one) in one of its two copies */
+void get_format_information_position(int qrcode_size, int copy, int bit, int *row, int *column) {
+    if (copy == 0) {
+        /* Around the top left finder pattern, skipping the timing patterns */
+        if (bit <= 5) {
+            *row = 8;
+            *column = bit;
+        } else if (bit <= 7) {
+            *row = 8;
+            *column = bit + 1;
+        } else if (bit == 8) {
+            *row = 7;
+            *column = 8;
+        } else {
+            *row = 14 - bit;
+            *column = 8;
         }
-    }
-    /* fill outer black*/
-    for (int i = 0; i < 7; i++) {
-        for (int j = 0; j < 7; j++) {
-            qrcode[qrcode_size*i + j].value = QRCODE_BLACK;
-            qrcode[qrcode_size*i + j].locked = LOCKED;
-            qrcode[qrcode_size*(qrcode_size - 1 - i) + j].value = QRCODE_BLACK;
-            qrcode[qrcode_size*(i) + qrcode_size - 1 - j].value = QRCODE_BLACK;
+    } else {
+        /* Split between the bottom left and the top right finder patterns */
+        if (bit <= 6) {
+            *row = qrcode_size - 1 - bit;
+            *column = 8;
+        } else {
+            *row = 8;
+            *column = qrcode_size - 15 + bit;
         }
     }
-    /* fill inner white */
-    for (int i = 1; i < 6; i++) {
-        for (int j = 1; j < 6; j++) {
-            qrcode[qrcode_size*i + j].value = QRCODE_WHITE;
-            qrcode[qrcode_size*i + j].locked = LOCKED;
-            qrcode[qrcode_size*(qrcode_size - 1 - i) + j].value = QRCODE_WHITE;
-            qrcode[qrcode_size*(i) + qrcode_size - 1 - j].value = QRCODE_WHITE;
+}
+
+/* Draws the function patterns of a version (finder, alignment and timing patterns, dark module and version information)
+ * and locks all reserved cells, format information included */
+void draw_function_patterns(qrcode_matrix_t *qrcode, int version) {
+
+    int qrcode_size = get_qrcode_size(version);
+    qrcode->size = qrcode_size;
+    qrcode->words_per_row = (qrcode_size + QRCODE_MATRIX_WORD_BITS - 1) / QRCODE_MATRIX_WORD_BITS;
+    memset(qrcode->value, 0, sizeof(qrcode->value));
+    memset(qrcode->function, 0, sizeof(qrcode->function));
+
+    /* finder patterns (top left, bottom left, top right) */
+    const int finder_rows[] = {0, qrcode_size - 7, 0};
+    const int finder_columns[] = {0, 0, qrcode_size - 7};
+    for (int f = 0; f < 3; f++) {
+        /* fill outer white (separators) */
+        for (int i = -1; i <= 7; i++) {
+            for (int j = -1; j <= 7; j++) {
+                int row = finder_rows[f] + i;
+                int column = finder_columns[f] + j;
+                if (row >= 0 && row < qrcode_size && column >= 0 && column < qrcode_size)
+                    set_function_module(qrcode, row, column, QRCODE_WHITE);
+            }
         }
-    }
-    /* fill inner black */
-    for (int i = 2; i < 5; i++) {
-        for (int j = 2; j < 5; j++) {
-            qrcode[qrcode_size*i + j].value = QRCODE_BLACK;
-            qrcode[qrcode_size*i + j].locked = LOCKED;
-            qrcode[qrcode_size*(qrcode_size - 1 - i) + j].value = QRCODE_BLACK;
-            qrcode[qrcode_size*(i) + qrcode_size - 1 - j].value = QRCODE_BLACK;
+        /* fill black rings and inner square */
+        for (int i = 0; i < 7; i++) {
+            for (int j = 0; j < 7; j++) {
+                int distance = abs(i - 3) > abs(j - 3) ? abs(i - 3) : abs(j - 3);
+                set_function_module(qrcode, finder_rows[f] + i, finder_columns[f] + j, distance != 2);
+            }
         }
     }
 
@@ -395,19 +1649,15 @@ void populate_qrcode(cell_t qrcode[], unsigned char data[], int version, int cor
     if (version > 1) {
         for (int i = 0; i < ALIGN_PATTERN_LOCATION_SIZE; i++) {
             for (int j = 0; j < ALIGN_PATTERN_LOCATION_SIZE; j++) {
-                if (qrcode[qrcode_size*(QRCODE_INFO[version].align_pattern_locations[i]) + QRCODE_INFO[version].align_pattern_locations[j]].locked == UNLOCKED) {
+                int row = QRCODE_INFO[version].align_pattern_locations[i];
+                int column = QRCODE_INFO[version].align_pattern_locations[j];
+                if (!is_module_locked(qrcode, row, column)) {
                     for (int k = -2; k <= 2; k++) {
                         for (int h = -2; h <= 2; h++) {
-                            qrcode[qrcode_size*(QRCODE_INFO[version].align_pattern_locations[i] + k) + QRCODE_INFO[version].align_pattern_locations[j] + h].locked = LOCKED;
-                            qrcode[qrcode_size*(QRCODE_INFO[version].align_pattern_locations[i] + k) + QRCODE_INFO[version].align_pattern_locations[j] + h].value = QRCODE_BLACK;
-                        }
-                    }
-                    for (int k = -1; k <= 1; k++) {
-                        for (int h = -1; h <= 1; h++) {
-                            qrcode[qrcode_size*(QRCODE_INFO[version].align_pattern_locations[i] + k) + QRCODE_INFO[version].align_pattern_locations[j] + h].value = QRCODE_WHITE;
+                            int distance = abs(k) > abs(h) ? abs(k) : abs(h);
+                            set_function_module(qrcode, row + k, column + h, distance != 1);
                         }
                     }
-                    qrcode[qrcode_size*(QRCODE_INFO[version].align_pattern_locations[i]) + QRCODE_INFO[version].align_pattern_locations[j]].value = QRCODE_BLACK;
                 }
             }
         }
@@ -416,195 +1666,155 @@ void populate_qrcode(cell_t qrcode[], unsigned char data[], int version, int cor
     /* Timing patterns */
     const int alignment_pos = 6;
     for (int i = 0; i < qrcode_size; i++) {
-        if (qrcode[qrcode_size*(i) + alignment_pos].locked == UNLOCKED) {
-            qrcode[qrcode_size*(i) + alignment_pos].value = (i + 1) % 2;
-            qrcode[qrcode_size*(i) + alignment_pos].locked = LOCKED;
-        }
-        if (qrcode[qrcode_size*(alignment_pos) + i].locked == UNLOCKED) {
-            qrcode[qrcode_size*(alignment_pos) + i].value = (i + 1) % 2;
-            qrcode[qrcode_size*(alignment_pos) + i].locked = LOCKED;
-        }
+        if (!is_module_locked(qrcode, i, alignment_pos))
+            set_function_module(qrcode, i, alignment_pos, (i + 1) % 2);
+        if (!is_module_locked(qrcode, alignment_pos, i))
+            set_function_module(qrcode, alignment_pos, i, (i + 1) % 2);
     }
 
     /* Dark module and reserved areas */
-    qrcode[qrcode_size*(qrcode_size - 1 - 7) + 8].value = QRCODE_BLACK;
-    qrcode[qrcode_size*(qrcode_size - 1 - 7) + 8].locked = LOCKED;
+    set_function_module(qrcode, qrcode_size - 1 - 7, 8, QRCODE_BLACK);
 
     /* version 7 or above require a Version Information Area */
     if (version >= 7) {
-        /* Lock the cells */
-        for (int i = 0; i < 3; i++) {
-            for (int j = 0; j < 6; j++) {
-                qrcode[qrcode_size*(qrcode_size - 11 + i) + j].locked = LOCKED;
-                qrcode[qrcode_size*(j) + qrcode_size - 11 + i].locked = LOCKED;
+        /* Put Version Information bits (from the least significant one) */
+        unsigned int version_bits = VERSION_INFORMATION_STRINGS[version];
+        for (int i = 0; i < 6; i++) {
+            for (int j = 0; j < 3; j++) {
+                bool bit = (version_bits >> (i*3 + j)) & 1;
+                set_function_module(qrcode, qrcode_size - 11 + j, i, bit);
+                set_function_module(qrcode, i, qrcode_size - 11 + j, bit);
             }
         }
+    }
 
-        /* Put Version Information bits */
-        unsigned char version_bits[VERSION_INFORMATION_BITS_SIZE];
-        get_binary_from_integer(version, version_bits , VERSION_BITS_SIZE);
-        for (int i = VERSION_BITS_SIZE; i < VERSION_INFORMATION_BITS_SIZE; i++) {
-            version_bits[i] = 0;
+    /* Lock Format Information cells (their values are written with the mask) */
+    for (int copy = 0; copy < 2; copy++) {
+        for (int i = 0; i < FORMAT_INFORMATION_BITS_SIZE; i++) {
+            int row, column;
+            get_format_information_position(qrcode_size, copy, i, &row, &column);
+            set_function_module(qrcode, row, column, QRCODE_WHITE);
         }
+    }
+}
 
-        /* Compute correction bits */
-        int current_position = 0;
-        while (version_bits[current_position] == 0)
-            current_position++;
-        while (current_position < VERSION_POSITION_THRESHOLD) {
-            for (int i = current_position; i < VERSION_INFORMATION_BITS_SIZE; i++) {
-                if (i - current_position < VERSION_INFORMATION_GENERATOR_POLYNOMIAL_SIZE)
-                    version_bits[i] ^= VERSION_INFORMATION_GENERATOR_POLYNOMIAL[i - current_position];
-                else
-                    version_bits[i] ^= 0;
-            }
-            while (version_bits[current_position] == 0)
-                current_position++;
+/* Returns true if the module in the given position is inverted by the mask */
+bool is_mask_module(int mask, int i, int j) {
+    switch (mask) {
+        case 0:
+            return (i + j) % 2 == 0;
+        case 1:
+            return (i) % 2 == 0;
+        case 2:
+            return (j) % 3 == 0;
+        case 3:
+            return (i + j) % 3 == 0;
+        case 4:
+            return (i/2 + j/3) % 2 == 0;
+        case 5:
+            return ((i*j) % 2) + ((i*j) % 3) == 0;
+        case 6:
+            return (((i*j) % 2) + ((i*j) % 3)) % 2 == 0;
+        case 7:
+            return (((i+j) % 2) + ((i*j) % 3)) % 2 == 0;
+    }
+    return false;
+}
 
+/* Everything that only depends on the version: the function patterns and the modules inverted by every mask */
+typedef struct version_template {
+    qrcode_matrix_t function_patterns;
+    /* Mask planes, already restricted to the free modules */
+    uint64_t masks[MASK_NUMBER][QRCODE_MAX_SIZE * QRCODE_MATRIX_MAX_WORDS_PER_ROW];
+} version_template_t;
+
+/* Templates of every version, built on first use and shared by all threads */
+_Atomic(version_template_t*) version_templates[QRCODE_VERSIONS + 1];
+
+/* Gets the template of a version (NULL if it could not be allocated) */
+const version_template_t *get_version_template(int version) {
+    version_template_t *version_template = atomic_load_explicit(&version_templates[version], memory_order_acquire);
+    if (version_template)
+        return version_template;
+
+    version_template = malloc(sizeof(version_template_t));
+    if (!version_template)
+        return NULL;
+    qrcode_matrix_t *function_patterns = &version_template->function_patterns;
+    draw_function_patterns(function_patterns, version);
+
+    /* Mask planes, one word at a time */
+    for (int mask = 0; mask < MASK_NUMBER; mask++) {
+        for (int i = 0; i < function_patterns->size; i++) {
+            for (int w = 0; w < function_patterns->words_per_row; w++) {
+                uint64_t mask_word = 0;
+                for (int b = 0; b < QRCODE_MATRIX_WORD_BITS && w*QRCODE_MATRIX_WORD_BITS + b < function_patterns->size; b++) {
+                    if (is_mask_module(mask, i, w*QRCODE_MATRIX_WORD_BITS + b))
+                        mask_word |= (uint64_t) 1 << b;
+                }
+                version_template->masks[mask][i*function_patterns->words_per_row + w] = mask_word & ~function_patterns->function[i*function_patterns->words_per_row + w];
+            }
         }
-        /* Put the bits again, as the correction bits should be right after these */
-        get_binary_from_integer(version, version_bits, VERSION_BITS_SIZE);
-
-        /* Manually put every bit in its place */
-        qrcode[qrcode_size*(qrcode_size - 11 + 0) + 0].value = version_bits[17];
-        qrcode[qrcode_size*(qrcode_size - 11 + 1) + 0].value = version_bits[16];
-        qrcode[qrcode_size*(qrcode_size - 11 + 2) + 0].value = version_bits[15];
-        qrcode[qrcode_size*(qrcode_size - 11 + 0) + 1].value = version_bits[14];
-        qrcode[qrcode_size*(qrcode_size - 11 + 1) + 1].value = version_bits[13];
-        qrcode[qrcode_size*(qrcode_size - 11 + 2) + 1].value = version_bits[12];
-        qrcode[qrcode_size*(qrcode_size - 11 + 0) + 2].value = version_bits[11];
-        qrcode[qrcode_size*(qrcode_size - 11 + 1) + 2].value = version_bits[10];
-        qrcode[qrcode_size*(qrcode_size - 11 + 2) + 2].value = version_bits[9];
-        qrcode[qrcode_size*(qrcode_size - 11 + 0) + 3].value = version_bits[8];
-        qrcode[qrcode_size*(qrcode_size - 11 + 1) + 3].value = version_bits[7];
-        qrcode[qrcode_size*(qrcode_size - 11 + 2) + 3].value = version_bits[6];
-        qrcode[qrcode_size*(qrcode_size - 11 + 0) + 4].value = version_bits[5];
-        qrcode[qrcode_size*(qrcode_size - 11 + 1) + 4].value = version_bits[4];
-        qrcode[qrcode_size*(qrcode_size - 11 + 2) + 4].value = version_bits[3];
-        qrcode[qrcode_size*(qrcode_size - 11 + 0) + 5].value = version_bits[2];
-        qrcode[qrcode_size*(qrcode_size - 11 + 1) + 5].value = version_bits[1];
-        qrcode[qrcode_size*(qrcode_size - 11 + 2) + 5].value = version_bits[0];
-
-        qrcode[qrcode_size*(0) + qrcode_size - 11 + 0].value = version_bits[17];
-        qrcode[qrcode_size*(0) + qrcode_size - 11 + 1].value = version_bits[16];
-        qrcode[qrcode_size*(0) + qrcode_size - 11 + 2].value = version_bits[15];
-        qrcode[qrcode_size*(1) + qrcode_size - 11 + 0].value = version_bits[14];
-        qrcode[qrcode_size*(1) + qrcode_size - 11 + 1].value = version_bits[13];
-        qrcode[qrcode_size*(1) + qrcode_size - 11 + 2].value = version_bits[12];
-        qrcode[qrcode_size*(2) + qrcode_size - 11 + 0].value = version_bits[11];
-        qrcode[qrcode_size*(2) + qrcode_size - 11 + 1].value = version_bits[10];
-        qrcode[qrcode_size*(2) + qrcode_size - 11 + 2].value = version_bits[9];
-        qrcode[qrcode_size*(3) + qrcode_size - 11 + 0].value = version_bits[8];
-        qrcode[qrcode_size*(3) + qrcode_size - 11 + 1].value = version_bits[7];
-        qrcode[qrcode_size*(3) + qrcode_size - 11 + 2].value = version_bits[6];
-        qrcode[qrcode_size*(4) + qrcode_size - 11 + 0].value = version_bits[5];
-        qrcode[qrcode_size*(4) + qrcode_size - 11 + 1].value = version_bits[4];
-        qrcode[qrcode_size*(4) + qrcode_size - 11 + 2].value = version_bits[3];
-        qrcode[qrcode_size*(5) + qrcode_size - 11 + 0].value = version_bits[2];
-        qrcode[qrcode_size*(5) + qrcode_size - 11 + 1].value = version_bits[1];
-        qrcode[qrcode_size*(5) + qrcode_size - 11 + 2].value = version_bits[0];
-    }
-
-    /* Lock Format Information cells */
-    qrcode[qrcode_size*(qrcode_size - 1) + 8].locked = LOCKED;
-    qrcode[qrcode_size*(qrcode_size - 2) + 8].locked = LOCKED;
-    qrcode[qrcode_size*(qrcode_size - 3) + 8].locked = LOCKED;
-    qrcode[qrcode_size*(qrcode_size - 4) + 8].locked = LOCKED;
-    qrcode[qrcode_size*(qrcode_size - 5) + 8].locked = LOCKED;
-    qrcode[qrcode_size*(qrcode_size - 6) + 8].locked = LOCKED;
-    qrcode[qrcode_size*(qrcode_size - 7) + 8].locked = LOCKED;
-    qrcode[qrcode_size*(8) + qrcode_size - 8].locked = LOCKED;
-    qrcode[qrcode_size*(8) + qrcode_size - 7].locked = LOCKED;
-    qrcode[qrcode_size*(8) + qrcode_size - 6].locked = LOCKED;
-    qrcode[qrcode_size*(8) + qrcode_size - 5].locked = LOCKED;
-    qrcode[qrcode_size*(8) + qrcode_size - 4].locked = LOCKED;
-    qrcode[qrcode_size*(8) + qrcode_size - 3].locked = LOCKED;
-    qrcode[qrcode_size*(8) + qrcode_size - 2].locked = LOCKED;
-    qrcode[qrcode_size*(8) + qrcode_size - 1].locked = LOCKED;
-    qrcode[qrcode_size*(8) + 0].locked = LOCKED;
-    qrcode[qrcode_size*(8) + 1].locked = LOCKED;
-    qrcode[qrcode_size*(8) + 2].locked = LOCKED;
-    qrcode[qrcode_size*(8) + 3].locked = LOCKED;
-    qrcode[qrcode_size*(8) + 4].locked = LOCKED;
-    qrcode[qrcode_size*(8) + 5].locked = LOCKED;
-    qrcode[qrcode_size*(8) + 7].locked = LOCKED;
-    qrcode[qrcode_size*(8) + 8].locked = LOCKED;
-    qrcode[qrcode_size*(7) + 8].locked = LOCKED;
-    qrcode[qrcode_size*(5) + 8].locked = LOCKED;
-    qrcode[qrcode_size*(4) + 8].locked = LOCKED;
-    qrcode[qrcode_size*(3) + 8].locked = LOCKED;
-    qrcode[qrcode_size*(2) + 8].locked = LOCKED;
-    qrcode[qrcode_size*(1) + 8].locked = LOCKED;
-    qrcode[qrcode_size*(0) + 8].locked = LOCKED;
-
-    /* Get Format Information bits */
-    unsigned char format_bits[FORMAT_INFORMATION_BITS_SIZE];
-    for (int i = 0; i < ERROR_CORRECTION_LEVEL_BITS_SIZE; i++)
-        format_bits[i] = ERROR_CORRECTION_LEVEL_BITS[correction_level][i];
-    get_binary_from_integer(mask, format_bits + ERROR_CORRECTION_LEVEL_BITS_SIZE, MASK_LEVEL_BITS_SIZE);
-    for (int i = ERROR_CORRECTION_LEVEL_BITS_SIZE + MASK_LEVEL_BITS_SIZE; i < FORMAT_INFORMATION_BITS_SIZE; i++) {
-        format_bits[i] = 0;
-    }
-
-    /* Compute correction bits */
-    int current_position = 0;
-    while (format_bits[current_position] == 0)
-        current_position++;
-    while (current_position < FORMAT_POSITION_THRESHOLD) {
-        for (int i = current_position; i < FORMAT_INFORMATION_BITS_SIZE; i++) {
-            if (i - current_position < FORMAT_STRING_GENERATOR_POLYNOMIAL_SIZE)
-                format_bits[i] ^= FORMAT_INFORMATION_GENERATOR_POLYNOMIAL[i - current_position];
-            else
-                format_bits[i] ^= 0;
-        }
-        while (format_bits[current_position] == 0)
-            current_position++;
+    }
 
+    /* If another thread published its template first, use that one */
+    version_template_t *expected = NULL;
+    if (!atomic_compare_exchange_strong_explicit(&version_templates[version], &expected, version_template, memory_order_acq_rel, memory_order_acquire)) {
+        free(version_template);
+        return expected;
     }
-    /* Put initial bits again as the correction bits should already be after them */
-    for (int i = 0; i < ERROR_CORRECTION_LEVEL_BITS_SIZE; i++)
-        format_bits[i] = ERROR_CORRECTION_LEVEL_BITS[correction_level][i];
-    get_binary_from_integer(mask, format_bits + ERROR_CORRECTION_LEVEL_BITS_SIZE, MASK_LEVEL_BITS_SIZE);
+    return version_template;
+}
 
-    /* Apply fixed mask */
-    for (int i = 0; i < FORMAT_INFORMATION_BITS_SIZE; i++) {
-        format_bits[i] ^= FORMAT_INFORMATION_MASK_STRING[i];
-    }
-
-    /* Manually put the Format Information bits */
-    qrcode[qrcode_size*(qrcode_size - 1) + 8].value = format_bits[0];
-    qrcode[qrcode_size*(qrcode_size - 2) + 8].value = format_bits[1];
-    qrcode[qrcode_size*(qrcode_size - 3) + 8].value = format_bits[2];
-    qrcode[qrcode_size*(qrcode_size - 4) + 8].value = format_bits[3];
-    qrcode[qrcode_size*(qrcode_size - 5) + 8].value = format_bits[4];
-    qrcode[qrcode_size*(qrcode_size - 6) + 8].value = format_bits[5];
-    qrcode[qrcode_size*(qrcode_size - 7) + 8].value = format_bits[6];
-    qrcode[qrcode_size*(8) + qrcode_size - 8].value = format_bits[7];
-    qrcode[qrcode_size*(8) + qrcode_size - 7].value = format_bits[8];
-    qrcode[qrcode_size*(8) + qrcode_size - 6].value = format_bits[9];
-    qrcode[qrcode_size*(8) + qrcode_size - 5].value = format_bits[10];
-    qrcode[qrcode_size*(8) + qrcode_size - 4].value = format_bits[11];
-    qrcode[qrcode_size*(8) + qrcode_size - 3].value = format_bits[12];
-    qrcode[qrcode_size*(8) + qrcode_size - 2].value = format_bits[13];
-    qrcode[qrcode_size*(8) + qrcode_size - 1].value = format_bits[14];
-
-    qrcode[qrcode_size*(8) + 0].value = format_bits[0];
-    qrcode[qrcode_size*(8) + 1].value = format_bits[1];
-    qrcode[qrcode_size*(8) + 2].value = format_bits[2];
-    qrcode[qrcode_size*(8) + 3].value = format_bits[3];
-    qrcode[qrcode_size*(8) + 4].value = format_bits[4];
-    qrcode[qrcode_size*(8) + 5].value = format_bits[5];
-    qrcode[qrcode_size*(8) + 7].value = format_bits[6];
-    qrcode[qrcode_size*(8) + 8].value = format_bits[7];
-    qrcode[qrcode_size*(7) + 8].value = format_bits[8];
-    qrcode[qrcode_size*(5) + 8].value = format_bits[9];
-    qrcode[qrcode_size*(4) + 8].value = format_bits[10];
-    qrcode[qrcode_size*(3) + 8].value = format_bits[11];
-    qrcode[qrcode_size*(2) + 8].value = format_bits[12];
-    qrcode[qrcode_size*(1) + 8].value = format_bits[13];
-    qrcode[qrcode_size*(0) + 8].value = format_bits[14];
-
-    /* Insert Data */
+/* Placement maps of every version and correction level, built on first use and shared by all threads */
+_Atomic(unsigned short*) placement_maps[QRCODE_VERSIONS + 1][CORRECTION_LEVELS];
+
+/* Gets the placement map of a version and correction level (NULL if it could not be allocated):
+ * the bit index in the value plane of the module of every codeword bit, with the codewords in block order (data blocks followed by correction blocks).
+ * It combines the interleaving of the blocks and the zigzag placement; the remainder bits are left white in the function pattern template. */
+const unsigned short *get_placement_map(int version, int correction_level) {
+    unsigned short *placement_map = atomic_load_explicit(&placement_maps[version][correction_level], memory_order_acquire);
+    if (placement_map)
+        return placement_map;
+
+    const version_template_t *version_template = get_version_template(version);
+    if (!version_template)
+        return NULL;
+    const qrcode_matrix_t *function_pattern_template = &version_template->function_patterns;
+
+    int qrcode_size = function_pattern_template->size;
+    int words_per_row = function_pattern_template->words_per_row;
+    const correction_level_related_information_t *info = &QRCODE_INFO[version].correction_level_info[correction_level];
+    int blocks1 = info->blocks_in_group1;
+    int words_per_block1 = info->data_codewords_per_block_in_group1;
+    int blocks2 = info->blocks_in_group2;
+    int words_per_block2 = info->data_codewords_per_block_in_group2;
+    int ecc_per_block = info->error_correction_codewords_per_block;
+    int final_codewords = info->total_codewords + ecc_per_block*(blocks1 + blocks2);
+    int data_bits = final_codewords * BITS_PER_BYTE;
+
+    /* The map is allocated with room after it for the block order index of every interleaved codeword, which is dropped once the map is built
+     * (a stack array would take several KB of the small stacks of worker threads) */
+    placement_map = malloc(sizeof(unsigned short) * (data_bits + final_codewords));
+    if (!placement_map)
+        return NULL;
+    unsigned short *codeword_order = placement_map + data_bits;
+    int position = 0;
+    for (int i = 0; i < (words_per_block1 > words_per_block2 ? words_per_block1 : words_per_block2); i++) {
+        /* If the second group exists, its blocks are always larger than those in group 1 */
+        if (i < words_per_block1) {
+            for (int j = 0; j < blocks1; j++)
+                codeword_order[position++] = i + j*(words_per_block1);
+        }
+        for (int j = 0; j < blocks2; j++)
+            codeword_order[position++] = words_per_block1*blocks1 + i + j*(words_per_block2);
+    }
+    for (int i = 0; i < ecc_per_block; i++) {
+        for (int j = 0; j < (blocks1 + blocks2); j++)
+            codeword_order[position++] = info->total_codewords + i + j*(ecc_per_block);
+    }
+
+    /* Zigzag walk over the free modules */
     int i = qrcode_size - 1;
     int j = qrcode_size - 1;
     int current = 0;
@@ -612,8 +1822,9 @@ void populate_qrcode(cell_t qrcode[], unsigned char data[], int version, int cor
     bool is_right = true;
     while (i != qrcode_size - 1 || j != 0) {
         if (state == ASCENDING) {
-            if (qrcode[qrcode_size*(i) + j].locked == UNLOCKED) {
-                qrcode[qrcode_size*(i) + j].value = data[current];
+            if (!is_module_locked(function_pattern_template, i, j)) {
+                if (current < data_bits)
+                    placement_map[codeword_order[current / BITS_PER_BYTE]*BITS_PER_BYTE + current % BITS_PER_BYTE] = (i*words_per_row)*QRCODE_MATRIX_WORD_BITS + j;
                 current++;
             }
             if (is_right) {
@@ -631,8 +1842,9 @@ void populate_qrcode(cell_t qrcode[], unsigned char data[], int version, int cor
                 }
             }
         } else if (state == DESCENDING) {
-            if (qrcode[qrcode_size*(i) + j].locked == UNLOCKED) {
-                qrcode[qrcode_size*(i) + j].value = data[current];
+            if (!is_module_locked(function_pattern_template, i, j)) {
+                if (current < data_bits)
+                    placement_map[codeword_order[current / BITS_PER_BYTE]*BITS_PER_BYTE + current % BITS_PER_BYTE] = (i*words_per_row)*QRCODE_MATRIX_WORD_BITS + j;
                 current++;
             }
             if (is_right) {
@@ -652,188 +1864,190 @@ void populate_qrcode(cell_t qrcode[], unsigned char data[], int version, int cor
         }
     }
 
-    /* Apply mask */
-    switch (mask) {
-        case 0:
-            for (int i = 0; i < qrcode_size; i++) {
-                for (int j = 0; j < qrcode_size; j++) {
-                    if ((i + j) % 2 == 0 && qrcode[qrcode_size*i + j].locked == UNLOCKED)
-                        qrcode[qrcode_size*i + j].value = !qrcode[qrcode_size*i + j].value;
-                }
-            }
-            break;
-        case 1:
-            for (int i = 0; i < qrcode_size; i++) {
-                for (int j = 0; j < qrcode_size; j++) {
-                    if ((i) % 2 == 0 && qrcode[qrcode_size*i + j].locked == UNLOCKED)
-                        qrcode[qrcode_size*i + j].value = !qrcode[qrcode_size*i + j].value;
-                }
-            }
-            break;
-        case 2:
-            for (int i = 0; i < qrcode_size; i++) {
-                for (int j = 0; j < qrcode_size; j++) {
-                    if ((j) % 3 == 0 && qrcode[qrcode_size*i + j].locked == UNLOCKED)
-                        qrcode[qrcode_size*i + j].value = !qrcode[qrcode_size*i + j].value;
-                }
-            }
-            break;
-        case 3:
-            for (int i = 0; i < qrcode_size; i++) {
-                for (int j = 0; j < qrcode_size; j++) {
-                    if ((i + j) % 3 == 0 && qrcode[qrcode_size*i + j].locked == UNLOCKED)
-                        qrcode[qrcode_size*i + j].value = !qrcode[qrcode_size*i + j].value;
-                }
-            }
-            break;
-        case 4:
-            for (int i = 0; i < qrcode_size; i++) {
-                for (int j = 0; j < qrcode_size; j++) {
-                    if ((int)(floor((double)i/2) + floor((double)j/3)) % 2 == 0 && qrcode[qrcode_size*i + j].locked == UNLOCKED)
-                        qrcode[qrcode_size*i + j].value = !qrcode[qrcode_size*i + j].value;
-                }
-            }
-            break;
-        case 5:
-            for (int i = 0; i < qrcode_size; i++) {
-                for (int j = 0; j < qrcode_size; j++) {
-                    if (((i*j) % 2) + ((i*j) % 3) == 0 && qrcode[qrcode_size*i + j].locked == UNLOCKED)
-                        qrcode[qrcode_size*i + j].value = !qrcode[qrcode_size*i + j].value;
-                }
-            }
-            break;
-        case 6:
-            for (int i = 0; i < qrcode_size; i++) {
-                for (int j = 0; j < qrcode_size; j++) {
-                    if ((((i*j) % 2) + ((i*j) % 3)) % 2 == 0 && qrcode[qrcode_size*i + j].locked == UNLOCKED)
-                        qrcode[qrcode_size*i + j].value = !qrcode[qrcode_size*i + j].value;
-                }
-            }
-            break;
-        case 7:
-            for (int i = 0; i < qrcode_size; i++) {
-                for (int j = 0; j < qrcode_size; j++) {
-                    if ((((i+j) % 2) + ((i*j) % 3)) % 2 == 0 && qrcode[qrcode_size*i + j].locked == UNLOCKED)
-                        qrcode[qrcode_size*i + j].value = !qrcode[qrcode_size*i + j].value;
-                }
-            }
-            break;
+    unsigned short *shrunk_placement_map = realloc(placement_map, sizeof(unsigned short) * data_bits);
+    if (shrunk_placement_map)
+        placement_map = shrunk_placement_map;
+
+    /* If another thread published its map first, use that one */
+    unsigned short *expected = NULL;
+    if (!atomic_compare_exchange_strong_explicit(&placement_maps[version][correction_level], &expected, placement_map, memory_order_acq_rel, memory_order_acquire)) {
+        free(placement_map);
+        return expected;
     }
+    return placement_map;
 }
 
-/* Computes the penalty of the given qrcode */
-unsigned int compute_qrcode_penalty(cell_t qrcode[], int version) {
-    int qrcode_size = get_qrcode_size(version);
-    unsigned int penalty = 0;
-    /* Penalty 1: check for 5 or more blocks of the same color in a row (or column)*/
-    int same_color_counter = 0;
-    bool current_value = QRCODE_WHITE;
-    for (int i = 0; i < qrcode_size; i++) {
-        for (int j = 0; j < qrcode_size; j++) {
-            if (qrcode[qrcode_size*(i) + j].value == current_value) {
-                same_color_counter++;
-            } else {
-                if (same_color_counter >= 5)
-                    penalty += (same_color_counter - 2);
-                current_value = !current_value;
-                same_color_counter = 1;
-            }
+/* Populates a qrcode with patterns and codewords (data and correction codewords in block order, placed through the placement map).
+ * No mask is applied and the format information is left empty */
+void populate_qrcode(qrcode_matrix_t *qrcode, const unsigned char codewords[], int data_codewords, const unsigned short placement_map[], const version_template_t *version_template) {
+
+    /* Start from the function patterns of the version */
+    const qrcode_matrix_t *function_patterns = &version_template->function_patterns;
+    qrcode->size = function_patterns->size;
+    qrcode->words_per_row = function_patterns->words_per_row;
+    memcpy(qrcode->value, function_patterns->value, sizeof(uint64_t) * qrcode->size * qrcode->words_per_row);
+    memcpy(qrcode->function, function_patterns->function, sizeof(uint64_t) * qrcode->size * qrcode->words_per_row);
+
+    /* Insert Data: every bit goes straight to its module (free modules are white in the template) */
+    for (int i = 0; i < data_codewords; i++) {
+        unsigned char codeword = codewords[i];
+        const unsigned short *codeword_modules = placement_map + i*BITS_PER_BYTE;
+        for (int b = 0; b < BITS_PER_BYTE; b++)
+            qrcode->value[codeword_modules[b] / QRCODE_MATRIX_WORD_BITS] |= (uint64_t) ((codeword >> (BITS_PER_BYTE - 1 - b)) & 1) << (codeword_modules[b] % QRCODE_MATRIX_WORD_BITS);
+    }
+}
+
+/* Writes into destination the values of the populated qrcode with a mask and its Format Information applied.
+ * Only the value plane of destination is filled */
+void apply_mask(qrcode_matrix_t *destination, const qrcode_matrix_t *qrcode, const version_template_t *version_template, int correction_level, int mask) {
+    int qrcode_size = qrcode->size;
+    int words_per_row = qrcode->words_per_row;
+    destination->size = qrcode_size;
+    destination->words_per_row = words_per_row;
+
+    /* Apply mask: a XOR of whole words with the mask plane */
+    const uint64_t *mask_plane = version_template->masks[mask];
+    for (int i = 0; i < qrcode_size*words_per_row; i++)
+        destination->value[i] = qrcode->value[i] ^ mask_plane[i];
+
+    /* Put the Format Information bits (from the most significant one) */
+    unsigned int format_bits = FORMAT_INFORMATION_STRINGS[correction_level][mask];
+    for (int copy = 0; copy < 2; copy++) {
+        for (int i = 0; i < FORMAT_INFORMATION_BITS_SIZE; i++) {
+            int row, column;
+            get_format_information_position(qrcode_size, copy, i, &row, &column);
+            set_matrix_module(destination->value, words_per_row, row, column, (format_bits >> (FORMAT_INFORMATION_BITS_SIZE - 1 - i)) & 1);
         }
-        if (same_color_counter >= 5)
-            penalty += (same_color_counter - 2);
-        same_color_counter = 0;
-    }
-    for (int j = 0; j < qrcode_size; j++) {
-        for (int i = 0; i < qrcode_size; i++) {
-            if (qrcode[qrcode_size*(i) + j].value == current_value) {
-                same_color_counter++;
-            } else {
-                if (same_color_counter >= 5)
-                    penalty += (same_color_counter - 2);
-                current_value = !current_value;
-                same_color_counter = 1;
-            }
+    }
+}
+
+/* Number of bits set in a word */
+int count_bits(uint64_t word) {
+#ifdef __GNUC__
+    return __builtin_popcountll(word);
+#else
+    int count = 0;
+    for (; word; word &= word - 1)
+        count++;
+    return count;
+#endif
+}
+
+/* Gets word w of a packed row shifted by 'shift' (0-63) modules towards its start: bit j of the result is module (w*64 + j + shift) */
+uint64_t get_shifted_row_word(const uint64_t row[], int words_per_row, int w, int shift) {
+    if (shift == 0)
+        return row[w];
+    uint64_t word = row[w] >> shift;
+    if (w + 1 < words_per_row)
+        word |= row[w + 1] << (QRCODE_MATRIX_WORD_BITS - shift);
+    return word;
+}
+
+/* Gets the bits of word w that are in positions lower than limit */
+uint64_t get_positions_mask(int w, int limit) {
+    int bits = limit - w*QRCODE_MATRIX_WORD_BITS;
+    if (bits <= 0)
+        return 0;
+    return bits >= QRCODE_MATRIX_WORD_BITS ? ~(uint64_t) 0 : ((uint64_t) 1 << bits) - 1;
+}
+
+/* Transposes a block of 64x64 modules in place (bit c of row r becomes bit r of row c) */
+void transpose_bit_block(uint64_t block[QRCODE_MATRIX_WORD_BITS]) {
+    uint64_t mask = 0x00000000FFFFFFFFULL;
+    for (int j = QRCODE_MATRIX_WORD_BITS / 2; j > 0; j >>= 1, mask ^= mask << j) {
+        for (int k = 0; k < QRCODE_MATRIX_WORD_BITS; k = (k + j + 1) & ~j) {
+            uint64_t t = ((block[k] >> j) ^ block[k + j]) & mask;
+            block[k] ^= t << j;
+            block[k + j] ^= t;
         }
-        if (same_color_counter >= 5)
-            penalty += (same_color_counter - 2);
-        same_color_counter = 0;
     }
+}
 
-    /* Penaly 2: check for blocks of 4 squares */
-    for (int i = 0; i < qrcode_size - 1; i++) {
-        for (int j = 0; j < qrcode_size - 1; j++) {
-            if (qrcode[qrcode_size*(i) + j].value == qrcode[qrcode_size*(i) + j + 1].value &&
-                    qrcode[qrcode_size*(i) + j].value == qrcode[qrcode_size*(i + 1) + j].value &&
-                    qrcode[qrcode_size*(i) + j].value == qrcode[qrcode_size*(i + 1) + j + 1].value) {
-                penalty += 3;
+/* Writes the value plane of the matrix with rows and columns swapped into destination (same layout as the matrix) */
+void transpose_matrix(const qrcode_matrix_t *qrcode, uint64_t destination[]) {
+    uint64_t block[QRCODE_MATRIX_WORD_BITS];
+    for (int block_row = 0; block_row < qrcode->words_per_row; block_row++) {
+        for (int block_column = 0; block_column < qrcode->words_per_row; block_column++) {
+            for (int k = 0; k < QRCODE_MATRIX_WORD_BITS; k++) {
+                int row = block_row*QRCODE_MATRIX_WORD_BITS + k;
+                block[k] = row < qrcode->size ? qrcode->value[row*qrcode->words_per_row + block_column] : 0;
+            }
+            transpose_bit_block(block);
+            for (int k = 0; k < QRCODE_MATRIX_WORD_BITS; k++) {
+                int row = block_column*QRCODE_MATRIX_WORD_BITS + k;
+                if (row < qrcode->size)
+                    destination[row*qrcode->words_per_row + block_row] = block[k];
             }
         }
     }
+}
 
-    /* Penalty 3: patterns BWBBBWBWWWW or WWWWBWBBBWB give penalties in rows or columns */
-    const int PENALY_PATTERN_SIZE = 11;
-    const char penalty_pattern1[] = {QRCODE_BLACK, QRCODE_WHITE, QRCODE_BLACK, QRCODE_BLACK, QRCODE_BLACK, QRCODE_WHITE, QRCODE_BLACK, QRCODE_WHITE, QRCODE_WHITE, QRCODE_WHITE, QRCODE_WHITE};
-    const char penalty_pattern2[] = {QRCODE_WHITE, QRCODE_WHITE, QRCODE_WHITE, QRCODE_WHITE, QRCODE_BLACK, QRCODE_WHITE, QRCODE_BLACK, QRCODE_BLACK, QRCODE_BLACK, QRCODE_WHITE, QRCODE_BLACK};
+/* Penalty rules 1 and 3 on every row of a plane: runs of 5 or more modules of the same color and (if requested) the finder-like patterns */
+unsigned int compute_rows_penalty(const uint64_t plane[], int qrcode_size, int words_per_row, bool finder_patterns) {
+    /* Finder-like patterns BWBBBWBWWWW and WWWWBWBBBWB (module p of the pattern is bit p) */
+    const int PENALTY_PATTERN_SIZE = 11;
+    const unsigned int penalty_pattern1 = 0x05D;
+    const unsigned int penalty_pattern2 = 0x5D0;
 
+    unsigned int penalty = 0;
     for (int i = 0; i < qrcode_size; i++) {
-        for (int j = 0; j < qrcode_size - PENALY_PATTERN_SIZE; j++) {
-            bool give_penalty = true;
-            for (int p = 0; p < PENALY_PATTERN_SIZE; p++) {
-                if (qrcode[qrcode_size*(i) + j + p].value != penalty_pattern1[p]) {
-                    give_penalty = false;
-                    break;
-                }
-            }
-            if (give_penalty)
-                penalty += 40;
-
-            give_penalty = true;
-            for (int p = 0; p < PENALY_PATTERN_SIZE; p++) {
-                if (qrcode[qrcode_size*(i) + j + p].value != penalty_pattern2[p]) {
-                    give_penalty = false;
-                    break;
-                }
+        const uint64_t *row = plane + i*words_per_row;
+        uint64_t previous_runs = 0;
+        for (int w = 0; w < words_per_row; w++) {
+            uint64_t shifted[PENALTY_PATTERN_SIZE];
+            for (int p = 0; p < (finder_patterns ? PENALTY_PATTERN_SIZE : 5); p++)
+                shifted[p] = get_shifted_row_word(row, words_per_row, w, p);
+
+            /* Penalty 1: positions where 5 modules in a row have the same color; every run of length L gives L - 4 of them, plus 2 for its start */
+            uint64_t runs = ~(shifted[0] ^ shifted[1]) & ~(shifted[1] ^ shifted[2]) & ~(shifted[2] ^ shifted[3]) & ~(shifted[3] ^ shifted[4]);
+            runs &= get_positions_mask(w, qrcode_size - 4);
+            uint64_t run_starts = runs & ~((runs << 1) | (previous_runs >> (QRCODE_MATRIX_WORD_BITS - 1)));
+            penalty += count_bits(runs) + 2*count_bits(run_starts);
+            previous_runs = runs;
+            if (!finder_patterns)
+                continue;
+
+            /* Penalty 3: every pattern position is checked, the last possible one excluded */
+            uint64_t pattern1_matches = get_positions_mask(w, qrcode_size - PENALTY_PATTERN_SIZE);
+            uint64_t pattern2_matches = pattern1_matches;
+            for (int p = 0; p < PENALTY_PATTERN_SIZE; p++) {
+                pattern1_matches &= (penalty_pattern1 >> p) & 1 ? shifted[p] : ~shifted[p];
+                pattern2_matches &= (penalty_pattern2 >> p) & 1 ? shifted[p] : ~shifted[p];
             }
-            if (give_penalty)
-                penalty += 40;
+            penalty += 40*(count_bits(pattern1_matches) + count_bits(pattern2_matches));
         }
     }
-    for (int i = 0; i < qrcode_size - PENALY_PATTERN_SIZE; i++) {
-        for (int j = 0; j < qrcode_size; j++) {
-            bool give_penalty = true;
-            for (int p = 0; p < PENALY_PATTERN_SIZE; p++) {
-                if (qrcode[qrcode_size*(i + p) + j].value != penalty_pattern1[p]) {
-                    give_penalty = false;
-                    break;
-                }
-            }
-            if (give_penalty)
-                penalty += 40;
+    return penalty;
+}
 
-            give_penalty = true;
-            for (int p = 0; p < PENALY_PATTERN_SIZE; p++) {
-                if (qrcode[qrcode_size*(i + p) + j].value != penalty_pattern2[p]) {
-                    give_penalty = false;
-                    break;
-                }
-            }
-            if (give_penalty)
-                penalty += 40;
+/* Computes the penalty of the given qrcode, working on whole words (columns are evaluated as the rows of the transposed matrix).
+ * Without finder_patterns rule 3 is skipped, giving a cheaper estimate of the penalty */
+unsigned int compute_penalty(const qrcode_matrix_t *qrcode, bool finder_patterns) {
+    int qrcode_size = qrcode->size;
+    int words_per_row = qrcode->words_per_row;
+
+    /* Penalty 1 and 3: rows, then columns */
+    uint64_t transposed[QRCODE_MAX_SIZE * QRCODE_MATRIX_MAX_WORDS_PER_ROW];
+    transpose_matrix(qrcode, transposed);
+    unsigned int penalty = compute_rows_penalty(qrcode->value, qrcode_size, words_per_row, finder_patterns) + compute_rows_penalty(transposed, qrcode_size, words_per_row, finder_patterns);
+
+    /* Penaly 2: check for blocks of 4 squares */
+    for (int i = 0; i < qrcode_size - 1; i++) {
+        const uint64_t *row = qrcode->value + i*words_per_row;
+        const uint64_t *next_row = row + words_per_row;
+        for (int w = 0; w < words_per_row; w++) {
+            uint64_t same_right = ~(row[w] ^ get_shifted_row_word(row, words_per_row, w, 1));
+            uint64_t same_next_right = ~(next_row[w] ^ get_shifted_row_word(next_row, words_per_row, w, 1));
+            uint64_t blocks = same_right & same_next_right & ~(row[w] ^ next_row[w]) & get_positions_mask(w, qrcode_size - 1);
+            penalty += 3*count_bits(blocks);
         }
     }
 
     /* Penalty 4: based on the ratio between white and black cells */
     int black_counter = 0;
-    int white_counter = 0;
-    for (int i = 0; i < qrcode_size; i++) {
-        for (int j = 0; j < qrcode_size; j++) {
-            if (qrcode[qrcode_size*(i) + j].value == QRCODE_BLACK)
-                black_counter++;
-            else
-                white_counter++;
-        }
-    }
-    int black_ratio = floor(((double) black_counter / (black_counter + white_counter)) * 100);
+    for (int i = 0; i < qrcode_size*words_per_row; i++)
+        black_counter += count_bits(qrcode->value[i]);
+    int black_ratio = black_counter*100 / (qrcode_size*qrcode_size);
     int candidate1 = abs(black_ratio - (black_ratio % 5) - 50);
     int candidate2 = abs(black_ratio + (5 - (black_ratio % 5)) - 50);
     penalty += candidate1 < candidate2 ? candidate1*2 : candidate2*2;
@@ -841,345 +2055,1557 @@ unsigned int compute_qrcode_penalty(cell_t qrcode[], int version) {
     return penalty;
 }
 
-#define IMAGE_FACTOR 10
+/* Computes the penalty of the given qrcode (all four rules) */
+unsigned int compute_qrcode_penalty(const qrcode_matrix_t *qrcode) {
+    return compute_penalty(qrcode, true);
+}
 
-/* Prints the qrcode matrix to the preferred output type.
- * If the output is a file, specify the name in the 'output_file_name' variable (NULL if the output is not a file):
- * */
-void print_matrix(qrcode_t qrcode, enum OUTPUT_TYPE output_type, char *output_file_name) {
+/* Computes an estimate of the penalty of the given qrcode (rules 1, 2 and 4 only) */
+unsigned int compute_qrcode_approximate_penalty(const qrcode_matrix_t *qrcode) {
+    return compute_penalty(qrcode, false);
+}
 
-    switch (output_type) {
-        case TERMINAL:
-            /* Print the qrcode to terminal (the ratio of a character is usually h/w=2, so printing 2 characters should be enough to make it readable in general)*/
-            printf("\n");
-            for (int i = 0; i < qrcode.size; i++) {
-                for (int j = 0; j < qrcode.size; j++) {
-                    if (qrcode.data[i*qrcode.size + j] == QRCODE_WHITE)
-                        printf("██");
-                    else
-                        printf("░░");
-                }
-                printf("\n");
-            }
-            printf("\n");
-            break;
-        case FILE_PPM:
-            /* Print qrcode to ppm file */
-            ;
-            FILE *image = fopen(output_file_name, "wb");
-            fprintf(image, "P6\n");
-            fprintf(image, "%lu %lu\n", (qrcode.size)*IMAGE_FACTOR, (qrcode.size)*IMAGE_FACTOR);
-            fprintf(image, "255\n");
-            for (int i = 0; i < qrcode.size; i++) {
-                for (int g = 0; g < IMAGE_FACTOR; g++) {
-                    for (int j = 0; j < qrcode.size; j++) {
-                        for (int f = 0; f < IMAGE_FACTOR; f++) {
-                            if (qrcode.data[i*qrcode.size+j] == QRCODE_WHITE) {
-                                fprintf(image, "%c%c%c", 0xFF, 0xFF, 0xFF);
-                            } else {
-                                fprintf(image, "%c%c%c", 0x00, 0x00, 0x00);
-                            }
-                        }
-                    }
-                }
-            }
-            fclose(image);
-            break;
+/* All the mask candidates of a qrcode: every candidate has its own matrix, so they can be evaluated at the same time */
+typedef struct mask_evaluation {
+    const qrcode_matrix_t *unmasked_qrcode;
+    const version_template_t *version_template;
+    int correction_level;
+    bool is_approximate;
+    qrcode_matrix_t candidates[MASK_NUMBER];
+    unsigned int penalties[MASK_NUMBER];
+} mask_evaluation_t;
+
+/* Applies a mask to its own candidate matrix and computes its penalty (or its estimate) */
+void evaluate_mask(mask_evaluation_t *evaluation, int mask) {
+    apply_mask(&evaluation->candidates[mask], evaluation->unmasked_qrcode, evaluation->version_template, evaluation->correction_level, mask);
+    evaluation->penalties[mask] = evaluation->is_approximate ? compute_qrcode_approximate_penalty(&evaluation->candidates[mask]) : compute_qrcode_penalty(&evaluation->candidates[mask]);
+}
+
+#ifdef QRCODE_THREADS
+/* Pool of threads evaluating masks, started on first use and kept for the whole process.
+ * It works on one evaluation at a time: the caller takes masks too and waits until all of them are done. */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    int workers;
+    bool is_started;
+    mask_evaluation_t *evaluation; /* evaluation in progress (NULL if the pool is free) */
+    int next_mask;
+    int pending_masks;
+} mask_pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, false, NULL, 0, 0};
+
+void *mask_pool_worker(void *argument) {
+    (void) argument;
+    pthread_mutex_lock(&mask_pool.lock);
+    while (true) {
+        while (!mask_pool.evaluation || mask_pool.next_mask >= MASK_NUMBER)
+            pthread_cond_wait(&mask_pool.work, &mask_pool.lock);
+
+        mask_evaluation_t *evaluation = mask_pool.evaluation;
+        int mask = mask_pool.next_mask++;
+        pthread_mutex_unlock(&mask_pool.lock);
+        evaluate_mask(evaluation, mask);
+        pthread_mutex_lock(&mask_pool.lock);
+
+        if (--mask_pool.pending_masks == 0)
+            pthread_cond_signal(&mask_pool.done);
     }
+    return NULL;
 }
 
-/* Returns true if the qrcode is valid, else false */
-bool is_qrcode_valid(qrcode_t qrcode) {
-    return (qrcode.data) ? true : false;
+/* Evaluates all masks on the pool; returns false (nothing evaluated) if the pool is busy with another qrcode or has no threads */
+bool evaluate_masks_on_pool(mask_evaluation_t *evaluation) {
+    pthread_mutex_lock(&mask_pool.lock);
+    if (!mask_pool.is_started) {
+        mask_pool.is_started = true;
+        for (int i = 0; i < MASK_NUMBER - 1; i++) {
+            pthread_t thread;
+            if (pthread_create(&thread, NULL, mask_pool_worker, NULL) != 0)
+                break;
+            pthread_detach(thread);
+            mask_pool.workers++;
+        }
+    }
+    if (mask_pool.evaluation || mask_pool.workers == 0) {
+        pthread_mutex_unlock(&mask_pool.lock);
+        return false;
+    }
+
+    mask_pool.evaluation = evaluation;
+    mask_pool.next_mask = 0;
+    mask_pool.pending_masks = MASK_NUMBER;
+    pthread_cond_broadcast(&mask_pool.work);
+
+    /* Take masks like the workers, then wait for the ones still being evaluated */
+    while (mask_pool.next_mask < MASK_NUMBER) {
+        int mask = mask_pool.next_mask++;
+        pthread_mutex_unlock(&mask_pool.lock);
+        evaluate_mask(evaluation, mask);
+        pthread_mutex_lock(&mask_pool.lock);
+        mask_pool.pending_masks--;
+    }
+    while (mask_pool.pending_masks > 0)
+        pthread_cond_wait(&mask_pool.done, &mask_pool.lock);
+
+    mask_pool.evaluation = NULL;
+    pthread_mutex_unlock(&mask_pool.lock);
+    return true;
 }
+#endif
 
-/* Generates a QRCODE from the given template. */
-qrcode_t generate_qrcode(qrcode_template_t qrcode_template) {
-    /* Input check */
-    if (!qrcode_template.text) { fprintf(stderr, "QRCODE ERROR: Input error, text is NULL\n"); return QRCODE_INVALID; }
-    if (qrcode_template.version < VERSION_ANY || qrcode_template.version > QRCODE_VERSIONS) { fprintf(stderr, "QRCODE ERROR: Input error, invalid Version\n"); return QRCODE_INVALID; }
-    if (qrcode_template.mask < MASK_ANY || qrcode_template.mask >= MASK_NUMBER) { fprintf(stderr, "QRCODE ERROR: Input error, invalid Mask\n"); return QRCODE_INVALID; }
+/* Evaluates all masks, on the mask pool if requested (and available), otherwise one after the other */
+void evaluate_masks(mask_evaluation_t *evaluation, bool parallel) {
+#ifdef QRCODE_THREADS
+    if (parallel && evaluate_masks_on_pool(evaluation))
+        return;
+#else
+    (void) parallel;
+#endif
+    for (int mask = 0; mask < MASK_NUMBER; mask++)
+        evaluate_mask(evaluation, mask);
+}
 
-    /* Information */
-    if (qrcode_template.debug) {
-        printf("QRCODE INFO:\n");
-        if (qrcode_template.version == VERSION_ANY)
-            printf("VERSION: [ANY]\n");
-        else
-            printf("VERSION: [%d]\n", qrcode_template.version);
+/* Gets the value (QRCODE_WHITE or QRCODE_BLACK) of a module of the qrcode */
+unsigned char get_qrcode_module(qrcode_t qrcode, size_t row, size_t column) {
+    return (qrcode.data[row*qrcode.words_per_row + column / QRCODE_MATRIX_WORD_BITS] >> (column % QRCODE_MATRIX_WORD_BITS)) & 1;
+}
 
-        printf("CORRECTION LEVEL: [");
-        switch (qrcode_template.correction_level) {
-            case LOW:
-                printf("LOW");
-                break;
-            case MEDIUM:
-                printf("MEDIUM");
-                break;
-            case QUARTILE:
-                printf("QUARTILE");
-                break;
-            case HIGH:
-                printf("HIGH");
-                break;
+#define IMAGE_FACTOR 10
+#define IMAGE_MAX_FACTOR 100
+#define QUIET_ZONE_MAX_SIZE 100
+
+/* How print_matrix renders a qrcode */
+typedef struct qrcode_render_options {
+    /* side of a module in pixels (image outputs) [1-100] */
+    int scale;
+    /* modules of the same color as the background around the qrcode [0-100] */
+    int quiet_zone;
+    /* terminal output: set the colors with ANSI escapes, so the contrast doesn't depend on the terminal theme */
+    bool terminal_color;
+} qrcode_render_options_t;
+
+/* Default render options (same image as before they were added) */
+#define QRCODE_RENDER_OPTIONS_DEFAULT       \
+    (qrcode_render_options_t)               \
+    {                                       \
+        .scale = IMAGE_FACTOR,              \
+        .quiet_zone = QRCODE_PADDING,       \
+        .terminal_color = false,            \
+    }
+
+/* Side in modules of the rendered qrcode (the qrcode padding is replaced by the quiet zone) */
+size_t get_rendered_size(qrcode_t qrcode, int quiet_zone) {
+    return qrcode.size - 2*QRCODE_PADDING + 2*quiet_zone;
+}
+
+/* Gets a module of the rendered qrcode: outside the qrcode padding it has the padding color */
+int get_rendered_module(qrcode_t qrcode, int quiet_zone, size_t row, size_t column) {
+    long padded_row = (long) row - quiet_zone + QRCODE_PADDING;
+    long padded_column = (long) column - quiet_zone + QRCODE_PADDING;
+    if (padded_row < 0 || padded_column < 0 || padded_row >= (long) qrcode.size || padded_column >= (long) qrcode.size)
+        return get_qrcode_module(qrcode, 0, 0);
+    return get_qrcode_module(qrcode, padded_row, padded_column);
+}
+
+/* Packs the pixel row of a module row, 1 bit per pixel from the most significant one (rows padded to bytes): set bits are the black pixels, or the white ones if is_white_set */
+void get_packed_pixel_row(qrcode_t qrcode, qrcode_render_options_t options, size_t module_row, bool is_white_set, unsigned char scanline[]) {
+    size_t modules = get_rendered_size(qrcode, options.quiet_zone);
+    memset(scanline, 0, (modules*options.scale + BITS_PER_BYTE - 1) / BITS_PER_BYTE);
+    for (size_t j = 0; j < modules; j++) {
+        if ((get_rendered_module(qrcode, options.quiet_zone, module_row, j) == QRCODE_WHITE) != is_white_set)
+            continue;
+        for (size_t pixel = j*options.scale; pixel < (j + 1)*options.scale; pixel++)
+            scanline[pixel / BITS_PER_BYTE] |= 0x80 >> (pixel % BITS_PER_BYTE);
+    }
+}
+
+/* Writes the qrcode as a binary PPM (P6) or PBM (P4) image: every module row is turned into a scanline once, repeated scale times and written with a single fwrite */
+bool write_raster_image(qrcode_t qrcode, enum OUTPUT_TYPE output_type, qrcode_render_options_t options, FILE *image) {
+    size_t modules = get_rendered_size(qrcode, options.quiet_zone);
+    size_t width = modules * options.scale;
+    /* PPM: 3 bytes per pixel; PBM: 1 bit per pixel (1 = black), rows padded to bytes */
+    size_t scanline_bytes = output_type == FILE_PBM ? (width + BITS_PER_BYTE - 1) / BITS_PER_BYTE : width * 3;
+
+    unsigned char *block = malloc(scanline_bytes * options.scale);
+    if (!block) { fprintf(stderr, "QRCODE ERROR: Memory Error\n"); return false; }
+
+    fprintf(image, output_type == FILE_PBM ? "P4\n%zu %zu\n" : "P6\n%zu %zu\n255\n", width, width);
+    bool is_written = true;
+    for (size_t i = 0; i < modules && is_written; i++) {
+        if (output_type == FILE_PBM) {
+            get_packed_pixel_row(qrcode, options, i, false, block);
+        } else {
+            for (size_t j = 0; j < modules; j++)
+                memset(block + 3*j*options.scale, get_rendered_module(qrcode, options.quiet_zone, i, j) == QRCODE_WHITE ? 0xFF : 0x00, 3*options.scale);
         }
-        printf("]\n");
+        for (int g = 1; g < options.scale; g++)
+            memcpy(block + g*scanline_bytes, block, scanline_bytes);
+        is_written = fwrite(block, scanline_bytes, options.scale, image) == (size_t) options.scale;
+    }
 
-        if (qrcode_template.mask == MASK_ANY)
-            printf("MASK: [ANY]\n");
-        else
-            printf("MASK: [%d]\n", qrcode_template.mask);
+    free(block);
+    if (!is_written)
+        fprintf(stderr, "QRCODE ERROR: Can't write the image\n");
+    return is_written;
+}
 
-        printf("ENCODING: [");
-        switch (qrcode_template.encoding_mode) {
-            case NUMERIC:
-                printf("NUMERIC");
-                break;
-            case ALPHANUMERIC:
-                printf("ALPHANUMERIC");
-                break;
-            case BYTE:
-                printf("BYTE");
-                break;
-            case KANJI:
-                printf("KANJI");
-                break;
+/* Growable byte buffer, used to render qrcodes in memory */
+typedef struct byte_buffer {
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+    bool is_valid; /* false after a failed allocation (nothing more is appended) */
+} byte_buffer_t;
+
+#define BYTE_BUFFER_EMPTY (byte_buffer_t) {NULL, 0, 0, true}
+
+/* Makes room for 'bytes' more bytes; returns false if the buffer is not valid */
+bool byte_buffer_reserve(byte_buffer_t *buffer, size_t bytes) {
+    if (!buffer->is_valid)
+        return false;
+    if (buffer->size + bytes <= buffer->capacity)
+        return true;
+
+    size_t capacity = buffer->capacity ? buffer->capacity : 256;
+    while (capacity < buffer->size + bytes)
+        capacity *= 2;
+    unsigned char *data = realloc(buffer->data, capacity);
+    if (!data) {
+        buffer->is_valid = false;
+        return false;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return true;
+}
+
+void byte_buffer_append(byte_buffer_t *buffer, const void *data, size_t bytes) {
+    if (bytes == 0 || !byte_buffer_reserve(buffer, bytes))
+        return;
+    memcpy(buffer->data + buffer->size, data, bytes);
+    buffer->size += bytes;
+}
+
+void byte_buffer_append_byte(byte_buffer_t *buffer, unsigned char byte) {
+    byte_buffer_append(buffer, &byte, 1);
+}
+
+/* Appends formatted text (without the NULL terminator) */
+void byte_buffer_append_format(byte_buffer_t *buffer, const char *format, ...) {
+    /* Short text is formatted once on the stack */
+    char text[128];
+    va_list arguments;
+    va_start(arguments, format);
+    int length = vsnprintf(text, sizeof(text), format, arguments);
+    va_end(arguments);
+    if (length < 0)
+        return;
+    if ((size_t) length < sizeof(text)) {
+        byte_buffer_append(buffer, text, length);
+        return;
+    }
+
+    if (!byte_buffer_reserve(buffer, length + 1))
+        return;
+    va_start(arguments, format);
+    vsnprintf((char *) buffer->data + buffer->size, length + 1, format, arguments);
+    va_end(arguments);
+    buffer->size += length;
+}
+
+/* Appends a 32 bits number, most significant byte first */
+void byte_buffer_append_uint32(byte_buffer_t *buffer, uint32_t value) {
+    unsigned char bytes[4] = {value >> 24, value >> 16, value >> 8, value};
+    byte_buffer_append(buffer, bytes, sizeof(bytes));
+}
+
+/* CRC-32 (polynomial 0xEDB88320) of every byte value, for PNG chunks */
+const uint32_t PNG_CRC_TABLE[256] = {
+    0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA, 0x076DC419, 0x706AF48F, 0xE963A535, 0x9E6495A3,
+    0x0EDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988, 0x09B64C2B, 0x7EB17CBD, 0xE7B82D07, 0x90BF1D91,
+    0x1DB71064, 0x6AB020F2, 0xF3B97148, 0x84BE41DE, 0x1ADAD47D, 0x6DDDE4EB, 0xF4D4B551, 0x83D385C7,
+    0x136C9856, 0x646BA8C0, 0xFD62F97A, 0x8A65C9EC, 0x14015C4F, 0x63066CD9, 0xFA0F3D63, 0x8D080DF5,
+    0x3B6E20C8, 0x4C69105E, 0xD56041E4, 0xA2677172, 0x3C03E4D1, 0x4B04D447, 0xD20D85FD, 0xA50AB56B,
+    0x35B5A8FA, 0x42B2986C, 0xDBBBC9D6, 0xACBCF940, 0x32D86CE3, 0x45DF5C75, 0xDCD60DCF, 0xABD13D59,
+    0x26D930AC, 0x51DE003A, 0xC8D75180, 0xBFD06116, 0x21B4F4B5, 0x56B3C423, 0xCFBA9599, 0xB8BDA50F,
+    0x2802B89E, 0x5F058808, 0xC60CD9B2, 0xB10BE924, 0x2F6F7C87, 0x58684C11, 0xC1611DAB, 0xB6662D3D,
+    0x76DC4190, 0x01DB7106, 0x98D220BC, 0xEFD5102A, 0x71B18589, 0x06B6B51F, 0x9FBFE4A5, 0xE8B8D433,
+    0x7807C9A2, 0x0F00F934, 0x9609A88E, 0xE10E9818, 0x7F6A0DBB, 0x086D3D2D, 0x91646C97, 0xE6635C01,
+    0x6B6B51F4, 0x1C6C6162, 0x856530D8, 0xF262004E, 0x6C0695ED, 0x1B01A57B, 0x8208F4C1, 0xF50FC457,
+    0x65B0D9C6, 0x12B7E950, 0x8BBEB8EA, 0xFCB9887C, 0x62DD1DDF, 0x15DA2D49, 0x8CD37CF3, 0xFBD44C65,
+    0x4DB26158, 0x3AB551CE, 0xA3BC0074, 0xD4BB30E2, 0x4ADFA541, 0x3DD895D7, 0xA4D1C46D, 0xD3D6F4FB,
+    0x4369E96A, 0x346ED9FC, 0xAD678846, 0xDA60B8D0, 0x44042D73, 0x33031DE5, 0xAA0A4C5F, 0xDD0D7CC9,
+    0x5005713C, 0x270241AA, 0xBE0B1010, 0xC90C2086, 0x5768B525, 0x206F85B3, 0xB966D409, 0xCE61E49F,
+    0x5EDEF90E, 0x29D9C998, 0xB0D09822, 0xC7D7A8B4, 0x59B33D17, 0x2EB40D81, 0xB7BD5C3B, 0xC0BA6CAD,
+    0xEDB88320, 0x9ABFB3B6, 0x03B6E20C, 0x74B1D29A, 0xEAD54739, 0x9DD277AF, 0x04DB2615, 0x73DC1683,
+    0xE3630B12, 0x94643B84, 0x0D6D6A3E, 0x7A6A5AA8, 0xE40ECF0B, 0x9309FF9D, 0x0A00AE27, 0x7D079EB1,
+    0xF00F9344, 0x8708A3D2, 0x1E01F268, 0x6906C2FE, 0xF762575D, 0x806567CB, 0x196C3671, 0x6E6B06E7,
+    0xFED41B76, 0x89D32BE0, 0x10DA7A5A, 0x67DD4ACC, 0xF9B9DF6F, 0x8EBEEFF9, 0x17B7BE43, 0x60B08ED5,
+    0xD6D6A3E8, 0xA1D1937E, 0x38D8C2C4, 0x4FDFF252, 0xD1BB67F1, 0xA6BC5767, 0x3FB506DD, 0x48B2364B,
+    0xD80D2BDA, 0xAF0A1B4C, 0x36034AF6, 0x41047A60, 0xDF60EFC3, 0xA867DF55, 0x316E8EEF, 0x4669BE79,
+    0xCB61B38C, 0xBC66831A, 0x256FD2A0, 0x5268E236, 0xCC0C7795, 0xBB0B4703, 0x220216B9, 0x5505262F,
+    0xC5BA3BBE, 0xB2BD0B28, 0x2BB45A92, 0x5CB36A04, 0xC2D7FFA7, 0xB5D0CF31, 0x2CD99E8B, 0x5BDEAE1D,
+    0x9B64C2B0, 0xEC63F226, 0x756AA39C, 0x026D930A, 0x9C0906A9, 0xEB0E363F, 0x72076785, 0x05005713,
+    0x95BF4A82, 0xE2B87A14, 0x7BB12BAE, 0x0CB61B38, 0x92D28E9B, 0xE5D5BE0D, 0x7CDCEFB7, 0x0BDBDF21,
+    0x86D3D2D4, 0xF1D4E242, 0x68DDB3F8, 0x1FDA836E, 0x81BE16CD, 0xF6B9265B, 0x6FB077E1, 0x18B74777,
+    0x88085AE6, 0xFF0F6A70, 0x66063BCA, 0x11010B5C, 0x8F659EFF, 0xF862AE69, 0x616BFFD3, 0x166CCF45,
+    0xA00AE278, 0xD70DD2EE, 0x4E048354, 0x3903B3C2, 0xA7672661, 0xD06016F7, 0x4969474D, 0x3E6E77DB,
+    0xAED16A4A, 0xD9D65ADC, 0x40DF0B66, 0x37D83BF0, 0xA9BCAE53, 0xDEBB9EC5, 0x47B2CF7F, 0x30B5FFE9,
+    0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6, 0xBAD03605, 0xCDD70693, 0x54DE5729, 0x23D967BF,
+    0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94, 0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D
+};
+
+/* Updates a PNG CRC (start from 0xFFFFFFFF and invert the final value) */
+uint32_t get_png_crc(uint32_t crc, const unsigned char data[], size_t size) {
+    for (size_t i = 0; i < size; i++)
+        crc = PNG_CRC_TABLE[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+/* Adler-32 checksum of a zlib stream (the modulo is taken only every 5552 bytes, the most that can't overflow) */
+uint32_t get_adler32(const unsigned char data[], size_t size) {
+    const uint32_t ADLER_MODULO = 65521;
+    const size_t ADLER_MAX_RUN = 5552;
+    uint32_t a = 1, b = 0;
+    while (size > 0) {
+        size_t run = size < ADLER_MAX_RUN ? size : ADLER_MAX_RUN;
+        size -= run;
+        for (; run > 0; run--) {
+            a += *data++;
+            b += a;
         }
-        printf("]\n");
+        a %= ADLER_MODULO;
+        b %= ADLER_MODULO;
+    }
+    return (b << 16) | a;
+}
 
-        printf("NEGATIVE MODE: [%s]\n", qrcode_template.negative ? "ENABLED" : "DISABLED");
+/* Deflate lengths and distances: base value and extra bits of every code */
+#define DEFLATE_LENGTH_CODES 29
+#define DEFLATE_DISTANCE_CODES 30
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+#define DEFLATE_MAX_DISTANCE 32768
+const unsigned short DEFLATE_LENGTH_BASE[DEFLATE_LENGTH_CODES] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const unsigned char DEFLATE_LENGTH_EXTRA_BITS[DEFLATE_LENGTH_CODES] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const unsigned short DEFLATE_DISTANCE_BASE[DEFLATE_DISTANCE_CODES] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+const unsigned char DEFLATE_DISTANCE_EXTRA_BITS[DEFLATE_DISTANCE_CODES] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+/* Deflate bit stream: bits are packed from the least significant one */
+typedef struct deflate_stream {
+    byte_buffer_t *buffer;
+    uint32_t bits;
+    int bits_number;
+} deflate_stream_t;
+
+void deflate_append_bits(deflate_stream_t *stream, uint32_t value, int bits) {
+    stream->bits |= value << stream->bits_number;
+    stream->bits_number += bits;
+    while (stream->bits_number >= BITS_PER_BYTE) {
+        byte_buffer_append_byte(stream->buffer, stream->bits & 0xFF);
+        stream->bits >>= BITS_PER_BYTE;
+        stream->bits_number -= BITS_PER_BYTE;
+    }
+}
 
-        printf("ISO MODE: [%s]\n", qrcode_template.iso ? "ENABLED" : "DISABLED");
-        printf("\n");
+/* Appends a literal/length symbol with the fixed Huffman code (Huffman codes go from their most significant bit) */
+void deflate_append_symbol(deflate_stream_t *stream, int symbol) {
+    unsigned int code;
+    int bits;
+    if (symbol < 144) {
+        code = 0x30 + symbol;
+        bits = 8;
+    } else if (symbol < 256) {
+        code = 0x190 + symbol - 144;
+        bits = 9;
+    } else if (symbol < 280) {
+        code = symbol - 256;
+        bits = 7;
+    } else {
+        code = 0xC0 + symbol - 280;
+        bits = 8;
     }
+    unsigned int reversed = 0;
+    for (int i = 0; i < bits; i++)
+        reversed |= ((code >> i) & 1) << (bits - 1 - i);
+    deflate_append_bits(stream, reversed, bits);
+}
 
-    /* Pointer to the input */
-    char *input = qrcode_template.text;
+/* Appends a match of 'length' bytes at 'distance' bytes back */
+void deflate_append_match(deflate_stream_t *stream, int length, int distance) {
+    int code = DEFLATE_LENGTH_CODES - 1;
+    while (DEFLATE_LENGTH_BASE[code] > length)
+        code--;
+    deflate_append_symbol(stream, 257 + code);
+    deflate_append_bits(stream, length - DEFLATE_LENGTH_BASE[code], DEFLATE_LENGTH_EXTRA_BITS[code]);
+
+    code = DEFLATE_DISTANCE_CODES - 1;
+    while (DEFLATE_DISTANCE_BASE[code] > distance)
+        code--;
+    unsigned int reversed = 0;
+    for (int i = 0; i < 5; i++)
+        reversed |= ((code >> i) & 1) << (4 - i);
+    deflate_append_bits(stream, reversed, 5);
+    deflate_append_bits(stream, distance - DEFLATE_DISTANCE_BASE[code], DEFLATE_DISTANCE_EXTRA_BITS[code]);
+}
 
-    /* Input length and bytes */
-    size_t input_length_bytes = strlen(qrcode_template.text);
-    /* NOTE: Even if in UTF-8 some characters take more than 1 byte, the number of characters is assumed to be the same as the number of bytes (for legacy reasons) */
-    size_t input_length_characters = input_length_bytes;
+/* Length of the match at 'distance' bytes back (0 if there is no such byte), up to the deflate maximum */
+int get_deflate_match_length(const unsigned char data[], size_t size, size_t position, size_t distance) {
+    if (distance == 0 || distance > position || distance > DEFLATE_MAX_DISTANCE)
+        return 0;
+    size_t length = 0;
+    while (length < DEFLATE_MAX_MATCH && position + length < size && data[position + length] == data[position + length - distance])
+        length++;
+    return length;
+}
+
+/* Matches are also searched among the previous positions with the same 3 bytes (hash chains, at most DEFLATE_MAX_CHAIN of them) */
+#define DEFLATE_HASH_BITS 15
+#define DEFLATE_MAX_CHAIN 32
+
+uint32_t get_deflate_hash(const unsigned char data[]) {
+    return ((data[0] << 16 | data[1] << 8 | data[2]) * 2654435761U) >> (32 - DEFLATE_HASH_BITS);
+}
+
+/* Compresses data as a zlib stream of a single fixed Huffman block; returns false if memory can't be allocated.
+ * Images have rows of 'row_size' bytes: the previous row (repeated scanlines) and the previous byte (runs of pixels) are tried first, then the hash chains */
+bool deflate_image(byte_buffer_t *destination, const unsigned char data[], size_t size, size_t row_size) {
+    /* Last position of every hash and previous position with the same hash of every window position (-1 = none) */
+    int32_t *hash_heads = malloc(sizeof(int32_t) << DEFLATE_HASH_BITS);
+    int32_t *previous_positions = malloc(sizeof(int32_t) * DEFLATE_MAX_DISTANCE);
+    if (!hash_heads || !previous_positions) {
+        fprintf(stderr, "QRCODE ERROR: Memory Error\n");
+        free(hash_heads);
+        free(previous_positions);
+        return false;
+    }
+    memset(hash_heads, 0xFF, sizeof(int32_t) << DEFLATE_HASH_BITS);
+
+    /* zlib header: deflate with 32K window, no dictionary */
+    byte_buffer_append_byte(destination, 0x78);
+    byte_buffer_append_byte(destination, 0x01);
+
+    deflate_stream_t stream = {destination, 0, 0};
+    /* Last block, fixed Huffman codes */
+    deflate_append_bits(&stream, 1, 1);
+    deflate_append_bits(&stream, 1, 2);
+
+    size_t inserted = 0;
+    for (size_t position = 0; position < size;) {
+        int length = get_deflate_match_length(data, size, position, row_size);
+        size_t distance = row_size;
+        int run_length = get_deflate_match_length(data, size, position, 1);
+        if (run_length > length) {
+            length = run_length;
+            distance = 1;
+        }
+        if (length < DEFLATE_MAX_MATCH && position + DEFLATE_MIN_MATCH <= size) {
+            int32_t candidate = hash_heads[get_deflate_hash(data + position)];
+            for (int chain = 0; chain < DEFLATE_MAX_CHAIN && candidate >= 0 && position - candidate <= DEFLATE_MAX_DISTANCE; chain++) {
+                int candidate_length = get_deflate_match_length(data, size, position, position - candidate);
+                if (candidate_length > length) {
+                    length = candidate_length;
+                    distance = position - candidate;
+                }
+                candidate = previous_positions[candidate % DEFLATE_MAX_DISTANCE];
+            }
+        }
+
+        size_t next_position = position + (length >= DEFLATE_MIN_MATCH ? length : 1);
+        if (length >= DEFLATE_MIN_MATCH)
+            deflate_append_match(&stream, length, distance);
+        else
+            deflate_append_symbol(&stream, data[position]);
+
+        /* Every position covered gets in its hash chain */
+        for (; inserted < next_position && inserted + DEFLATE_MIN_MATCH <= size; inserted++) {
+            uint32_t hash = get_deflate_hash(data + inserted);
+            previous_positions[inserted % DEFLATE_MAX_DISTANCE] = hash_heads[hash];
+            hash_heads[hash] = inserted;
+        }
+        position = next_position;
+    }
+    deflate_append_symbol(&stream, 256);
+    if (stream.bits_number > 0)
+        deflate_append_bits(&stream, 0, BITS_PER_BYTE - stream.bits_number);
+
+    byte_buffer_append_uint32(destination, get_adler32(data, size));
+    free(hash_heads);
+    free(previous_positions);
+    return true;
+}
+
+/* Appends a PNG chunk (length, type, data, CRC of type and data) */
+void append_png_chunk(byte_buffer_t *buffer, const char type[4], const unsigned char data[], size_t size) {
+    byte_buffer_append_uint32(buffer, size);
+    byte_buffer_append(buffer, type, 4);
+    byte_buffer_append(buffer, data, size);
+    uint32_t crc = get_png_crc(0xFFFFFFFF, (const unsigned char *) type, 4);
+    byte_buffer_append_uint32(buffer, ~get_png_crc(crc, data, size));
+}
+
+/* Renders the qrcode as a 1 bit grayscale PNG in memory: *destination is allocated (free it) and holds *destination_size bytes.
+ * Returns false if the options are not valid or memory can't be allocated */
+bool render_png(qrcode_t qrcode, qrcode_render_options_t options, unsigned char **destination, size_t *destination_size) {
+    if (options.scale < 1 || options.scale > IMAGE_MAX_FACTOR) { fprintf(stderr, "QRCODE ERROR: Input error, invalid scale\n"); return false; }
+    if (options.quiet_zone < 0 || options.quiet_zone > QUIET_ZONE_MAX_SIZE) { fprintf(stderr, "QRCODE ERROR: Input error, invalid quiet zone\n"); return false; }
+
+    size_t modules = get_rendered_size(qrcode, options.quiet_zone);
+    size_t width = modules * options.scale;
+    /* Every scanline is its filter type (0, none) followed by the pixels (1 = white) */
+    size_t row_size = 1 + (width + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+    unsigned char *image = malloc(row_size * width);
+    if (!image) { fprintf(stderr, "QRCODE ERROR: Memory Error\n"); return false; }
+
+    for (size_t i = 0; i < modules; i++) {
+        unsigned char *row = image + i*options.scale*row_size;
+        row[0] = 0;
+        get_packed_pixel_row(qrcode, options, i, true, row + 1);
+        for (int g = 1; g < options.scale; g++)
+            memcpy(row + g*row_size, row, row_size);
+    }
 
-    /* If the encoding is different, convert it */
-    bool is_input_converted = false;
-    if (qrcode_template.encoding_mode == KANJI) {
-        size_t input_length_bytes_converted = get_input_length_bytes_converted(qrcode_template.text, input_length_bytes, "SHIFT-JIS");
-        input = malloc(sizeof(char) * input_length_bytes_converted);
-        if (!input) { fprintf(stderr, "QRCODE ERROR: Memory Error\n"); return QRCODE_INVALID; }
+    const unsigned char PNG_SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    /* Width, height, bit depth 1, grayscale, deflate, adaptive filters, no interlace */
+    unsigned char header[13] = {width >> 24, width >> 16, width >> 8, width, width >> 24, width >> 16, width >> 8, width, 1, 0, 0, 0, 0};
+
+    byte_buffer_t png = BYTE_BUFFER_EMPTY;
+    byte_buffer_t compressed = BYTE_BUFFER_EMPTY;
+    bool is_compressed = deflate_image(&compressed, image, row_size * width, row_size);
+    free(image);
+    if (!is_compressed)
+        return false;
+
+    byte_buffer_append(&png, PNG_SIGNATURE, sizeof(PNG_SIGNATURE));
+    append_png_chunk(&png, "IHDR", header, sizeof(header));
+    append_png_chunk(&png, "IDAT", compressed.data, compressed.size);
+    append_png_chunk(&png, "IEND", NULL, 0);
+    free(compressed.data);
+
+    if (!png.is_valid || !compressed.is_valid) {
+        fprintf(stderr, "QRCODE ERROR: Memory Error\n");
+        free(png.data);
+        return false;
+    }
+    *destination = png.data;
+    *destination_size = png.size;
+    return true;
+}
 
-        convert_input(qrcode_template.text, input, input_length_bytes, input_length_bytes_converted, "SHIFT-JIS");
+/* Writes a non negative number in decimal; returns the characters written */
+int write_decimal(char destination[], unsigned int number) {
+    char digits[10];
+    int digits_number = 0;
+    do {
+        digits[digits_number++] = '0' + number % 10;
+        number /= 10;
+    } while (number > 0);
+    for (int i = 0; i < digits_number; i++)
+        destination[i] = digits[digits_number - 1 - i];
+    return digits_number;
+}
 
-        input_length_bytes = input_length_bytes_converted;
-        input_length_characters = input_length_bytes / 2; /* NOTE: Every char in SJIS is 2 bytes long */
-        is_input_converted = true;
+/* Appends a path shape "M{x} {y}h{width}v{height}h-{width}z" (formatted by hand, as there is one for every run of modules) */
+void append_svg_shape(byte_buffer_t *buffer, int x, int y, int width, int height) {
+    char shape[64];
+    int length = 0;
+    shape[length++] = 'M';
+    length += write_decimal(shape + length, x);
+    shape[length++] = ' ';
+    length += write_decimal(shape + length, y);
+    shape[length++] = 'h';
+    length += write_decimal(shape + length, width);
+    shape[length++] = 'v';
+    length += write_decimal(shape + length, height);
+    shape[length++] = 'h';
+    shape[length++] = '-';
+    length += write_decimal(shape + length, width);
+    shape[length++] = 'z';
+    byte_buffer_append(buffer, shape, length);
+}
 
-    } else if (qrcode_template.encoding_mode == BYTE && qrcode_template.iso == true) {
-        size_t input_length_bytes_converted = get_input_length_bytes_converted(qrcode_template.text, input_length_bytes, "ISO-8859-1");
-        input = malloc(sizeof(char) * input_length_bytes_converted);
-        if (!input) { fprintf(stderr, "QRCODE ERROR: Memory Error\n"); return QRCODE_INVALID; }
+/* Renders the qrcode as SVG text in memory: *destination is allocated (free it) and holds *destination_size bytes (not NULL terminated).
+ * The background (and the quiet zone) is a single rectangle of the padding color, the other modules are one path: runs of modules in a row are one shape,
+ * made taller while the next rows have the same run. Returns false if the options are not valid or memory can't be allocated */
+bool render_svg(qrcode_t qrcode, qrcode_render_options_t options, unsigned char **destination, size_t *destination_size) {
+    if (options.scale < 1 || options.scale > IMAGE_MAX_FACTOR) { fprintf(stderr, "QRCODE ERROR: Input error, invalid scale\n"); return false; }
+    if (options.quiet_zone < 0 || options.quiet_zone > QUIET_ZONE_MAX_SIZE) { fprintf(stderr, "QRCODE ERROR: Input error, invalid quiet zone\n"); return false; }
+
+    int qrcode_size = qrcode.size - 2*QRCODE_PADDING;
+    size_t modules = get_rendered_size(qrcode, options.quiet_zone);
+    /* With negative colors the padding is black */
+    int background = get_qrcode_module(qrcode, 0, 0);
+
+    /* Runs already drawn as part of a taller shape, by their first module */
+    bool *is_drawn = calloc(qrcode_size * qrcode_size, sizeof(bool));
+    if (!is_drawn) { fprintf(stderr, "QRCODE ERROR: Memory Error\n"); return false; }
+
+    byte_buffer_t svg = BYTE_BUFFER_EMPTY;
+    /* The view box starts at the corner of the quiet zone, so the shapes keep the coordinates of the modules in the symbol */
+    byte_buffer_append_format(&svg, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%zu\" height=\"%zu\" viewBox=\"%d %d %zu %zu\" shape-rendering=\"crispEdges\">"
+            "<rect x=\"%d\" y=\"%d\" width=\"%zu\" height=\"%zu\" fill=\"%s\"/><path fill=\"%s\" d=\"",
+            modules*options.scale, modules*options.scale, -options.quiet_zone, -options.quiet_zone, modules, modules,
+            -options.quiet_zone, -options.quiet_zone, modules, modules,
+            background == QRCODE_WHITE ? "#fff" : "#000", background == QRCODE_WHITE ? "#000" : "#fff");
 
-        convert_input(qrcode_template.text, input, input_length_bytes, input_length_bytes_converted, "ISO-8859-1");
+    for (int i = 0; i < qrcode_size; i++) {
+        for (int j = 0; j < qrcode_size;) {
+            if (get_qrcode_module(qrcode, i + QRCODE_PADDING, j + QRCODE_PADDING) == background) {
+                j++;
+                continue;
+            }
+            int length = 1;
+            while (j + length < qrcode_size && get_qrcode_module(qrcode, i + QRCODE_PADDING, j + length + QRCODE_PADDING) != background)
+                length++;
+
+            if (!is_drawn[i*qrcode_size + j]) {
+                /* The shape gets taller while the next row has exactly the same run */
+                int height = 1;
+                while (i + height < qrcode_size) {
+                    int row = i + height + QRCODE_PADDING;
+                    bool is_same_run = (j == 0 || get_qrcode_module(qrcode, row, j - 1 + QRCODE_PADDING) == background) &&
+                        (j + length == qrcode_size || get_qrcode_module(qrcode, row, j + length + QRCODE_PADDING) == background);
+                    for (int k = 0; k < length && is_same_run; k++)
+                        is_same_run = get_qrcode_module(qrcode, row, j + k + QRCODE_PADDING) != background;
+                    if (!is_same_run)
+                        break;
+                    is_drawn[(i + height)*qrcode_size + j] = true;
+                    height++;
+                }
+                append_svg_shape(&svg, j, i, length, height);
+            }
+            j += length;
+        }
+    }
+    byte_buffer_append_format(&svg, "\"/></svg>\n");
+    free(is_drawn);
 
-        input_length_bytes = input_length_bytes_converted;
-        input_length_characters = input_length_bytes; /* NOTE: Every char in ISO is 1 byte long */
-        is_input_converted = true;
+    if (!svg.is_valid) {
+        fprintf(stderr, "QRCODE ERROR: Memory Error\n");
+        free(svg.data);
+        return false;
     }
+    *destination = svg.data;
+    *destination_size = svg.size;
+    return true;
+}
 
-    /* If not manually selected, choose best version for qrcode */
-    if (qrcode_template.version == VERSION_ANY) {
-        qrcode_template.version++;
-        while (QRCODE_INFO[qrcode_template.version].correction_level_info[qrcode_template.correction_level].character_capacity[qrcode_template.encoding_mode] < input_length_characters &&
-                qrcode_template.version < QRCODE_VERSIONS) {
-            qrcode_template.version++;
+/* Renders the qrcode as terminal text in memory: *destination is allocated (free it) and holds *destination_size bytes (not NULL terminated).
+ * Every character is one module wide and two modules tall, using half block glyphs for the white modules (drawn in the terminal foreground color,
+ * white on black with terminal_color). Returns false if the options are not valid or memory can't be allocated */
+bool render_terminal(qrcode_t qrcode, qrcode_render_options_t options, unsigned char **destination, size_t *destination_size) {
+    if (options.quiet_zone < 0 || options.quiet_zone > QUIET_ZONE_MAX_SIZE) { fprintf(stderr, "QRCODE ERROR: Input error, invalid quiet zone\n"); return false; }
+
+    /* Glyph of every pair of modules: top white (bit 1), bottom white (bit 0) */
+    const char *HALF_BLOCKS[4] = {" ", "▄", "▀", "█"};
+    const char *COLOR_START = "\x1b[97;40m";
+    const char *COLOR_END = "\x1b[0m";
+
+    size_t modules = get_rendered_size(qrcode, options.quiet_zone);
+    byte_buffer_t text = BYTE_BUFFER_EMPTY;
+    /* Glyphs take up to 3 bytes (UTF-8), plus the colors and the new line of every text row */
+    byte_buffer_reserve(&text, 2 + (modules + 1) / 2 * (3*modules + strlen(COLOR_START) + strlen(COLOR_END) + 1));
+
+    byte_buffer_append_byte(&text, '\n');
+    for (size_t i = 0; i < modules; i += 2) {
+        if (options.terminal_color)
+            byte_buffer_append(&text, COLOR_START, strlen(COLOR_START));
+        for (size_t j = 0; j < modules; j++) {
+            /* After the last row the modules have the quiet zone color */
+            int top = get_rendered_module(qrcode, options.quiet_zone, i, j) == QRCODE_WHITE;
+            int bottom = get_rendered_module(qrcode, options.quiet_zone, i + 1, j) == QRCODE_WHITE;
+            const char *glyph = HALF_BLOCKS[top << 1 | bottom];
+            byte_buffer_append(&text, glyph, strlen(glyph));
         }
-        if (qrcode_template.debug)
-            printf("Selecting Version from text size:\nSelected Version [%d]\n\n", qrcode_template.version);
+        if (options.terminal_color)
+            byte_buffer_append(&text, COLOR_END, strlen(COLOR_END));
+        byte_buffer_append_byte(&text, '\n');
     }
+    byte_buffer_append_byte(&text, '\n');
 
-    /* If input is too large, abort */
-    if (QRCODE_INFO[qrcode_template.version].correction_level_info[qrcode_template.correction_level].character_capacity[qrcode_template.encoding_mode] < input_length_characters) {
-        fprintf(stderr, "QRCODE ERROR: Input too large: [%lu] (more than %lu bytes). Can't generate code...\n",
-                input_length_characters, QRCODE_INFO[qrcode_template.version].correction_level_info[qrcode_template.correction_level].character_capacity[qrcode_template.encoding_mode]);
-        return QRCODE_INVALID;
+    if (!text.is_valid) {
+        fprintf(stderr, "QRCODE ERROR: Memory Error\n");
+        free(text.data);
+        return false;
     }
+    *destination = text.data;
+    *destination_size = text.size;
+    return true;
+}
 
-    /* Sizes */
-    size_t qrcode_size = get_qrcode_size(qrcode_template.version);
-    size_t padded_qrcode_size = get_qrcode_size_with_padding(qrcode_template.version);
+/* Writes a rendered image to a file; returns false if it can't be written */
+bool write_rendered_file(const unsigned char data[], size_t size, const char *output_file_name) {
+    FILE *file = fopen(output_file_name, "wb");
+    if (!file) { fprintf(stderr, "QRCODE ERROR: Can't open output file %s\n", output_file_name ? output_file_name : "(NULL)"); return false; }
+    bool is_written = fwrite(data, 1, size, file) == size;
+    is_written &= fclose(file) == 0;
+    if (!is_written)
+        fprintf(stderr, "QRCODE ERROR: Can't write the image\n");
+    return is_written;
+}
+
+/* Prints the qrcode matrix to the preferred output type with the given render options.
+ * If the output is a file, specify the name in the 'output_file_name' variable (NULL if the output is not a file).
+ * Returns false if the options are not valid or the output can't be written */
+bool print_matrix_with_options(qrcode_t qrcode, enum OUTPUT_TYPE output_type, const char *output_file_name, qrcode_render_options_t options) {
+    if (options.scale < 1 || options.scale > IMAGE_MAX_FACTOR) { fprintf(stderr, "QRCODE ERROR: Input error, invalid scale\n"); return false; }
+    if (options.quiet_zone < 0 || options.quiet_zone > QUIET_ZONE_MAX_SIZE) { fprintf(stderr, "QRCODE ERROR: Input error, invalid quiet zone\n"); return false; }
+
+    switch (output_type) {
+        case TERMINAL:
+            /* Print the qrcode to terminal: the whole text is built first, then written at once */
+            ;
+            unsigned char *text;
+            size_t text_size;
+            if (!render_terminal(qrcode, options, &text, &text_size))
+                return false;
+            fflush(stdout);
+            bool is_text_written = fwrite(text, 1, text_size, stdout) == text_size;
+            is_text_written &= fflush(stdout) == 0;
+            free(text);
+            return is_text_written;
+        case FILE_PPM:
+        case FILE_PBM:
+            /* Print qrcode to ppm or pbm file */
+            ;
+            FILE *image = fopen(output_file_name, "wb");
+            if (!image) { fprintf(stderr, "QRCODE ERROR: Can't open output file %s\n", output_file_name ? output_file_name : "(NULL)"); return false; }
+            bool is_written = write_raster_image(qrcode, output_type, options, image);
+            if (fclose(image) != 0 && is_written) {
+                fprintf(stderr, "QRCODE ERROR: Can't write the image\n");
+                is_written = false;
+            }
+            return is_written;
+        case FILE_PNG:
+        case FILE_SVG:
+            /* Render the png or svg in memory, then write it */
+            ;
+            unsigned char *rendered;
+            size_t rendered_size;
+            if (!(output_type == FILE_PNG ? render_png : render_svg)(qrcode, options, &rendered, &rendered_size))
+                return false;
+            bool is_rendered_written = write_rendered_file(rendered, rendered_size, output_file_name);
+            free(rendered);
+            return is_rendered_written;
+    }
+    return false;
+}
+
+/* Prints the qrcode matrix to the preferred output type (default render options).
+ * If the output is a file, specify the name in the 'output_file_name' variable (NULL if the output is not a file):
+ * */
+bool print_matrix(qrcode_t qrcode, enum OUTPUT_TYPE output_type, const char *output_file_name) {
+    return print_matrix_with_options(qrcode, output_type, output_file_name, QRCODE_RENDER_OPTIONS_DEFAULT);
+}
+
+/* Returns true if the qrcode is valid, else false */
+bool is_qrcode_valid(qrcode_t qrcode) {
+    return (qrcode.data) ? true : false;
+}
+
+/* The sizes of the character count indicators only change between these bands of versions */
+#define VERSION_BANDS 3
+const unsigned int VERSION_BAND_FIRST_VERSION[VERSION_BANDS + 1] = {1, 10, 27, QRCODE_VERSIONS + 1};
+
+/* Data capacity in bits of a version with the given correction level */
+size_t get_data_capacity_bits(unsigned int version, enum CORRECTION_LEVEL correction_level) {
+    return (size_t) QRCODE_INFO[version].correction_level_info[correction_level].total_codewords * BITS_PER_BYTE;
+}
+
+/* Exact number of bits of a segment (header included) in the given version; SIZE_MAX if it has too many characters for its count indicator.
+ * characters is the number of bytes in Byte mode. */
+size_t get_segment_bits(enum ENCODING_MODE encoding_mode, size_t characters, unsigned int version) {
+    int count_size = QRCODE_INFO[version].character_count_indicator_size[encoding_mode];
+    if (characters >> count_size)
+        return SIZE_MAX;
+
+    size_t bits = MODE_INDICATOR_SIZE + count_size;
+    switch (encoding_mode) {
+        case NUMERIC:
+            bits += characters / 3 * NUMERIC_3_CHARACTER_SIZE + (characters % 3 == 2 ? NUMERIC_2_CHARACTER_SIZE : (characters % 3 == 1 ? NUMERIC_1_CHARACTER_SIZE : 0));
+            break;
+        case ALPHANUMERIC:
+            bits += characters / 2 * ALPHANUMERIC_2_CHARACTER_SIZE + (characters % 2) * ALPHANUMERIC_1_CHARACTER_SIZE;
+            break;
+        case BYTE:
+            bits += characters * BITS_PER_BYTE;
+            break;
+        case KANJI:
+            bits += characters * KANJI_CHARACTER_SIZE;
+            break;
+        default:
+            return SIZE_MAX;
+    }
+    return bits;
+}
+
+/* Number of bits of the text in a version of a band (the same for all the versions of the band) */
+typedef size_t (*text_bits_function_t)(void *context, unsigned int version);
+
+/* Selects the smallest version in [first_version, last_version] whose data capacity holds the bits of the text: the bits are computed once per band,
+ * then the version is binary searched in the band (capacities grow with the version). The last call of get_text_bits is for the band of the selected version.
+ * Returns 0 if the text doesn't fit; bits is set to the bits of the text in the last band tried. */
+unsigned int select_version(unsigned int first_version, unsigned int last_version, enum CORRECTION_LEVEL correction_level, text_bits_function_t get_text_bits, void *context, size_t *bits) {
+    *bits = SIZE_MAX;
+    for (int band = 0; band < VERSION_BANDS; band++) {
+        unsigned int low = first_version > VERSION_BAND_FIRST_VERSION[band] ? first_version : VERSION_BAND_FIRST_VERSION[band];
+        unsigned int high = last_version < VERSION_BAND_FIRST_VERSION[band + 1] - 1 ? last_version : VERSION_BAND_FIRST_VERSION[band + 1] - 1;
+        if (low > high)
+            continue;
+
+        *bits = get_text_bits(context, low);
+        if (*bits > get_data_capacity_bits(high, correction_level))
+            continue;
+        while (low < high) {
+            unsigned int middle = (low + high) / 2;
+            if (*bits <= get_data_capacity_bits(middle, correction_level))
+                high = middle;
+            else
+                low = middle + 1;
+        }
+        return low;
+    }
+    return 0;
+}
 
-    int total_information_needed = QRCODE_INFO[qrcode_template.version].correction_level_info[qrcode_template.correction_level].total_codewords * BITS_PER_BYTE;
+/* Raises the correction level of the template to the highest one whose capacity in the template version still holds the bits */
+void maximize_correction_level(qrcode_template_t *qrcode_template, size_t bits) {
+    for (enum CORRECTION_LEVEL correction_level = HIGH; correction_level > qrcode_template->correction_level; correction_level--) {
+        if (bits <= get_data_capacity_bits(qrcode_template->version, correction_level)) {
+            qrcode_template->correction_level = correction_level;
+            break;
+        }
+    }
+    if (qrcode_template->debug)
+        printf("Raising Correction Level in Version [%d]:\nSelected Correction Level [%d]\n\n", qrcode_template->version, qrcode_template->correction_level);
+}
 
-    /* Buffer containing the bits of data. */
-    int information_buffer_position = 0;
-    unsigned char information_buffer[total_information_needed];
+/* Context of the bits of a single segment text */
+typedef struct single_segment_bits_context {
+    enum ENCODING_MODE encoding_mode;
+    size_t characters;
+} single_segment_bits_context_t;
+
+size_t get_single_segment_bits(void *context, unsigned int version) {
+    single_segment_bits_context_t *segment = context;
+    return get_segment_bits(segment->encoding_mode, segment->characters, version);
+}
 
-    /* Insert byte mode into buffer */
-    for (int i = 0; i < MODE_INDICATOR_SIZE; i++) {
-        information_buffer[information_buffer_position] = MODE_INDICATOR[qrcode_template.encoding_mode][i];
-        information_buffer_position++;
+/* Value of a character in the alphanumeric table (0-9, A-Z, space, $ % * + - . / :), -1 if it is not in the table */
+int get_alphanumeric_value(unsigned char character) {
+    if (character >= '0' && character <= '9')
+        return character - '0';
+    if (character >= 'A' && character <= 'Z')
+        return character - 'A' + 10;
+    switch (character) {
+        case ' ': return 36;
+        case '$': return 37;
+        case '%': return 38;
+        case '*': return 39;
+        case '+': return 40;
+        case '-': return 41;
+        case '.': return 42;
+        case '/': return 43;
+        case ':': return 44;
+        default: return -1;
     }
+}
 
-    /* Insert input length into buffer */
-    get_binary_from_integer(input_length_characters, information_buffer + sizeof(unsigned char)*information_buffer_position,
-            QRCODE_INFO[qrcode_template.version].character_count_indicator_size[qrcode_template.encoding_mode]);
-    information_buffer_position += QRCODE_INFO[qrcode_template.version].character_count_indicator_size[qrcode_template.encoding_mode];
+/* Value of a Shift-JIS double byte character in Kanji mode (13 bits), -1 if it is not in the Kanji ranges */
+int get_kanji_value(unsigned int character) {
+    /* Subtract a magic number, then multiply the first byte by another number and sum it with the second byte */
+    if (character >= 0x8140 && character <= 0x9FFC)
+        character -= 0x8140;
+    else if (character >= 0xE040 && character <= 0xEBBF)
+        character -= 0xC140;
+    else
+        return -1;
+    return 0xC0*(character >> 8) + (character & 0xFF);
+}
+
+/* Appends the mode indicator and the character count of a segment; returns false if they don't fit in the stream */
+bool append_segment_header(bitstream_t *stream, enum ENCODING_MODE encoding_mode, size_t characters, unsigned int version) {
+    bool is_stream_valid = bitstream_append(stream, MODE_INDICATOR[encoding_mode], MODE_INDICATOR_SIZE);
+    is_stream_valid &= bitstream_append(stream, characters, QRCODE_INFO[version].character_count_indicator_size[encoding_mode]);
+    return is_stream_valid;
+}
 
-    /* Text processing */
+/* Appends the data of a segment in the given mode (for Kanji the data is Shift-JIS). is_stream_valid is cleared if the data doesn't fit in the stream.
+ * Returns false if a character can't be encoded in the mode. */
+bool append_segment_data(bitstream_t *stream, enum ENCODING_MODE encoding_mode, const char data[], size_t bytes, bool *is_stream_valid) {
     unsigned int current_number = 0; /* Needed for some computations */
-    switch (qrcode_template.encoding_mode) {
+    switch (encoding_mode) {
         case NUMERIC:
-            for (size_t i = 0; i < input_length_bytes; i++) {
-                if (input[i] < '0' || input[i] > '9') {
-                    fprintf(stderr, "QRCODE ERROR: Invalid character for Numeric encoding found: [%c].\n", input[i]);
-                    if (is_input_converted)
-                        free(input);
-                    return QRCODE_INVALID;
+            for (size_t i = 0; i < bytes; i++) {
+                if (data[i] < '0' || data[i] > '9') {
+                    fprintf(stderr, "QRCODE ERROR: Invalid character for Numeric encoding found: [%c].\n", data[i]);
+                    return false;
                 }
-                current_number = current_number*10 + (input[i] - '0');
+                current_number = current_number*10 + (data[i] - '0');
 
-                if ((i+1) % 3 == 0 || i == (input_length_bytes - 1)) {
+                if ((i+1) % 3 == 0 || i == (bytes - 1)) {
                     int data_size = (i+1) % 3 == 0 ? NUMERIC_3_CHARACTER_SIZE : ((i+1) % 3 == 2 ? NUMERIC_2_CHARACTER_SIZE : NUMERIC_1_CHARACTER_SIZE);
-                    get_binary_from_integer(current_number, information_buffer + sizeof(unsigned char)*information_buffer_position, data_size);
-                    information_buffer_position += data_size;
+                    *is_stream_valid &= bitstream_append(stream, current_number, data_size);
                     current_number = 0;
                 }
             }
             break;
 
         case ALPHANUMERIC:
-            for (size_t i = 0; i < input_length_bytes; i++) {
-                unsigned char current_character = input[i];
+            for (size_t i = 0; i < bytes; i++) {
                 /* Every char is assigned a value */
-                if (current_character >= '0' && current_character <= '9')
-                    current_number = current_number*45 + (current_character - '0');
-                else if (current_character >= 'A' && current_character <= 'Z')
-                    current_number = current_number*45 + (current_character - 'A') + 10;
-                else if (current_character == ' ')
-                    current_number = current_number*45 + 36;
-                else if (current_character == '$')
-                    current_number = current_number*45 + 37;
-                else if (current_character == '%')
-                    current_number = current_number*45 + 38;
-                else if (current_character == '*')
-                    current_number = current_number*45 + 39;
-                else if (current_character == '+')
-                    current_number = current_number*45 + 40;
-                else if (current_character == '-')
-                    current_number = current_number*45 + 41;
-                else if (current_character == '.')
-                    current_number = current_number*45 + 42;
-                else if (current_character == '/')
-                    current_number = current_number*45 + 43;
-                else if (current_character == ':')
-                    current_number = current_number*45 + 44;
-                else {
-                    fprintf(stderr, "QRCODE ERROR: Invalid character for Alphanumeric encoding found: [%c].\n", current_character);
-                    if (is_input_converted)
-                        free(input);
-                    return QRCODE_INVALID;
+                int value = get_alphanumeric_value(data[i]);
+                if (value < 0) {
+                    fprintf(stderr, "QRCODE ERROR: Invalid character for Alphanumeric encoding found: [%c].\n", data[i]);
+                    return false;
                 }
+                current_number = current_number*45 + value;
 
-                if ((i+1) % 2 == 0 || i == (input_length_bytes - 1)) {
+                if ((i+1) % 2 == 0 || i == (bytes - 1)) {
                     int data_size = (i+1) % 2 == 0 ? ALPHANUMERIC_2_CHARACTER_SIZE : ALPHANUMERIC_1_CHARACTER_SIZE;
-                    get_binary_from_integer(current_number, information_buffer + sizeof(unsigned char)*information_buffer_position, data_size);
-                    information_buffer_position += data_size;
+                    *is_stream_valid &= bitstream_append(stream, current_number, data_size);
                     current_number = 0;
                 }
             }
             break;
 
         case BYTE:
-            for (size_t i = 0; i < input_length_bytes; i++) {
-                get_binary_from_integer(input[i], information_buffer + sizeof(unsigned char)*information_buffer_position, BITS_PER_BYTE);
-                information_buffer_position += BITS_PER_BYTE;
+            for (size_t i = 0; i < bytes; i++) {
+                *is_stream_valid &= bitstream_append(stream, (unsigned char) data[i], BITS_PER_BYTE);
             }
             break;
 
         case KANJI:
-            current_number = 0;
-            unsigned char *unsigned_input = (unsigned char*) input;
-            /* Convert bytes */
-            for (size_t i = 0; i < input_length_bytes; i += 2) {
-                current_number = (unsigned_input[i] << 8) + unsigned_input[i+1];
+            /* Every character is 2 bytes long: an odd length means the text has characters that are not Kanji */
+            if (bytes % 2) {
+                fprintf(stderr, "QRCODE ERROR: Invalid Character found.\n");
+                return false;
+            }
+            for (size_t i = 0; i < bytes; i += 2) {
                 /* Only characters that are in the valid ranges can be encoded */
-                if (current_number >= 0x8140 && current_number <= 0x9FFC) {
-                    /* Subtract a magic number, then multiply the first byte by another number and sum it with the second byte */
-                    current_number -= 0x8140;
-                    current_number = 0xC0*((current_number & 0xFF00) >> 8) + (current_number & 0x00FF);
-                    get_binary_from_integer(current_number, information_buffer + sizeof(unsigned char)*information_buffer_position, KANJI_CHARACTER_SIZE);
-                    information_buffer_position += KANJI_CHARACTER_SIZE;
-
-                } else if (current_number >= 0xE040 && current_number <= 0xEBBF) {
-                    current_number -= 0xC140;
-                    current_number = 0xC0*((current_number & 0xFF00) >> 8) + (current_number & 0x00FF);
-                    get_binary_from_integer(current_number, information_buffer + sizeof(unsigned char)*information_buffer_position, KANJI_CHARACTER_SIZE);
-                    information_buffer_position += KANJI_CHARACTER_SIZE;
-
-                } else {
+                int value = get_kanji_value((unsigned char) data[i] << 8 | (unsigned char) data[i+1]);
+                if (value < 0) {
                     fprintf(stderr, "QRCODE ERROR: Invalid Character found.\n");
-                    if (is_input_converted)
-                        free(input);
-                    return QRCODE_INVALID;
+                    return false;
                 }
+                *is_stream_valid &= bitstream_append(stream, value, KANJI_CHARACTER_SIZE);
             }
             break;
+
+        case MIXED:
+        case ENCODING_AUTO:
+            /* Mixed text is made of segments of the other modes, automatic encoding is resolved before */
+            return false;
     }
+    return true;
+}
+
+/* Encodes the whole text of the template in its encoding mode (one segment), selecting the version if needed */
+bool encode_single_segment(qrcode_template_t *qrcode_template, bitstream_t *information_stream, unsigned char destination[], char conversion_buffer[], size_t conversion_buffer_size) {
+    /* Pointer to the input */
+    char *input = qrcode_template->text;
+
+    /* Input length and bytes */
+    size_t input_length_bytes = strlen(qrcode_template->text);
+    /* NOTE: In Byte mode the count indicator holds bytes, so a UTF-8 character that takes more than 1 byte is counted as many characters */
+    size_t input_length_characters = input_length_bytes;
+
+    /* If the encoding is different, convert it (into the conversion buffer, or an allocated one) */
+    bool is_input_allocated = false;
+    if (qrcode_template->encoding_mode == KANJI || (qrcode_template->encoding_mode == BYTE && qrcode_template->iso == true)) {
+        enum CHARSET charset = qrcode_template->encoding_mode == KANJI ? CHARSET_SHIFT_JIS : CHARSET_ISO_8859_1;
+        size_t capacity = conversion_buffer ? conversion_buffer_size : 0;
+        input = conversion_buffer;
+        input_length_bytes = convert_text(charset, qrcode_template->text, input_length_bytes, &input, &capacity, !conversion_buffer);
+        is_input_allocated = !conversion_buffer;
+        if (input_length_bytes == SIZE_MAX) {
+            if (is_input_allocated)
+                free(input);
+            return false;
+        }
+
+        /* NOTE: Every char in SJIS is 2 bytes long, in ISO 1 byte long */
+        input_length_characters = charset == CHARSET_SHIFT_JIS ? input_length_bytes / 2 : input_length_bytes;
+    }
+
+    /* If not manually selected, choose the smallest version that holds the exact bits of the text */
+    single_segment_bits_context_t segment = {qrcode_template->encoding_mode, input_length_characters};
+    size_t bits;
+    unsigned int first_version = qrcode_template->version == VERSION_ANY ? 1 : qrcode_template->version;
+    unsigned int last_version = qrcode_template->version == VERSION_ANY ? QRCODE_VERSIONS : qrcode_template->version;
+    unsigned int version = select_version(first_version, last_version, qrcode_template->correction_level, get_single_segment_bits, &segment, &bits);
+
+    /* If input is too large, abort */
+    if (!version) {
+        fprintf(stderr, "QRCODE ERROR: Input too large: [%lu] (more than %lu bytes). Can't generate code...\n",
+                input_length_characters, QRCODE_INFO[last_version].correction_level_info[qrcode_template->correction_level].character_capacity[qrcode_template->encoding_mode]);
+        if (is_input_allocated)
+            free(input);
+        return false;
+    }
+    if (qrcode_template->version == VERSION_ANY && qrcode_template->debug)
+        printf("Selecting Version from text size:\nSelected Version [%d]\n\n", version);
+    qrcode_template->version = version;
+    if (qrcode_template->maximize_correction_level)
+        maximize_correction_level(qrcode_template, bits);
+
+    /* Packed buffer containing the data codewords */
+    bitstream_init(information_stream, destination, QRCODE_INFO[qrcode_template->version].correction_level_info[qrcode_template->correction_level].total_codewords);
+
+    /* Insert mode, input length and text into the stream */
+    bool is_stream_valid = append_segment_header(information_stream, qrcode_template->encoding_mode, input_length_characters, qrcode_template->version);
+    bool is_text_valid = append_segment_data(information_stream, qrcode_template->encoding_mode, input, input_length_bytes, &is_stream_valid);
 
     /* If input was allocated, free it */
-    if (is_input_converted)
+    if (is_input_allocated)
         free(input);
 
-    /* Add terminator */
-    for (int i = 0; i < TERMINATOR_MAX_SIZE && information_buffer_position < total_information_needed; i++) {
-        information_buffer[information_buffer_position] = 0;
-        information_buffer_position++;
+    if (!is_text_valid)
+        return false;
+    if (!is_stream_valid) {
+        fprintf(stderr, "QRCODE ERROR: Input too large, data does not fit in Version [%d]. Can't generate code...\n", qrcode_template->version);
+        return false;
     }
+    return true;
+}
+
+/* Mixed mode: every character of the text gets the classes of the modes that can encode it, then the sequence of segments
+ * with the fewest bits is found by dynamic programming over the modes (the header of a segment depends on the version) */
+#define CHARACTER_NUMERIC 0x1
+#define CHARACTER_ALPHANUMERIC 0x2
+#define CHARACTER_BYTE 0x4
+#define CHARACTER_KANJI 0x8
+/* The bytes of a character in Byte mode are kept above the classes */
+#define CHARACTER_BYTES_SHIFT 4
+
+/* Segment costs are in sixths of bit, so that numeric (10 bits every 3 characters) and alphanumeric (11 bits every 2) characters have an integer cost */
+#define SEGMENT_COST_SCALE 6
+#define SEGMENT_COST_INVALID SIZE_MAX
+
+/* Number of UTF-8 characters of the text */
+size_t get_utf8_length(const unsigned char text[], size_t bytes) {
+    size_t characters = 0;
+    for (size_t i = 0; i < bytes; i += get_utf8_character_bytes(text + i, bytes - i))
+        characters++;
+    return characters;
+}
 
-    /* Add 0's until the buffer size is a multiple of 8 */
-    while (information_buffer_position % BITS_PER_BYTE != 0) {
-        information_buffer[information_buffer_position] = 0;
-        information_buffer_position++;
+/* ISO-8859-1 value of a UTF-8 character, -1 if it has none */
+int get_latin1_value(const unsigned char character[], size_t bytes) {
+    if (bytes == 1)
+        return character[0];
+    if (bytes == 2 && character[0] <= 0xC3)
+        return (character[0] & 0x1F) << 6 | (character[1] & 0x3F);
+    return -1;
+}
+
+/* Classifies every character of the text; returns false if a character can't be encoded in any mode */
+bool classify_mixed_text(const unsigned char text[], size_t bytes, bool iso, unsigned char classes[]) {
+    size_t character_bytes;
+    for (size_t i = 0, character = 0; i < bytes; i += character_bytes, character++) {
+        character_bytes = get_utf8_character_bytes(text + i, bytes - i);
+
+        unsigned char character_class = 0;
+        if (text[i] >= '0' && text[i] <= '9')
+            character_class |= CHARACTER_NUMERIC;
+        if (character_bytes == 1 && get_alphanumeric_value(text[i]) >= 0)
+            character_class |= CHARACTER_ALPHANUMERIC;
+        if (!iso || get_latin1_value(text + i, character_bytes) >= 0)
+            character_class |= CHARACTER_BYTE | (iso ? 1 : character_bytes) << CHARACTER_BYTES_SHIFT;
+        if (get_utf8_kanji_value(text + i, character_bytes) >= 0)
+            character_class |= CHARACTER_KANJI;
+
+        if (!character_class) {
+            fprintf(stderr, "QRCODE ERROR: Invalid character for ISO-8859-1 found.\n");
+            return false;
+        }
+        classes[character] = character_class;
     }
+    return true;
+}
 
-    /* If the data is still not full, add filler bits */
-    int filler_step = 0;
-    for (int i = information_buffer_position/BITS_PER_BYTE; i < total_information_needed/BITS_PER_BYTE; i++) {
-        get_binary_from_integer(FILLER_CHARACTERS[filler_step], information_buffer + sizeof(unsigned char)*information_buffer_position, BITS_PER_BYTE);
-        information_buffer_position += BITS_PER_BYTE;
-        filler_step = (filler_step + 1) % 2;
+/* Finds the segments with the fewest bits in the given version: modes[i] is set to the mode of character i.
+ * While going forward modes[i] keeps, for every mode, the mode of character i on the cheapest path that ends in that mode (2 bits each). */
+void find_mixed_segments(const unsigned char classes[], size_t characters, unsigned int version, unsigned char modes[]) {
+    const unsigned char mode_class[ENCODING_MODES] = {CHARACTER_NUMERIC, CHARACTER_ALPHANUMERIC, CHARACTER_BYTE, CHARACTER_KANJI};
+    const size_t character_cost[ENCODING_MODES] = {
+        NUMERIC_3_CHARACTER_SIZE * SEGMENT_COST_SCALE / 3, ALPHANUMERIC_2_CHARACTER_SIZE * SEGMENT_COST_SCALE / 2,
+        BITS_PER_BYTE * SEGMENT_COST_SCALE, KANJI_CHARACTER_SIZE * SEGMENT_COST_SCALE
+    };
+
+    /* Cost of the cheapest path over the characters so far that is ready to go on in every mode (a new segment has its header paid) */
+    size_t header_cost[ENCODING_MODES], costs[ENCODING_MODES];
+    for (int mode = 0; mode < ENCODING_MODES; mode++) {
+        header_cost[mode] = (MODE_INDICATOR_SIZE + QRCODE_INFO[version].character_count_indicator_size[mode]) * SEGMENT_COST_SCALE;
+        costs[mode] = header_cost[mode];
     }
 
-    /* Reconvert the data in the buffer to get decimal numbers */
-    unsigned char character_buffer[(total_information_needed/BITS_PER_BYTE)];
-    for (int i = 0; i < total_information_needed/BITS_PER_BYTE; i++)
-        character_buffer[i] = get_integer_from_binary(information_buffer + sizeof(unsigned char)*i*BITS_PER_BYTE);
+    for (size_t i = 0; i < characters; i++) {
+        /* Extend the segments of the modes that can encode the character */
+        size_t extended_costs[ENCODING_MODES];
+        for (int mode = 0; mode < ENCODING_MODES; mode++) {
+            size_t cost = character_cost[mode] * (mode == BYTE ? classes[i] >> CHARACTER_BYTES_SHIFT : 1);
+            extended_costs[mode] = (classes[i] & mode_class[mode]) ? costs[mode] + cost : SEGMENT_COST_INVALID;
+        }
 
-    if (qrcode_template.debug) {
+        /* Or end the segment at the character (rounded up to whole bits) and start a new one */
+        unsigned char previous_modes = 0;
+        for (int mode = 0; mode < ENCODING_MODES; mode++) {
+            costs[mode] = extended_costs[mode];
+            int previous_mode = mode;
+            for (int from_mode = 0; from_mode < ENCODING_MODES; from_mode++) {
+                if (extended_costs[from_mode] == SEGMENT_COST_INVALID)
+                    continue;
+                size_t switched_cost = (extended_costs[from_mode] + SEGMENT_COST_SCALE - 1) / SEGMENT_COST_SCALE * SEGMENT_COST_SCALE + header_cost[mode];
+                if (switched_cost < costs[mode]) {
+                    costs[mode] = switched_cost;
+                    previous_mode = from_mode;
+                }
+            }
+            previous_modes |= previous_mode << 2*mode;
+        }
+        modes[i] = previous_modes;
+    }
+
+    /* Trace the cheapest path back from its last mode */
+    int mode = 0;
+    for (int i = 1; i < ENCODING_MODES; i++) {
+        if (costs[i] < costs[mode])
+            mode = i;
+    }
+    for (size_t i = characters; i-- > 0;) {
+        mode = (modes[i] >> 2*mode) & 0x3;
+        modes[i] = mode;
+    }
+}
+
+/* Number of bytes of a segment in the text */
+size_t get_mixed_segment_bytes(const unsigned char text[], size_t bytes, size_t characters) {
+    size_t segment_bytes = 0;
+    for (size_t i = 0; i < characters; i++)
+        segment_bytes += get_utf8_character_bytes(text + segment_bytes, bytes - segment_bytes);
+    return segment_bytes;
+}
+
+/* Exact number of bits of the segments in the given version; SIZE_MAX if a segment has too many characters for its count indicator */
+size_t get_mixed_segments_bits(const unsigned char classes[], const unsigned char modes[], size_t characters, unsigned int version) {
+    size_t bits = 0;
+    for (size_t start = 0, end; start < characters; start = end) {
+        size_t byte_mode_bytes = 0;
+        for (end = start; end < characters && modes[end] == modes[start]; end++)
+            byte_mode_bytes += classes[end] >> CHARACTER_BYTES_SHIFT;
+
+        size_t segment_bits = get_segment_bits(modes[start], modes[start] == BYTE ? byte_mode_bytes : end - start, version);
+        if (segment_bits == SIZE_MAX)
+            return SIZE_MAX;
+        bits += segment_bits;
+    }
+    return bits;
+}
+
+/* Context of the bits of a mixed text: the segments are found again for every band */
+typedef struct mixed_segments_bits_context {
+    const unsigned char *classes;
+    unsigned char *modes;
+    size_t characters;
+} mixed_segments_bits_context_t;
+
+size_t get_mixed_text_bits(void *context, unsigned int version) {
+    mixed_segments_bits_context_t *text = context;
+    find_mixed_segments(text->classes, text->characters, version, text->modes);
+    return get_mixed_segments_bits(text->classes, text->modes, text->characters, version);
+}
+
+/* Appends the segments of the text to the stream; returns false if they don't fit */
+bool append_mixed_segments(bitstream_t *stream, const unsigned char text[], size_t bytes, const unsigned char classes[], const unsigned char modes[], size_t characters,
+        unsigned int version, bool iso) {
+    bool is_stream_valid = true;
+    size_t offset = 0;
+    for (size_t start = 0, end; start < characters; start = end) {
+        size_t byte_mode_bytes = 0;
+        for (end = start; end < characters && modes[end] == modes[start]; end++)
+            byte_mode_bytes += classes[end] >> CHARACTER_BYTES_SHIFT;
+        size_t segment_bytes = get_mixed_segment_bytes(text + offset, bytes - offset, end - start);
+        const unsigned char *segment = text + offset;
+
+        is_stream_valid &= append_segment_header(stream, modes[start], modes[start] == BYTE ? byte_mode_bytes : end - start, version);
+        switch (modes[start]) {
+            case NUMERIC:
+            case ALPHANUMERIC:
+                /* Both are ASCII only, the classification made sure the characters are valid */
+                append_segment_data(stream, modes[start], (const char*) segment, segment_bytes, &is_stream_valid);
+                break;
+
+            case BYTE:
+                if (!iso) {
+                    append_segment_data(stream, BYTE, (const char*) segment, segment_bytes, &is_stream_valid);
+                    break;
+                }
+                for (size_t i = 0, character_bytes; i < segment_bytes; i += character_bytes) {
+                    character_bytes = get_utf8_character_bytes(segment + i, segment_bytes - i);
+                    is_stream_valid &= bitstream_append(stream, get_latin1_value(segment + i, character_bytes), BITS_PER_BYTE);
+                }
+                break;
+
+            case KANJI:
+                for (size_t i = 0, character_bytes; i < segment_bytes; i += character_bytes) {
+                    character_bytes = get_utf8_character_bytes(segment + i, segment_bytes - i);
+                    is_stream_valid &= bitstream_append(stream, get_utf8_kanji_value(segment + i, character_bytes), KANJI_CHARACTER_SIZE);
+                }
+                break;
+        }
+        offset += segment_bytes;
+    }
+    return is_stream_valid;
+}
+
+/* Encodes the text of the template in the segments with the fewest bits, selecting the smallest version they fit in if needed.
+ * The classification of the characters and the segments take 2 bytes per character of conversion_buffer (allocated if NULL). */
+bool encode_mixed_segments(qrcode_template_t *qrcode_template, bitstream_t *information_stream, unsigned char destination[], char conversion_buffer[], size_t conversion_buffer_size) {
+    const unsigned char *text = (const unsigned char*) qrcode_template->text;
+    size_t bytes = strlen(qrcode_template->text);
+    size_t characters = get_utf8_length(text, bytes);
+
+    /* Every character takes more than 3 bits: the text can't have more characters than the largest numeric capacity */
+    size_t max_characters = conversion_buffer ? conversion_buffer_size / 2 : QRCODE_INFO[QRCODE_VERSIONS].correction_level_info[LOW].character_capacity[NUMERIC];
+    if (characters > max_characters) { fprintf(stderr, "QRCODE ERROR: Input too large: [%lu] characters (more than %lu). Can't generate code...\n", characters, max_characters); return false; }
+
+    unsigned char *classes = conversion_buffer ? (unsigned char*) conversion_buffer : malloc(2*characters + 1);
+    if (!classes) { fprintf(stderr, "QRCODE ERROR: Memory Error\n"); return false; }
+    unsigned char *modes = classes + characters;
+
+    bool is_encoded = classify_mixed_text(text, bytes, qrcode_template->iso, classes);
+    if (is_encoded) {
+        /* The segments only change with the sizes of the count indicators: they are found once per band */
+        mixed_segments_bits_context_t segments = {classes, modes, characters};
+        size_t bits;
+        unsigned int first_version = qrcode_template->version == VERSION_ANY ? 1 : qrcode_template->version;
+        unsigned int last_version = qrcode_template->version == VERSION_ANY ? QRCODE_VERSIONS : qrcode_template->version;
+        unsigned int version = select_version(first_version, last_version, qrcode_template->correction_level, get_mixed_text_bits, &segments, &bits);
+
+        if (!version) {
+            fprintf(stderr, "QRCODE ERROR: Input too large: [%lu] bits (more than %lu). Can't generate code...\n", bits, get_data_capacity_bits(last_version, qrcode_template->correction_level));
+            is_encoded = false;
+        } else {
+            if (qrcode_template->version == VERSION_ANY && qrcode_template->debug)
+                printf("Selecting Version from text size:\nSelected Version [%d]\n\n", version);
+            qrcode_template->version = version;
+            if (qrcode_template->maximize_correction_level)
+                maximize_correction_level(qrcode_template, bits);
+
+            if (qrcode_template->debug) {
+                printf("Segments (%lu bits):\n", bits);
+                for (size_t start = 0, end; start < characters; start = end) {
+                    for (end = start; end < characters && modes[end] == modes[start]; end++);
+                    printf("%s [%lu] ", ENCODING_MODE_NAMES[modes[start]], end - start);
+                }
+                printf("\n\n");
+            }
+
+            bitstream_init(information_stream, destination, QRCODE_INFO[version].correction_level_info[qrcode_template->correction_level].total_codewords);
+            is_encoded = append_mixed_segments(information_stream, text, bytes, classes, modes, characters, version, qrcode_template->iso);
+        }
+    }
+
+    if (!conversion_buffer)
+        free(classes);
+    return is_encoded;
+}
+
+/* Automatic encoding: one pass over the bytes of the text tells if it is numeric, alphanumeric or ASCII.
+ * Alphanumeric and numeric bytes are found with a nibble lookup: a byte is in a set if the entry of its low nibble
+ * has the bit of its high nibble (only ASCII high nibbles have a bit) */
+#define TEXT_HAS_NON_NUMERIC 0x1
+#define TEXT_HAS_NON_ALPHANUMERIC 0x2
+#define TEXT_HAS_ASCII 0x4
+#define TEXT_HAS_NON_ASCII 0x8
+const unsigned char HIGH_NIBBLE_BITS[RS_NIBBLE_VALUES] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0, 0, 0, 0, 0, 0, 0, 0};
+const unsigned char NUMERIC_LOW_NIBBLE_SETS[RS_NIBBLE_VALUES] = {0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0, 0, 0, 0, 0, 0};
+const unsigned char ALPHANUMERIC_LOW_NIBBLE_SETS[RS_NIBBLE_VALUES] = {0x2C, 0x38, 0x38, 0x38, 0x3C, 0x3C, 0x38, 0x38, 0x38, 0x38, 0x3C, 0x14, 0x10, 0x14, 0x14, 0x14};
+
+/* Portable scan, also used for the tails of the vector ones */
+unsigned int scan_text_scalar(const unsigned char text[], size_t bytes) {
+    unsigned int found = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        unsigned char high_bit = HIGH_NIBBLE_BITS[text[i] >> 4];
+        if (!(NUMERIC_LOW_NIBBLE_SETS[text[i] & 0x0F] & high_bit))
+            found |= TEXT_HAS_NON_NUMERIC;
+        if (!(ALPHANUMERIC_LOW_NIBBLE_SETS[text[i] & 0x0F] & high_bit))
+            found |= TEXT_HAS_NON_ALPHANUMERIC;
+        found |= text[i] < 0x80 ? TEXT_HAS_ASCII : TEXT_HAS_NON_ASCII;
+    }
+    return found;
+}
+
+#ifdef QRCODE_X86_SIMD
+/* SSSE3 scan: 16 bytes at a time, the lookups are byte shuffles */
+__attribute__((target("ssse3")))
+unsigned int scan_text_ssse3(const unsigned char text[], size_t bytes) {
+    const __m128i nibble_mask = _mm_set1_epi8(0x0F);
+    const __m128i high_nibble_bits = _mm_loadu_si128((const __m128i*) HIGH_NIBBLE_BITS);
+    const __m128i numeric_sets = _mm_loadu_si128((const __m128i*) NUMERIC_LOW_NIBBLE_SETS);
+    const __m128i alphanumeric_sets = _mm_loadu_si128((const __m128i*) ALPHANUMERIC_LOW_NIBBLE_SETS);
+    __m128i non_numeric = _mm_setzero_si128(), non_alphanumeric = _mm_setzero_si128();
+    __m128i all_bytes = _mm_setzero_si128(), all_inverted_bytes = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i vector = _mm_loadu_si128((const __m128i*) (text + i));
+        __m128i low_nibbles = _mm_and_si128(vector, nibble_mask);
+        __m128i high_bits = _mm_shuffle_epi8(high_nibble_bits, _mm_and_si128(_mm_srli_epi16(vector, 4), nibble_mask));
+        non_numeric = _mm_or_si128(non_numeric, _mm_cmpeq_epi8(_mm_and_si128(_mm_shuffle_epi8(numeric_sets, low_nibbles), high_bits), _mm_setzero_si128()));
+        non_alphanumeric = _mm_or_si128(non_alphanumeric, _mm_cmpeq_epi8(_mm_and_si128(_mm_shuffle_epi8(alphanumeric_sets, low_nibbles), high_bits), _mm_setzero_si128()));
+        /* The top bit of a byte is set if it is not ASCII (and clear in the inverted byte) */
+        all_bytes = _mm_or_si128(all_bytes, vector);
+        all_inverted_bytes = _mm_or_si128(all_inverted_bytes, _mm_xor_si128(vector, _mm_set1_epi8(-1)));
+    }
+
+    unsigned int found = scan_text_scalar(text + i, bytes - i);
+    found |= _mm_movemask_epi8(non_numeric) ? TEXT_HAS_NON_NUMERIC : 0;
+    found |= _mm_movemask_epi8(non_alphanumeric) ? TEXT_HAS_NON_ALPHANUMERIC : 0;
+    found |= _mm_movemask_epi8(all_bytes) ? TEXT_HAS_NON_ASCII : 0;
+    found |= _mm_movemask_epi8(all_inverted_bytes) ? TEXT_HAS_ASCII : 0;
+    return found;
+}
+
+/* AVX2 scan: same as the SSSE3 one, 32 bytes at a time */
+__attribute__((target("avx2")))
+unsigned int scan_text_avx2(const unsigned char text[], size_t bytes) {
+    const __m256i nibble_mask = _mm256_set1_epi8(0x0F);
+    const __m256i high_nibble_bits = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) HIGH_NIBBLE_BITS));
+    const __m256i numeric_sets = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) NUMERIC_LOW_NIBBLE_SETS));
+    const __m256i alphanumeric_sets = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) ALPHANUMERIC_LOW_NIBBLE_SETS));
+    __m256i non_numeric = _mm256_setzero_si256(), non_alphanumeric = _mm256_setzero_si256();
+    __m256i all_bytes = _mm256_setzero_si256(), all_inverted_bytes = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 32 <= bytes; i += 32) {
+        __m256i vector = _mm256_loadu_si256((const __m256i*) (text + i));
+        __m256i low_nibbles = _mm256_and_si256(vector, nibble_mask);
+        __m256i high_bits = _mm256_shuffle_epi8(high_nibble_bits, _mm256_and_si256(_mm256_srli_epi16(vector, 4), nibble_mask));
+        non_numeric = _mm256_or_si256(non_numeric, _mm256_cmpeq_epi8(_mm256_and_si256(_mm256_shuffle_epi8(numeric_sets, low_nibbles), high_bits), _mm256_setzero_si256()));
+        non_alphanumeric = _mm256_or_si256(non_alphanumeric, _mm256_cmpeq_epi8(_mm256_and_si256(_mm256_shuffle_epi8(alphanumeric_sets, low_nibbles), high_bits), _mm256_setzero_si256()));
+        all_bytes = _mm256_or_si256(all_bytes, vector);
+        all_inverted_bytes = _mm256_or_si256(all_inverted_bytes, _mm256_xor_si256(vector, _mm256_set1_epi8(-1)));
+    }
+
+    unsigned int found = scan_text_scalar(text + i, bytes - i);
+    found |= _mm256_movemask_epi8(non_numeric) ? TEXT_HAS_NON_NUMERIC : 0;
+    found |= _mm256_movemask_epi8(non_alphanumeric) ? TEXT_HAS_NON_ALPHANUMERIC : 0;
+    found |= _mm256_movemask_epi8(all_bytes) ? TEXT_HAS_NON_ASCII : 0;
+    found |= _mm256_movemask_epi8(all_inverted_bytes) ? TEXT_HAS_ASCII : 0;
+    return found;
+}
+#endif
+
+/* Scans the text with the fastest kernel supported by the running cpu; returns the TEXT_HAS_ flags */
+unsigned int scan_text(const unsigned char text[], size_t bytes) {
+#ifdef QRCODE_X86_SIMD
+    if (__builtin_cpu_supports("avx2"))
+        return scan_text_avx2(text, bytes);
+    if (__builtin_cpu_supports("ssse3"))
+        return scan_text_ssse3(text, bytes);
+#endif
+    return scan_text_scalar(text, bytes);
+}
+
+/* Classes of a whole text (the classes that all of its characters have) */
+typedef struct text_classification {
+    /* Bytes of the text */
+    size_t bytes;
+    /* CHARACTER_ flags of the modes that can encode the whole text (CHARACTER_BYTE is always set) */
+    unsigned char classes;
+    /* flag set if the text is only made of ASCII characters */
+    bool is_ascii;
+} text_classification_t;
+
+/* Classifies a (UTF-8, NULL terminated) text. Kanji characters are only looked for when no character is ASCII, since ASCII can't be Kanji */
+text_classification_t classify_text(const char *text) {
+    const unsigned char *unsigned_text = (const unsigned char*) text;
+    text_classification_t classification = {.bytes = strlen(text), .classes = CHARACTER_BYTE, .is_ascii = true};
+    unsigned int found = scan_text(unsigned_text, classification.bytes);
+
+    if (!(found & TEXT_HAS_NON_NUMERIC))
+        classification.classes |= CHARACTER_NUMERIC;
+    if (!(found & TEXT_HAS_NON_ALPHANUMERIC))
+        classification.classes |= CHARACTER_ALPHANUMERIC;
+    classification.is_ascii = !(found & TEXT_HAS_NON_ASCII);
+
+    if (!(found & TEXT_HAS_ASCII) && classification.bytes > 0) {
+        bool is_kanji = true;
+        size_t character_bytes;
+        for (size_t i = 0; i < classification.bytes && is_kanji; i += character_bytes) {
+            character_bytes = get_utf8_character_bytes(unsigned_text + i, classification.bytes - i);
+            is_kanji = get_utf8_kanji_value(unsigned_text + i, character_bytes) >= 0;
+        }
+        if (is_kanji)
+            classification.classes |= CHARACTER_KANJI;
+    }
+    return classification;
+}
+
+/* The single mode with the fewest bits that can encode a classified text */
+enum ENCODING_MODE get_tightest_encoding_mode(text_classification_t classification) {
+    if (classification.classes & CHARACTER_NUMERIC)
+        return NUMERIC;
+    if (classification.classes & CHARACTER_ALPHANUMERIC)
+        return ALPHANUMERIC;
+    /* A Kanji character takes 13 bits, at least 2 bytes in UTF-8 */
+    if (classification.classes & CHARACTER_KANJI)
+        return KANJI;
+    return BYTE;
+}
+
+/* Encodes the text of the template into its data codewords (packed, in block order) and selects the version if needed.
+ * A converted text goes in conversion_buffer (allocated if NULL). Returns false if the template or its text are not valid. */
+bool get_data_codewords(qrcode_template_t *qrcode_template, unsigned char destination[], char conversion_buffer[], size_t conversion_buffer_size) {
+    /* Input check */
+    if (!qrcode_template->text) { fprintf(stderr, "QRCODE ERROR: Input error, text is NULL\n"); return false; }
+    if (qrcode_template->version < VERSION_ANY || qrcode_template->version > QRCODE_VERSIONS) { fprintf(stderr, "QRCODE ERROR: Input error, invalid Version\n"); return false; }
+    if (qrcode_template->encoding_mode < NUMERIC || qrcode_template->encoding_mode > ENCODING_AUTO) { fprintf(stderr, "QRCODE ERROR: Input error, invalid Encoding\n"); return false; }
+    if (qrcode_template->mask < MASK_ANY || qrcode_template->mask >= MASK_NUMBER) { fprintf(stderr, "QRCODE ERROR: Input error, invalid Mask\n"); return false; }
+    if (qrcode_template->mask_strategy < MASK_EXACT || qrcode_template->mask_strategy > MASK_FIXED) { fprintf(stderr, "QRCODE ERROR: Input error, invalid Mask strategy\n"); return false; }
+    if (qrcode_template->mask_strategy == MASK_FIXED && qrcode_template->mask == MASK_ANY) { fprintf(stderr, "QRCODE ERROR: Input error, fixed Mask strategy without a Mask\n"); return false; }
+
+    /* Information */
+    if (qrcode_template->debug) {
+        printf("QRCODE INFO:\n");
+        if (qrcode_template->version == VERSION_ANY)
+            printf("VERSION: [ANY]\n");
+        else
+            printf("VERSION: [%d]\n", qrcode_template->version);
+
+        printf("CORRECTION LEVEL: [");
+        switch (qrcode_template->correction_level) {
+            case LOW:
+                printf("LOW");
+                break;
+            case MEDIUM:
+                printf("MEDIUM");
+                break;
+            case QUARTILE:
+                printf("QUARTILE");
+                break;
+            case HIGH:
+                printf("HIGH");
+                break;
+        }
+        printf("]\n");
+
+        if (qrcode_template->mask == MASK_ANY)
+            printf("MASK: [ANY]\n");
+        else
+            printf("MASK: [%d]\n", qrcode_template->mask);
+
+        printf("ENCODING: [");
+        switch (qrcode_template->encoding_mode) {
+            case NUMERIC:
+                printf("NUMERIC");
+                break;
+            case ALPHANUMERIC:
+                printf("ALPHANUMERIC");
+                break;
+            case BYTE:
+                printf("BYTE");
+                break;
+            case KANJI:
+                printf("KANJI");
+                break;
+            case MIXED:
+                printf("MIXED");
+                break;
+            case ENCODING_AUTO:
+                printf("AUTO");
+                break;
+        }
+        printf("]\n");
+
+        printf("NEGATIVE MODE: [%s]\n", qrcode_template->negative ? "ENABLED" : "DISABLED");
+
+        printf("ISO MODE: [%s]\n", qrcode_template->iso ? "ENABLED" : "DISABLED");
+        printf("\n");
+    }
+
+    /* If not manually selected, choose the tightest encoding for the text */
+    if (qrcode_template->encoding_mode == ENCODING_AUTO) {
+        qrcode_template->encoding_mode = get_tightest_encoding_mode(classify_text(qrcode_template->text));
+        if (qrcode_template->debug) {
+            printf("Selecting Encoding from text:\nSelected Encoding [%s]\n\n", ENCODING_MODE_NAMES[qrcode_template->encoding_mode]);
+        }
+    }
+
+    /* Encode the text into the stream */
+    bitstream_t information_stream;
+    bool is_encoded = qrcode_template->encoding_mode == MIXED ?
+        encode_mixed_segments(qrcode_template, &information_stream, destination, conversion_buffer, conversion_buffer_size) :
+        encode_single_segment(qrcode_template, &information_stream, destination, conversion_buffer, conversion_buffer_size);
+    if (!is_encoded)
+        return false;
+    int total_codewords = QRCODE_INFO[qrcode_template->version].correction_level_info[qrcode_template->correction_level].total_codewords;
+
+    /* Add terminator and filler codewords */
+    bitstream_add_terminator_and_filler(&information_stream);
+
+    if (qrcode_template->debug) {
         printf("Input data (+ padding):\n");
-        for (int i = 0; i < total_information_needed/BITS_PER_BYTE; i++) {
-            printf("%d ", character_buffer[i]);
+        for (int i = 0; i < total_codewords; i++) {
+            printf("%d ", destination[i]);
         }
         printf("\n\n");
     }
 
-    /* Pupulate lookup tables */
-    log_lookup_table[0] = 1;
-    for (int i = 1; i < LOOKUPTABLE_SIZE; i++) {
-        log_lookup_table[i] = log_lookup_table[i - 1] * 2;
-        /* If number is over 255, xor it with 285 */
-        if (log_lookup_table[i] > 255)
-            log_lookup_table[i] ^= 285;
+    return true;
+}
+
+/* Computes the correction codewords of every block of the given codewords (data codewords followed by space for the correction codewords).
+ * The blocks of each group have the same size, so they are encoded together. */
+void get_qrcode_correction_codewords(const qrcode_template_t *qrcode_template, const reed_solomon_encoder_t *encoder, unsigned char codewords[]) {
+    /* Correction blocks (variables to make the code more readable)*/
+    int blocks1 = QRCODE_INFO[qrcode_template->version].correction_level_info[qrcode_template->correction_level].blocks_in_group1;
+    int words_per_block1 = QRCODE_INFO[qrcode_template->version].correction_level_info[qrcode_template->correction_level].data_codewords_per_block_in_group1;
+    int blocks2 = QRCODE_INFO[qrcode_template->version].correction_level_info[qrcode_template->correction_level].blocks_in_group2;
+    int words_per_block2 = QRCODE_INFO[qrcode_template->version].correction_level_info[qrcode_template->correction_level].data_codewords_per_block_in_group2;
+    int total_codewords = QRCODE_INFO[qrcode_template->version].correction_level_info[qrcode_template->correction_level].total_codewords;
+    int ecc_per_block = encoder->correction_codewords;
+
+    const unsigned char *messages[blocks1 > blocks2 ? blocks1 : blocks2];
+    unsigned char *destinations[blocks1 > blocks2 ? blocks1 : blocks2];
+
+    for (int i = 0; i < blocks1; i++) {
+        messages[i] = codewords + sizeof(unsigned char)*(i*words_per_block1);
+        destinations[i] = codewords + sizeof(unsigned char)*(total_codewords + i*ecc_per_block);
     }
-    for (int i = 1; i < LOOKUPTABLE_SIZE; i++) {
-        log_reverse_lookup_table[log_lookup_table[i]] = i;
+    get_correction_words_batch(encoder, messages, words_per_block1, blocks1, destinations);
+
+    for (int i = 0; i < blocks2; i++) {
+        messages[i] = codewords + sizeof(unsigned char)*(words_per_block1*blocks1 + i*words_per_block2);
+        destinations[i] = codewords + sizeof(unsigned char)*(total_codewords + blocks1*ecc_per_block + i*ecc_per_block);
     }
+    get_correction_words_batch(encoder, messages, words_per_block2, blocks2, destinations);
+}
+
+/* Matrices used while a qrcode is built */
+typedef struct qrcode_matrices {
+    qrcode_matrix_t unmasked_qrcode;
+    qrcode_matrix_t masked_qrcode;
+    mask_evaluation_t evaluation;
+} qrcode_matrices_t;
+
+/* Builds the qrcode from its data and correction codewords (in block order): interleaves them, places them and applies the mask.
+ * The qrcode modules are written in destination if given (get_qrcode_buffer_size bytes), else in a new allocation */
+qrcode_t get_qrcode_from_codewords(qrcode_template_t qrcode_template, const unsigned char codewords[], qrcode_matrices_t *matrices, uint64_t destination[]) {
+    /* Sizes */
+    size_t qrcode_size = get_qrcode_size(qrcode_template.version);
+    size_t padded_qrcode_size = get_qrcode_size_with_padding(qrcode_template.version);
+
+    int total_codewords = QRCODE_INFO[qrcode_template.version].correction_level_info[qrcode_template.correction_level].total_codewords;
+    const unsigned char *correction_character_buffer = codewords + total_codewords;
 
     /* Generator polynomial */
     int generator_polynomial_size = QRCODE_INFO[qrcode_template.version].correction_level_info[qrcode_template.correction_level].error_correction_codewords_per_block + 1;
-    unsigned char generator_polynomial[generator_polynomial_size];
     int ecc_per_block = QRCODE_INFO[qrcode_template.version].correction_level_info[qrcode_template.correction_level].error_correction_codewords_per_block;
-    get_generator_polynomial(generator_polynomial, ecc_per_block);
+    const unsigned char *generator_polynomial = get_generator_polynomial(ecc_per_block);
 
     if (qrcode_template.debug) {
         printf("Generator polynomial of qrcode:\n");
@@ -1198,27 +3624,6 @@ qrcode_t generate_qrcode(qrcode_template_t qrcode_template) {
     if (qrcode_template.debug)
         printf("Group1: %d blocks, %d words per block\nGroup2: %d blocks, %d words per block\n\n", blocks1, words_per_block1, blocks2, words_per_block2);
 
-    /* Buffer for the correction characters */
-    unsigned char correction_character_buffer[ecc_per_block * (blocks1 + blocks2)];
-
-    for (int i = 0; i < blocks1; i++) {
-        get_correction_words(
-                character_buffer + sizeof(unsigned char)*(i*words_per_block1),
-                words_per_block1,
-                generator_polynomial,
-                generator_polynomial_size,
-                correction_character_buffer + sizeof(unsigned char)*(i*ecc_per_block));
-    }
-
-    for (int i = 0; i < blocks2; i++) {
-        get_correction_words(
-                character_buffer + sizeof(unsigned char)*(words_per_block1*blocks1 + i*words_per_block2),
-                words_per_block2,
-                generator_polynomial,
-                generator_polynomial_size,
-                correction_character_buffer + sizeof(unsigned char)*(blocks1*ecc_per_block + i*ecc_per_block));
-    }
-
     if (qrcode_template.debug) {
         printf("Correction data:");
         for (int i = 0; i < ecc_per_block*(blocks1+blocks2); i++) {
@@ -1229,105 +3634,600 @@ qrcode_t generate_qrcode(qrcode_template_t qrcode_template) {
         printf("\n\n");
     }
 
-    /* Fill final information buffer (data + error correction) */
-    unsigned char qrcode_buffer[total_information_needed + ecc_per_block*(blocks1+blocks2)*BITS_PER_BYTE + QRCODE_INFO[qrcode_template.version].remainder_bits];
-    for (int i = 0; i < (words_per_block1 > words_per_block2 ? words_per_block1 : words_per_block2); i++) {
-        /* If the second group exists, its blocks are always larger than those in group 1 */
-        if (i < words_per_block1) {
-            for (int j = 0; j < blocks1; j++)
-                get_binary_from_integer(
-                        character_buffer[i + j*(words_per_block1)],
-                        qrcode_buffer + sizeof(unsigned char)*(i*(blocks1+blocks2) + j)*BITS_PER_BYTE,
-                        BITS_PER_BYTE);
-            for (int j = 0; j < blocks2; j++)
-                get_binary_from_integer(
-                        character_buffer[words_per_block1*blocks1 + i + j*(words_per_block2)],
-                        qrcode_buffer + sizeof(unsigned char)*(i*(blocks1+blocks2) + blocks1 + j)*BITS_PER_BYTE,
-                        BITS_PER_BYTE);
+    /* Module of every codeword bit */
+    int final_codewords = total_codewords + ecc_per_block*(blocks1+blocks2);
+    const unsigned short *placement_map = get_placement_map(qrcode_template.version, qrcode_template.correction_level);
+    if (!placement_map) { fprintf(stderr, "QRCODE ERROR: Memory Error\n"); return QRCODE_INVALID; }
 
-        } else {
-            for (int j = 0; j < blocks2; j++)
-                get_binary_from_integer(
-                        character_buffer[words_per_block1*blocks1 + i + j*(words_per_block2)],
-                        qrcode_buffer + sizeof(unsigned char)*(i*(blocks1+blocks2) + j)*BITS_PER_BYTE,
-                        BITS_PER_BYTE);
-        }
-    }
-    for (int i = 0; i < ecc_per_block; i++) {
-        for (int j = 0; j < (blocks1 + blocks2); j++)
-            get_binary_from_integer(
-                    correction_character_buffer[i + j*(ecc_per_block)],
-                    qrcode_buffer + sizeof(unsigned char)*(blocks1*words_per_block1 + blocks2*words_per_block2 + i*(blocks1 + blocks2) + j)*BITS_PER_BYTE,
-                    BITS_PER_BYTE);
-    }
-    /* Add remainder bits */
-    for (int i = 0; i < QRCODE_INFO[qrcode_template.version].remainder_bits; i++) {
-        qrcode_buffer[total_information_needed + ecc_per_block*(blocks1+blocks2)*BITS_PER_BYTE + i] = 0;
-    }
+    const version_template_t *version_template = get_version_template(qrcode_template.version);
+    if (!version_template) { fprintf(stderr, "QRCODE ERROR: Memory Error\n"); return QRCODE_INVALID; }
 
-    /* Matrix to populate with all qrcode data and patterns */
-    cell_t qrcode[qrcode_size * qrcode_size];
-    for (int i = 0; i < qrcode_size*qrcode_size; i++) {
-        qrcode[i].locked = UNLOCKED;
-    }
+    /* Matrix populated with all qrcode data and patterns, and the same matrix with a mask applied */
+    qrcode_matrix_t *unmasked_qrcode = &matrices->unmasked_qrcode;
+    populate_qrcode(unmasked_qrcode, codewords, final_codewords, placement_map, version_template);
+    const qrcode_matrix_t *qrcode = &matrices->masked_qrcode;
 
     /* If a specific mask is selected, skip penalty computations */
     if (qrcode_template.mask == MASK_ANY) {
-        /* Select best mask and apply it */
-        int mask_penalties[MASK_NUMBER] = {0};
-
-        /* Apply all masks and compute their penalties */
-        for (int current_mask = 0; current_mask < MASK_NUMBER; current_mask++) {
-            populate_qrcode(qrcode, qrcode_buffer, qrcode_template.version, qrcode_template.correction_level, current_mask);
-            mask_penalties[current_mask] = compute_qrcode_penalty(qrcode, qrcode_template.version);
-        }
+        /* Apply all masks and compute their penalties (every mask on its own matrix, the best one is kept) */
+        mask_evaluation_t *evaluation = &matrices->evaluation;
+        evaluation->unmasked_qrcode = unmasked_qrcode;
+        evaluation->version_template = version_template;
+        evaluation->correction_level = qrcode_template.correction_level;
+        evaluation->is_approximate = qrcode_template.mask_strategy == MASK_APPROXIMATE;
+        evaluate_masks(evaluation, qrcode_template.parallel_masks);
 
         /* Compare penalties and select best mask */
         qrcode_template.mask = 0;
-        int min_penalty = mask_penalties[0];
+        unsigned int min_penalty = evaluation->penalties[0];
         for (int current_mask = 0; current_mask < MASK_NUMBER; current_mask++) {
-            if (min_penalty > mask_penalties[current_mask]) {
+            if (min_penalty > evaluation->penalties[current_mask]) {
                 qrcode_template.mask = current_mask;
-                min_penalty = mask_penalties[current_mask];
+                min_penalty = evaluation->penalties[current_mask];
             }
         }
         if (qrcode_template.debug) {
-            printf("Mask Penalties:\n");
+            printf("Mask Penalties%s:\n", evaluation->is_approximate ? " (approximate)" : "");
             for (int i = 0; i < MASK_NUMBER; i++) {
-                printf("[%d]: %d, ", i, mask_penalties[i]);
+                printf("[%d]: %d, ", i, evaluation->penalties[i]);
             }
             printf("\nApplied Mask [%d]\n", qrcode_template.mask);
         }
+        qrcode = &evaluation->candidates[qrcode_template.mask];
+    } else {
+        apply_mask(&matrices->masked_qrcode, unmasked_qrcode, version_template, qrcode_template.correction_level, qrcode_template.mask);
     }
 
-    /* Populate with the best mask */
-    populate_qrcode(qrcode, qrcode_buffer, qrcode_template.version, qrcode_template.correction_level, qrcode_template.mask);
-
-    /* Create a qrcode grid with padding added */
+    /* Create a qrcode grid with padding added: every row is shifted by the padding */
     qrcode_t padded_qrcode;
     padded_qrcode.size = padded_qrcode_size;
-    padded_qrcode.data = malloc(sizeof(unsigned char) * ((padded_qrcode_size) * (padded_qrcode_size)));
-    if (!padded_qrcode.data) { fprintf(stderr, "QRCODE ERROR: Memory Error\n"); return QRCODE_INVALID; }
+    padded_qrcode.words_per_row = (padded_qrcode_size + QRCODE_MATRIX_WORD_BITS - 1) / QRCODE_MATRIX_WORD_BITS;
+    if (destination) {
+        padded_qrcode.data = destination;
+        memset(destination, 0, padded_qrcode_size * padded_qrcode.words_per_row * sizeof(uint64_t));
+    } else {
+        padded_qrcode.data = calloc(padded_qrcode_size * padded_qrcode.words_per_row, sizeof(uint64_t));
+        if (!padded_qrcode.data) { fprintf(stderr, "QRCODE ERROR: Memory Error\n"); return QRCODE_INVALID; }
+    }
 
-    for (int i = 0; i < padded_qrcode_size; i++) {
-        for (int j = 0; j < padded_qrcode_size; j++) {
-            if (i >= QRCODE_PADDING && j >= QRCODE_PADDING && i < (qrcode_size + QRCODE_PADDING) && j < (qrcode_size + QRCODE_PADDING))
-                padded_qrcode.data[(padded_qrcode_size)*(i) + j] = qrcode[(qrcode_size)*(i - QRCODE_PADDING) + j - QRCODE_PADDING].value;
-            else
-                padded_qrcode.data[(padded_qrcode_size)*(i) + j] = QRCODE_WHITE;
+    size_t words_per_row = qrcode->words_per_row;
+    for (size_t i = 0; i < qrcode_size; i++) {
+        const uint64_t *row = qrcode->value + i*words_per_row;
+        uint64_t *padded_row = padded_qrcode.data + (i + QRCODE_PADDING)*padded_qrcode.words_per_row;
+        for (size_t w = 0; w < padded_qrcode.words_per_row; w++) {
+            uint64_t word = w < words_per_row ? row[w] << QRCODE_PADDING : 0;
+            if (w > 0 && w - 1 < words_per_row)
+                word |= row[w - 1] >> (QRCODE_MATRIX_WORD_BITS - QRCODE_PADDING);
+            padded_row[w] = word;
         }
     }
 
-    /* If selected, invert values */
-    if (qrcode_template.negative)
-        for (int i = 0; i < padded_qrcode_size; i++) {
-            for (int j = 0; j < padded_qrcode_size; j++) {
-                padded_qrcode.data[(padded_qrcode_size)*(i) + j] = !padded_qrcode.data[(padded_qrcode_size)*(i) + j];
+    /* If selected, invert values (bits after the end of every row stay clear) */
+    if (qrcode_template.negative) {
+        for (size_t i = 0; i < padded_qrcode_size; i++) {
+            for (size_t w = 0; w < padded_qrcode.words_per_row; w++) {
+                size_t row_bits = padded_qrcode_size - w*QRCODE_MATRIX_WORD_BITS;
+                uint64_t row_mask = row_bits >= QRCODE_MATRIX_WORD_BITS ? ~(uint64_t) 0 : ((uint64_t) 1 << row_bits) - 1;
+                padded_qrcode.data[i*padded_qrcode.words_per_row + w] ^= row_mask;
             }
         }
+    }
 
     return padded_qrcode;
 }
 
+/* Maximum number of codewords (data + correction) of a qrcode */
+#define QRCODE_MAX_CODEWORDS 3706
+
+/* Generates a QRCODE from the given template. */
+qrcode_t generate_qrcode(qrcode_template_t qrcode_template) {
+    /* Data codewords followed by the correction codewords */
+    unsigned char codewords[QRCODE_MAX_CODEWORDS];
+    if (!get_data_codewords(&qrcode_template, codewords, NULL, 0))
+        return QRCODE_INVALID;
+
+    reed_solomon_encoder_t encoder;
+    reed_solomon_encoder_init(&encoder, QRCODE_INFO[qrcode_template.version].correction_level_info[qrcode_template.correction_level].error_correction_codewords_per_block);
+    get_qrcode_correction_codewords(&qrcode_template, &encoder, codewords);
+
+    qrcode_matrices_t *matrices = malloc(sizeof(qrcode_matrices_t));
+    if (!matrices) { fprintf(stderr, "QRCODE ERROR: Memory Error\n"); return QRCODE_INVALID; }
+    qrcode_t qrcode = get_qrcode_from_codewords(qrcode_template, codewords, matrices, NULL);
+    free(matrices);
+    return qrcode;
+}
+
+/* Memory needed to generate qrcodes up to a version without heap allocations (see get_qrcode_workspace_size) */
+typedef struct qrcode_workspace {
+    unsigned int max_version;
+    /* Converted text (Kanji, ISO-8859-1) or mixed mode segmentation, placed right after the workspace */
+    char *conversion_buffer;
+    size_t conversion_buffer_size;
+    /* Data codewords followed by the correction codewords */
+    unsigned char codewords[QRCODE_MAX_CODEWORDS];
+    reed_solomon_encoder_t encoder;
+    qrcode_matrices_t matrices;
+} qrcode_workspace_t;
+
+/* Bytes needed by the converted text (or the mixed mode segmentation, 2 bytes per character) of qrcodes up to max_version */
+size_t get_conversion_buffer_size(unsigned int max_version) {
+    const correction_level_related_information_t *info = &QRCODE_INFO[max_version].correction_level_info[LOW];
+    size_t byte_capacity = info->character_capacity[BYTE];
+    size_t kanji_bytes = 2*info->character_capacity[KANJI];
+    size_t segmentation_bytes = 2*info->character_capacity[NUMERIC];
+    size_t conversion_bytes = byte_capacity > kanji_bytes ? byte_capacity : kanji_bytes;
+    return conversion_bytes > segmentation_bytes ? conversion_bytes : segmentation_bytes;
+}
+
+/* Bytes of memory needed by a workspace for qrcodes up to max_version [1-40] (0 if the version is not valid) */
+size_t get_qrcode_workspace_size(unsigned int max_version) {
+    if (max_version < 1 || max_version > QRCODE_VERSIONS)
+        return 0;
+    return sizeof(qrcode_workspace_t) + get_conversion_buffer_size(max_version);
+}
+
+/* Bytes needed by the modules of a qrcode up to max_version [1-40] (0 if the version is not valid) */
+size_t get_qrcode_buffer_size(unsigned int max_version) {
+    if (max_version < 1 || max_version > QRCODE_VERSIONS)
+        return 0;
+    size_t padded_qrcode_size = get_qrcode_size_with_padding(max_version);
+    return padded_qrcode_size * ((padded_qrcode_size + QRCODE_MATRIX_WORD_BITS - 1) / QRCODE_MATRIX_WORD_BITS) * sizeof(uint64_t);
+}
+
+/* Sets up a workspace in the given memory (get_qrcode_workspace_size(max_version) bytes, aligned as malloc memory) and builds the shared tables of all versions up to max_version, including the kanji conversion map.
+ * Returns NULL if the memory is too small or the tables can't be built. */
+qrcode_workspace_t *qrcode_workspace_init(void *memory, size_t memory_size, unsigned int max_version) {
+    size_t workspace_size = get_qrcode_workspace_size(max_version);
+    if (!memory || workspace_size == 0 || memory_size < workspace_size) { fprintf(stderr, "QRCODE ERROR: Input error, workspace too small\n"); return NULL; }
+
+    for (unsigned int version = 1; version <= max_version; version++) {
+        if (!get_version_template(version)) { fprintf(stderr, "QRCODE ERROR: Memory Error\n"); return NULL; }
+        for (int correction_level = LOW; correction_level <= HIGH; correction_level++) {
+            if (!get_placement_map(version, correction_level)) { fprintf(stderr, "QRCODE ERROR: Memory Error\n"); return NULL; }
+        }
+    }
+    if (!get_kanji_value_map()) { fprintf(stderr, "QRCODE ERROR: Memory Error\n"); return NULL; }
+
+    qrcode_workspace_t *workspace = memory;
+    workspace->max_version = max_version;
+    workspace->conversion_buffer = (char *) memory + sizeof(qrcode_workspace_t);
+    workspace->conversion_buffer_size = get_conversion_buffer_size(max_version);
+    return workspace;
+}
+
+/* Generates a QRCODE from the given template into destination (get_qrcode_buffer_size(max_version) bytes) using only the workspace memory: no heap allocations.
+ * The qrcode data is destination (it must not be freed with the qrcode); the version can't be greater than the workspace one.
+ * Masks are always evaluated on the calling thread: parallel_masks is ignored, as the mask pool is started with pthread_create, which allocates. */
+qrcode_t generate_qrcode_into(qrcode_template_t qrcode_template, qrcode_workspace_t *workspace, uint64_t destination[]) {
+    if (!workspace || !destination) { fprintf(stderr, "QRCODE ERROR: Input error, workspace or destination is NULL\n"); return QRCODE_INVALID; }
+    if (qrcode_template.version > workspace->max_version) { fprintf(stderr, "QRCODE ERROR: Input error, Version greater than the workspace one\n"); return QRCODE_INVALID; }
+    qrcode_template.parallel_masks = false;
+
+    if (!get_data_codewords(&qrcode_template, workspace->codewords, workspace->conversion_buffer, workspace->conversion_buffer_size))
+        return QRCODE_INVALID;
+    if (qrcode_template.version > workspace->max_version) {
+        fprintf(stderr, "QRCODE ERROR: Input too large: Version [%d] needed, workspace up to [%d]. Can't generate code...\n", qrcode_template.version, workspace->max_version);
+        return QRCODE_INVALID;
+    }
+
+    reed_solomon_encoder_init(&workspace->encoder, QRCODE_INFO[qrcode_template.version].correction_level_info[qrcode_template.correction_level].error_correction_codewords_per_block);
+    get_qrcode_correction_codewords(&qrcode_template, &workspace->encoder, workspace->codewords);
+
+    return get_qrcode_from_codewords(qrcode_template, workspace->codewords, &workspace->matrices, destination);
+}
+
+/* Number of symbols of a batch task: their codewords are kept in memory together and the correction codewords of the ones with the same shape are computed together */
+#define QRCODE_BATCH_TASK 32
+
+/* Memory used by a thread of generate_qrcode_batch */
+typedef struct qrcode_batch_scratch {
+    unsigned char codewords[QRCODE_BATCH_TASK][QRCODE_MAX_CODEWORDS];
+    qrcode_template_t templates[QRCODE_BATCH_TASK];
+    bool is_encoded[QRCODE_BATCH_TASK];
+    bool has_correction[QRCODE_BATCH_TASK];
+    int members[QRCODE_BATCH_TASK];
+    const unsigned char *messages[QRCODE_BATCH_TASK];
+    unsigned char *destinations[QRCODE_BATCH_TASK];
+    qrcode_matrices_t matrices;
+} qrcode_batch_scratch_t;
+
+/* Generates the qrcodes of a batch task (at most QRCODE_BATCH_TASK templates).
+ * The correction codewords of symbols with the same version and correction level are computed together, one block position of all of them at a time. */
+void generate_qrcode_batch_task(const qrcode_template_t templates[], int templates_number, qrcode_t results[], qrcode_batch_scratch_t *scratch) {
+    /* Data codewords of every symbol */
+    for (int i = 0; i < templates_number; i++) {
+        scratch->templates[i] = templates[i];
+        scratch->is_encoded[i] = get_data_codewords(&scratch->templates[i], scratch->codewords[i], NULL, 0);
+        scratch->has_correction[i] = false;
+    }
+
+    /* Correction codewords of every group of symbols with the same shape */
+    for (int i = 0; i < templates_number; i++) {
+        if (!scratch->is_encoded[i] || scratch->has_correction[i])
+            continue;
+
+        unsigned int version = scratch->templates[i].version;
+        enum CORRECTION_LEVEL correction_level = scratch->templates[i].correction_level;
+        int members_number = 0;
+        for (int j = i; j < templates_number; j++) {
+            if (scratch->is_encoded[j] && !scratch->has_correction[j] && scratch->templates[j].version == version && scratch->templates[j].correction_level == correction_level) {
+                scratch->members[members_number++] = j;
+                scratch->has_correction[j] = true;
+            }
+        }
+
+        const correction_level_related_information_t *info = &QRCODE_INFO[version].correction_level_info[correction_level];
+        reed_solomon_encoder_t encoder;
+        reed_solomon_encoder_init(&encoder, info->error_correction_codewords_per_block);
+
+        for (int block = 0; block < info->blocks_in_group1 + info->blocks_in_group2; block++) {
+            bool is_group1 = block < info->blocks_in_group1;
+            int message_offset = is_group1 ? block*info->data_codewords_per_block_in_group1 :
+                info->blocks_in_group1*info->data_codewords_per_block_in_group1 + (block - info->blocks_in_group1)*info->data_codewords_per_block_in_group2;
+            for (int m = 0; m < members_number; m++) {
+                scratch->messages[m] = scratch->codewords[scratch->members[m]] + message_offset;
+                scratch->destinations[m] = scratch->codewords[scratch->members[m]] + info->total_codewords + block*info->error_correction_codewords_per_block;
+            }
+            get_correction_words_batch(&encoder, scratch->messages,
+                    is_group1 ? info->data_codewords_per_block_in_group1 : info->data_codewords_per_block_in_group2,
+                    members_number, scratch->destinations);
+        }
+    }
+
+    for (int i = 0; i < templates_number; i++)
+        results[i] = scratch->is_encoded[i] ? get_qrcode_from_codewords(scratch->templates[i], scratch->codewords[i], &scratch->matrices, NULL) : QRCODE_INVALID;
+}
+
+/* Tasks of a batch worker: the worker takes them from the front, the other workers steal them from the back */
+typedef struct qrcode_batch_queue {
+#ifdef QRCODE_THREADS
+    pthread_mutex_t lock;
+#endif
+    size_t next_task;
+    size_t end_task;
+} qrcode_batch_queue_t;
+
+typedef struct qrcode_batch_job {
+    const qrcode_template_t *templates;
+    size_t templates_number;
+    qrcode_t *results;
+    int workers;
+    qrcode_batch_queue_t *queues;
+    qrcode_batch_scratch_t *scratches;
+} qrcode_batch_job_t;
+
+typedef struct qrcode_batch_worker {
+    qrcode_batch_job_t *job;
+    int id;
+} qrcode_batch_worker_t;
+
+/* Takes a task from the front (own queue) or from the back (stolen); returns false if the queue is empty */
+bool take_batch_task(qrcode_batch_queue_t *queue, bool is_stolen, size_t *task) {
+#ifdef QRCODE_THREADS
+    pthread_mutex_lock(&queue->lock);
+#endif
+    bool is_taken = queue->next_task < queue->end_task;
+    if (is_taken)
+        *task = is_stolen ? --queue->end_task : queue->next_task++;
+#ifdef QRCODE_THREADS
+    pthread_mutex_unlock(&queue->lock);
+#endif
+    return is_taken;
+}
+
+/* Runs the tasks of the worker's queue, then steals from the other queues until all of them are empty */
+void *run_batch_worker(void *argument) {
+    qrcode_batch_worker_t *worker = argument;
+    qrcode_batch_job_t *job = worker->job;
+    size_t task;
+    for (int victim = 0; victim < job->workers; victim++) {
+        qrcode_batch_queue_t *queue = &job->queues[(worker->id + victim) % job->workers];
+        while (take_batch_task(queue, victim != 0, &task)) {
+            size_t first = task*QRCODE_BATCH_TASK;
+            int templates_number = job->templates_number - first < QRCODE_BATCH_TASK ? job->templates_number - first : QRCODE_BATCH_TASK;
+            generate_qrcode_batch_task(job->templates + first, templates_number, job->results + first, &job->scratches[worker->id]);
+        }
+    }
+    return NULL;
+}
+
+/* Generates a QRCODE for every template: results[i] is the qrcode of templates[i] (invalid if it could not be generated).
+ * The symbols are shared out in tasks between 'threads' threads (the calling one included, 0 = one per online processor); a thread that runs out of tasks steals them from the others. */
+void generate_qrcode_batch(const qrcode_template_t templates[], size_t templates_number, qrcode_t results[], int threads) {
+    size_t tasks_number = (templates_number + QRCODE_BATCH_TASK - 1) / QRCODE_BATCH_TASK;
+#ifdef QRCODE_THREADS
+    if (threads <= 0)
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (threads <= 0)
+        threads = 1;
+#ifndef QRCODE_THREADS
+    threads = 1;
+#endif
+    if ((size_t) threads > tasks_number)
+        threads = tasks_number > 0 ? tasks_number : 1;
+
+    qrcode_batch_job_t job = {templates, templates_number, results, threads, NULL, NULL};
+    job.queues = malloc(sizeof(qrcode_batch_queue_t) * threads);
+    job.scratches = malloc(sizeof(qrcode_batch_scratch_t) * threads);
+    qrcode_batch_worker_t *workers = malloc(sizeof(qrcode_batch_worker_t) * threads);
+    if (!job.queues || !job.scratches || !workers) {
+        fprintf(stderr, "QRCODE ERROR: Memory Error\n");
+        for (size_t i = 0; i < templates_number; i++)
+            results[i] = QRCODE_INVALID;
+        free(job.queues);
+        free(job.scratches);
+        free(workers);
+        return;
+    }
+
+    /* Every worker starts with a contiguous range of tasks */
+    for (int i = 0; i < threads; i++) {
+#ifdef QRCODE_THREADS
+        pthread_mutex_init(&job.queues[i].lock, NULL);
+#endif
+        job.queues[i].next_task = tasks_number * i / threads;
+        job.queues[i].end_task = tasks_number * (i + 1) / threads;
+        workers[i] = (qrcode_batch_worker_t) {&job, i};
+    }
+
+#ifdef QRCODE_THREADS
+    /* Worker 0 is the calling thread; the tasks of a thread that could not be started are stolen by the others */
+    pthread_t *thread_ids = malloc(sizeof(pthread_t) * threads);
+    bool *is_started = calloc(threads, sizeof(bool));
+    if (thread_ids && is_started) {
+        for (int i = 1; i < threads; i++)
+            is_started[i] = pthread_create(&thread_ids[i], NULL, run_batch_worker, &workers[i]) == 0;
+    }
+    run_batch_worker(&workers[0]);
+    if (thread_ids && is_started) {
+        for (int i = 1; i < threads; i++) {
+            if (is_started[i])
+                pthread_join(thread_ids[i], NULL);
+        }
+    }
+    free(thread_ids);
+    free(is_started);
+    for (int i = 0; i < threads; i++)
+        pthread_mutex_destroy(&job.queues[i].lock);
+#else
+    run_batch_worker(&workers[0]);
+#endif
+
+    free(job.queues);
+    free(job.scratches);
+    free(workers);
+}
+
+/* Archive of qrcodes: a header, the records (a record header followed by the padded qrcode words, as in qrcode_t) and the offset of every record.
+ * The records are written one after the other, then the offsets; the header (rewritten at the end) tells where they are.
+ * Everything is in the byte order of the writer (checked with byte_order) and 8 bytes aligned, so a mapped archive can be used in place */
+#define QRCODE_ARCHIVE_MAGIC "QRCARCHV"
+#define QRCODE_ARCHIVE_FORMAT 1
+#define QRCODE_ARCHIVE_BYTE_ORDER 0x01020304
+#define QRCODE_ARCHIVE_BUFFER_SIZE (1 << 20)
+
+typedef struct qrcode_archive_header {
+    char magic[8];
+    uint32_t format;
+    uint32_t byte_order;
+    uint64_t records_number;
+    uint64_t offsets_position; /* from the start of the archive */
+} qrcode_archive_header_t;
+
+typedef struct qrcode_archive_record_header {
+    uint8_t version;
+    uint8_t correction_level;
+    uint8_t mask;
+    uint8_t negative;
+    uint32_t size;            /* side of the padded qrcode */
+    uint64_t payload_hash;    /* FNV-1a of the encoded text */
+} qrcode_archive_record_header_t;
+
+/* A record of a mapped archive: the qrcode data points into the archive (don't free it) */
+typedef struct qrcode_archive_record {
+    qrcode_t qrcode;
+    int version;
+    int correction_level;
+    int mask;
+    bool negative;
+    uint64_t payload_hash;
+} qrcode_archive_record_t;
+
+/* 64 bits FNV-1a hash of a text */
+uint64_t get_payload_hash(const char *text) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (; *text; text++) {
+        hash ^= (unsigned char) *text;
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+/* Reads the correction level and mask of a qrcode from its format information (and if its colors are inverted); returns false if it doesn't match any */
+bool get_qrcode_format(qrcode_t qrcode, int *correction_level, int *mask, bool *negative) {
+    int qrcode_size = qrcode.size - 2*QRCODE_PADDING;
+    *negative = get_qrcode_module(qrcode, 0, 0) == QRCODE_BLACK;
+    unsigned int format_bits = 0;
+    for (int i = 0; i < FORMAT_INFORMATION_BITS_SIZE; i++) {
+        int row, column;
+        get_format_information_position(qrcode_size, 0, i, &row, &column);
+        format_bits = (format_bits << 1) | (get_qrcode_module(qrcode, row + QRCODE_PADDING, column + QRCODE_PADDING) ^ *negative);
+    }
+    for (*correction_level = 0; *correction_level < CORRECTION_LEVELS; (*correction_level)++) {
+        for (*mask = 0; *mask < MASK_NUMBER; (*mask)++) {
+            if (FORMAT_INFORMATION_STRINGS[*correction_level][*mask] == format_bits)
+                return true;
+        }
+    }
+    return false;
+}
+
+/* Writer of an archive: records are appended through a large stdio buffer, their offsets are kept in memory until the end */
+typedef struct qrcode_archive_writer {
+    FILE *file;
+    uint64_t position;
+    uint64_t *offsets;
+    size_t records_number;
+    size_t offsets_capacity;
+    bool is_valid; /* false after an error (nothing more is written) */
+} qrcode_archive_writer_t;
+
+bool write_archive_bytes(qrcode_archive_writer_t *writer, const void *data, size_t size) {
+    if (writer->is_valid && fwrite(data, 1, size, writer->file) != size) {
+        fprintf(stderr, "QRCODE ERROR: Can't write the archive\n");
+        writer->is_valid = false;
+    }
+    writer->position += size;
+    return writer->is_valid;
+}
+
+/* Adds the offset of the next record (0 for an empty record) */
+bool add_archive_offset(qrcode_archive_writer_t *writer, uint64_t offset) {
+    if (writer->records_number == writer->offsets_capacity) {
+        size_t capacity = writer->offsets_capacity ? 2*writer->offsets_capacity : 1024;
+        uint64_t *offsets = realloc(writer->offsets, sizeof(uint64_t) * capacity);
+        if (!offsets) { fprintf(stderr, "QRCODE ERROR: Memory Error\n"); writer->is_valid = false; return false; }
+        writer->offsets = offsets;
+        writer->offsets_capacity = capacity;
+    }
+    writer->offsets[writer->records_number++] = offset;
+    return true;
+}
+
+/* Creates an archive file; returns false if it can't be opened */
+bool qrcode_archive_open(qrcode_archive_writer_t *writer, const char *file_name) {
+    *writer = (qrcode_archive_writer_t) {NULL, 0, NULL, 0, 0, true};
+    writer->file = fopen(file_name, "wb");
+    if (!writer->file) { fprintf(stderr, "QRCODE ERROR: Can't open output file %s\n", file_name); return false; }
+    setvbuf(writer->file, NULL, _IOFBF, QRCODE_ARCHIVE_BUFFER_SIZE);
+
+    /* Header placeholder, written again when the archive is closed */
+    qrcode_archive_header_t header = {{0}, 0, 0, 0, 0};
+    return write_archive_bytes(writer, &header, sizeof(header));
+}
+
+/* Appends a qrcode and the text it encodes; returns false if it can't be written */
+bool qrcode_archive_append(qrcode_archive_writer_t *writer, qrcode_t qrcode, const char *payload) {
+    if (!writer->is_valid)
+        return false;
+
+    qrcode_archive_record_header_t record = {0};
+    int correction_level, mask;
+    bool negative;
+    if (!is_qrcode_valid(qrcode) || !get_qrcode_format(qrcode, &correction_level, &mask, &negative)) { fprintf(stderr, "QRCODE ERROR: Input error, invalid qrcode\n"); return false; }
+    record.version = (qrcode.size - 2*QRCODE_PADDING - 17) / 4;
+    record.correction_level = correction_level;
+    record.mask = mask;
+    record.negative = negative;
+    record.size = qrcode.size;
+    record.payload_hash = payload ? get_payload_hash(payload) : 0;
+
+    if (!add_archive_offset(writer, writer->position))
+        return false;
+    write_archive_bytes(writer, &record, sizeof(record));
+    return write_archive_bytes(writer, qrcode.data, qrcode.size * qrcode.words_per_row * sizeof(uint64_t));
+}
+
+/* Appends an empty record, to keep the numbering of the records when a qrcode can't be generated */
+bool qrcode_archive_append_empty(qrcode_archive_writer_t *writer) {
+    return writer->is_valid && add_archive_offset(writer, 0);
+}
+
+/* Writes the offsets and the header, then closes the file; returns false if the archive is not complete */
+bool qrcode_archive_close(qrcode_archive_writer_t *writer) {
+    qrcode_archive_header_t header = {QRCODE_ARCHIVE_MAGIC, QRCODE_ARCHIVE_FORMAT, QRCODE_ARCHIVE_BYTE_ORDER, writer->records_number, writer->position};
+    write_archive_bytes(writer, writer->offsets, sizeof(uint64_t) * writer->records_number);
+    if (writer->is_valid && (fseek(writer->file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, writer->file) != 1)) {
+        fprintf(stderr, "QRCODE ERROR: Can't write the archive\n");
+        writer->is_valid = false;
+    }
+    if (fclose(writer->file) != 0 && writer->is_valid) {
+        fprintf(stderr, "QRCODE ERROR: Can't write the archive\n");
+        writer->is_valid = false;
+    }
+    free(writer->offsets);
+    writer->offsets = NULL;
+    return writer->is_valid;
+}
+
+/* Archive in memory (usually mapped) */
+typedef struct qrcode_archive {
+    const unsigned char *data;
+    size_t size;
+    uint64_t records_number;
+    const uint64_t *offsets;
+} qrcode_archive_t;
+
+/* Checks an archive in memory (8 bytes aligned) and sets up the reader; returns false if it is not a complete archive of this byte order */
+bool qrcode_archive_from_memory(qrcode_archive_t *archive, const void *data, size_t size) {
+    const qrcode_archive_header_t *header = data;
+    if (size < sizeof(qrcode_archive_header_t) || memcmp(header->magic, QRCODE_ARCHIVE_MAGIC, sizeof(header->magic)) ||
+            header->format != QRCODE_ARCHIVE_FORMAT || header->byte_order != QRCODE_ARCHIVE_BYTE_ORDER ||
+            header->offsets_position % sizeof(uint64_t) != 0 || header->offsets_position > size || header->records_number > (size - header->offsets_position) / sizeof(uint64_t)) {
+        fprintf(stderr, "QRCODE ERROR: Input error, not a valid archive\n");
+        return false;
+    }
+    archive->data = data;
+    archive->size = size;
+    archive->records_number = header->records_number;
+    archive->offsets = (const uint64_t *) (archive->data + header->offsets_position);
+    return true;
+}
+
+/* Gets a record of the archive without copying it; returns false if it doesn't exist, is empty or is damaged */
+bool qrcode_archive_get(const qrcode_archive_t *archive, size_t record_number, qrcode_archive_record_t *record) {
+    if (record_number >= archive->records_number) { fprintf(stderr, "QRCODE ERROR: Input error, record %zu not in the archive\n", record_number); return false; }
+
+    uint64_t offset = archive->offsets[record_number];
+    if (offset == 0) { fprintf(stderr, "QRCODE ERROR: Record %zu is empty\n", record_number); return false; }
+    if (offset % sizeof(uint64_t) != 0 || offset > archive->size || archive->size - offset < sizeof(qrcode_archive_record_header_t)) { fprintf(stderr, "QRCODE ERROR: Input error, damaged archive\n"); return false; }
+    const qrcode_archive_record_header_t *header = (const qrcode_archive_record_header_t *) (archive->data + offset);
+
+    /* The fields of the record are checked like the ones of a template, and its matrix must lie inside the archive */
+    if (header->version < 1 || header->version > QRCODE_VERSIONS || header->correction_level >= CORRECTION_LEVELS || header->mask >= MASK_NUMBER ||
+            header->size != (uint32_t) get_qrcode_size_with_padding(header->version)) { fprintf(stderr, "QRCODE ERROR: Input error, damaged archive\n"); return false; }
+    size_t words_per_row = (header->size + QRCODE_MATRIX_WORD_BITS - 1) / QRCODE_MATRIX_WORD_BITS;
+    if (header->size * words_per_row * sizeof(uint64_t) > archive->size - offset - sizeof(qrcode_archive_record_header_t)) { fprintf(stderr, "QRCODE ERROR: Input error, damaged archive\n"); return false; }
+
+    record->qrcode.data = (uint64_t *) (header + 1);
+    record->qrcode.size = header->size;
+    record->qrcode.words_per_row = words_per_row;
+    record->version = header->version;
+    record->correction_level = header->correction_level;
+    record->mask = header->mask;
+    record->negative = header->negative;
+    record->payload_hash = header->payload_hash;
+    return true;
+}
+
+#ifdef QRCODE_MMAP
+/* Maps an archive file in memory (read only); returns false if it can't be mapped or is not valid */
+bool qrcode_archive_map(qrcode_archive_t *archive, const char *file_name) {
+    int file = open(file_name, O_RDONLY);
+    if (file < 0) { fprintf(stderr, "QRCODE ERROR: Can't open archive %s\n", file_name); return false; }
+
+    struct stat file_status;
+    void *data = MAP_FAILED;
+    if (fstat(file, &file_status) == 0 && file_status.st_size > 0)
+        data = mmap(NULL, file_status.st_size, PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    if (data == MAP_FAILED) { fprintf(stderr, "QRCODE ERROR: Can't map archive %s\n", file_name); return false; }
+
+    if (!qrcode_archive_from_memory(archive, data, file_status.st_size)) {
+        munmap(data, file_status.st_size);
+        return false;
+    }
+    return true;
+}
+
+void qrcode_archive_unmap(qrcode_archive_t *archive) {
+    munmap((void *) archive->data, archive->size);
+    archive->data = NULL;
+    archive->offsets = NULL;
+    archive->records_number = 0;
+}
+#endif
+
 #endif
 #endif
@@ -0,0 +1,126 @@
+/* Differential test of the mask penalty: compute_qrcode_penalty (packed rows) against a module by module scorer,
+ * for every version, correction level and mask, on random and uniform codewords */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#define ENABLE_QRCODE_LIB
+#include "../qrcode_generator.h"
+
+#define RANDOM_FILLS 4
+
+/* Scores the penalty of a matrix one module at a time, as in the ISO standard */
+unsigned int compute_reference_penalty(const qrcode_matrix_t *qrcode) {
+    int qrcode_size = qrcode->size;
+    unsigned int penalty = 0;
+
+    /* Penalty 1: 5 or more modules of the same color in a row or in a column */
+    for (int direction = 0; direction < 2; direction++) {
+        for (int i = 0; i < qrcode_size; i++) {
+            int same_color_counter = 0;
+            bool current_value = QRCODE_WHITE;
+            for (int j = 0; j < qrcode_size; j++) {
+                bool value = direction == 0 ? get_matrix_module(qrcode->value, qrcode->words_per_row, i, j) : get_matrix_module(qrcode->value, qrcode->words_per_row, j, i);
+                if (j > 0 && value == current_value) {
+                    same_color_counter++;
+                } else {
+                    if (same_color_counter >= 5)
+                        penalty += same_color_counter - 2;
+                    current_value = value;
+                    same_color_counter = 1;
+                }
+            }
+            if (same_color_counter >= 5)
+                penalty += same_color_counter - 2;
+        }
+    }
+
+    /* Penalty 2: blocks of 2x2 modules of the same color */
+    for (int i = 0; i < qrcode_size - 1; i++) {
+        for (int j = 0; j < qrcode_size - 1; j++) {
+            bool value = get_matrix_module(qrcode->value, qrcode->words_per_row, i, j);
+            if (value == get_matrix_module(qrcode->value, qrcode->words_per_row, i, j + 1) &&
+                    value == get_matrix_module(qrcode->value, qrcode->words_per_row, i + 1, j) &&
+                    value == get_matrix_module(qrcode->value, qrcode->words_per_row, i + 1, j + 1))
+                penalty += 3;
+        }
+    }
+
+    /* Penalty 3: patterns BWBBBWBWWWW or WWWWBWBBBWB in rows or columns (the last possible position is not checked, as in the original scorer) */
+    const int PENALTY_PATTERN_SIZE = 11;
+    const char penalty_pattern1[] = {QRCODE_BLACK, QRCODE_WHITE, QRCODE_BLACK, QRCODE_BLACK, QRCODE_BLACK, QRCODE_WHITE, QRCODE_BLACK, QRCODE_WHITE, QRCODE_WHITE, QRCODE_WHITE, QRCODE_WHITE};
+    const char penalty_pattern2[] = {QRCODE_WHITE, QRCODE_WHITE, QRCODE_WHITE, QRCODE_WHITE, QRCODE_BLACK, QRCODE_WHITE, QRCODE_BLACK, QRCODE_BLACK, QRCODE_BLACK, QRCODE_WHITE, QRCODE_BLACK};
+    for (int direction = 0; direction < 2; direction++) {
+        for (int i = 0; i < qrcode_size; i++) {
+            for (int j = 0; j < qrcode_size - PENALTY_PATTERN_SIZE; j++) {
+                bool is_pattern1 = true, is_pattern2 = true;
+                for (int p = 0; p < PENALTY_PATTERN_SIZE; p++) {
+                    bool value = direction == 0 ? get_matrix_module(qrcode->value, qrcode->words_per_row, i, j + p) : get_matrix_module(qrcode->value, qrcode->words_per_row, j + p, i);
+                    is_pattern1 = is_pattern1 && value == penalty_pattern1[p];
+                    is_pattern2 = is_pattern2 && value == penalty_pattern2[p];
+                }
+                penalty += 40*is_pattern1 + 40*is_pattern2;
+            }
+        }
+    }
+
+    /* Penalty 4: ratio between black and white modules */
+    int black_counter = 0;
+    for (int i = 0; i < qrcode_size; i++) {
+        for (int j = 0; j < qrcode_size; j++)
+            black_counter += get_matrix_module(qrcode->value, qrcode->words_per_row, i, j) == QRCODE_BLACK;
+    }
+    int black_ratio = floor(((double) black_counter / (qrcode_size*qrcode_size)) * 100);
+    int candidate1 = abs(black_ratio - (black_ratio % 5) - 50);
+    int candidate2 = abs(black_ratio + (5 - (black_ratio % 5)) - 50);
+    penalty += candidate1 < candidate2 ? candidate1*2 : candidate2*2;
+
+    return penalty;
+}
+
+/* xorshift32, so that the codewords are the same on every platform */
+unsigned int get_random(unsigned int *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+int main() {
+    static qrcode_matrix_t unmasked_qrcode, masked_qrcode;
+    unsigned char codewords[QRCODE_MAX_CODEWORDS];
+    unsigned int random_state = 2463534242u;
+    int symbols = 0, mismatches = 0;
+
+    for (int version = 1; version <= QRCODE_VERSIONS; version++) {
+        const version_template_t *version_template = get_version_template(version);
+        if (!version_template) { fprintf(stderr, "penalty_test: Memory Error\n"); return 1; }
+        for (int correction_level = 0; correction_level < CORRECTION_LEVELS; correction_level++) {
+            const correction_level_related_information_t *info = &QRCODE_INFO[version].correction_level_info[correction_level];
+            int final_codewords = info->total_codewords + info->error_correction_codewords_per_block*(info->blocks_in_group1 + info->blocks_in_group2);
+            const unsigned short *placement_map = get_placement_map(version, correction_level);
+            if (!placement_map) { fprintf(stderr, "penalty_test: Memory Error\n"); return 1; }
+
+            /* Random codewords, then all white and all black ones (long runs and many 2x2 blocks once masked) */
+            for (int fill = 0; fill < RANDOM_FILLS + 2; fill++) {
+                for (int i = 0; i < final_codewords; i++)
+                    codewords[i] = fill < RANDOM_FILLS ? get_random(&random_state) : (fill == RANDOM_FILLS ? 0x00 : 0xFF);
+                populate_qrcode(&unmasked_qrcode, codewords, final_codewords, placement_map, version_template);
+
+                for (int mask = 0; mask < MASK_NUMBER; mask++) {
+                    apply_mask(&masked_qrcode, &unmasked_qrcode, version_template, correction_level, mask);
+                    unsigned int penalty = compute_qrcode_penalty(&masked_qrcode);
+                    unsigned int reference_penalty = compute_reference_penalty(&masked_qrcode);
+                    symbols++;
+                    if (penalty != reference_penalty) {
+                        if (mismatches++ < 10)
+                            printf("penalty_test: version %d level %d fill %d mask %d: penalty %u, reference %u\n", version, correction_level, fill, mask, penalty, reference_penalty);
+                    }
+                }
+            }
+        }
+    }
+
+    printf("penalty_test: %d symbols, %d mismatches\n", symbols, mismatches);
+    return mismatches ? 1 : 0;
+}
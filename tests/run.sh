@@ -0,0 +1,37 @@
+#!/bin/sh
+# Builds and runs the tests: sh tests/run.sh (CC and CFLAGS can be set)
+cd "$(dirname "$0")" || exit 1
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O2 -Wall}
+build=$(mktemp -d) || exit 1
+trap 'rm -rf "$build"' EXIT
+
+failed=0
+run_test() {
+    name=$1
+    shift
+    if ! $CC $CFLAGS "$name.c" -o "$build/$name" "$@"; then
+        echo "$name: BUILD FAILED"
+        failed=1
+    elif ! "$build/$name"; then
+        echo "$name: FAILED"
+        failed=1
+    fi
+}
+
+# Tests comparing with iconv (that the library doesn't use): skipped if iconv is missing, linked with -liconv where it is not in the C library
+run_iconv_test() {
+    name=$1
+    shift
+    if $CC $CFLAGS "$name.c" -o "$build/$name" "$@" 2>/dev/null || $CC $CFLAGS "$name.c" -o "$build/$name" "$@" -liconv 2>/dev/null; then
+        "$build/$name" || { echo "$name: FAILED"; failed=1; }
+    else
+        echo "$name: skipped (iconv not available)"
+    fi
+}
+
+run_test penalty_test -pthread -lm
+run_test workspace_test -fno-builtin-malloc -fno-builtin-calloc -fno-builtin-realloc -pthread -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+run_iconv_test transcoder_test -pthread
+
+exit $failed
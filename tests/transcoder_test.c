@@ -0,0 +1,129 @@
+/* convert_text against iconv, for Shift JIS and ISO-8859-1: every code point, long ASCII runs and random byte strings (invalid and truncated UTF-8 too).
+ * Needs iconv, that the library doesn't use: gcc tests/transcoder_test.c -pthread (-liconv on some systems) */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iconv.h>
+#define ENABLE_QRCODE_LIB
+#include "../qrcode_generator.h"
+
+#define RANDOM_STRINGS 200000
+#define RANDOM_STRING_MAX_SIZE 24
+#define ASCII_RUN_MAX_SIZE 200
+#define OUTPUT_MAX_SIZE 512
+
+const char *ICONV_CHARSET_NAMES[] = {"SHIFT-JIS", "ISO-8859-1"};
+iconv_t converters[2];
+int mismatches = 0;
+
+/* Converts with iconv up to the first character that can't be converted (convert_text stops there too); returns the converted bytes */
+size_t convert_text_with_iconv(enum CHARSET charset, const char text[], size_t bytes, char destination[]) {
+    char *input = (char *) text, *output = destination;
+    size_t input_bytes = bytes, output_bytes = OUTPUT_MAX_SIZE;
+    iconv(converters[charset], NULL, NULL, NULL, NULL);
+    iconv(converters[charset], &input, &input_bytes, &output, &output_bytes);
+    return OUTPUT_MAX_SIZE - output_bytes;
+}
+
+/* Compares the two conversions of a text in both charsets, counting the differences */
+void check_text(const char text[], size_t bytes, const char *description, unsigned long value) {
+    for (int charset = CHARSET_SHIFT_JIS; charset <= CHARSET_ISO_8859_1; charset++) {
+        char expected[OUTPUT_MAX_SIZE], converted[OUTPUT_MAX_SIZE];
+        char *buffer = converted;
+        size_t capacity = sizeof(converted);
+        size_t expected_bytes = convert_text_with_iconv(charset, text, bytes, expected);
+        size_t converted_bytes = convert_text(charset, text, bytes, &buffer, &capacity, false);
+        if ((converted_bytes != expected_bytes || memcmp(converted, expected, expected_bytes)) && mismatches++ < 10)
+            printf("transcoder_test: %s %s %lX: iconv %zu bytes, convert_text %zu bytes\n", ICONV_CHARSET_NAMES[charset], description, value, expected_bytes, converted_bytes);
+    }
+}
+
+/* Writes a code point in UTF-8; returns its bytes */
+size_t write_utf8(unsigned long code_point, char destination[]) {
+    if (code_point < 0x80) {
+        destination[0] = code_point;
+        return 1;
+    }
+    if (code_point < 0x800) {
+        destination[0] = 0xC0 | code_point >> 6;
+        destination[1] = 0x80 | (code_point & 0x3F);
+        return 2;
+    }
+    if (code_point < 0x10000) {
+        destination[0] = 0xE0 | code_point >> 12;
+        destination[1] = 0x80 | ((code_point >> 6) & 0x3F);
+        destination[2] = 0x80 | (code_point & 0x3F);
+        return 3;
+    }
+    destination[0] = 0xF0 | code_point >> 18;
+    destination[1] = 0x80 | ((code_point >> 12) & 0x3F);
+    destination[2] = 0x80 | ((code_point >> 6) & 0x3F);
+    destination[3] = 0x80 | (code_point & 0x3F);
+    return 4;
+}
+
+/* xorshift32, so that the strings are the same on every platform */
+unsigned int get_random(unsigned int *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+int main() {
+    for (int charset = CHARSET_SHIFT_JIS; charset <= CHARSET_ISO_8859_1; charset++) {
+        converters[charset] = iconv_open(ICONV_CHARSET_NAMES[charset], "UTF-8");
+        if (converters[charset] == (iconv_t) -1) { printf("transcoder_test: iconv can't convert to %s\n", ICONV_CHARSET_NAMES[charset]); return 1; }
+    }
+
+    /* Every code point (surrogates are not valid UTF-8), between ASCII characters */
+    unsigned long code_points = 0;
+    for (unsigned long code_point = 1; code_point <= 0x10FFFF; code_point++) {
+        if (code_point >= 0xD800 && code_point <= 0xDFFF)
+            continue;
+        char text[8];
+        size_t bytes = 0;
+        text[bytes++] = 'a';
+        bytes += write_utf8(code_point, text + bytes);
+        text[bytes++] = 'b';
+        check_text(text, bytes, "code point", code_point);
+        code_points++;
+    }
+
+    /* ASCII runs of every length up to the vector kernels several times over, ended by a Latin-1, a kanji or an invalid character */
+    const char *RUN_ENDS[] = {"\xC3\xA9", "\xE6\xBC\xA2", "\xFF", ""};
+    for (size_t run = 0; run <= ASCII_RUN_MAX_SIZE; run++) {
+        for (int end = 0; end < 4; end++) {
+            char text[ASCII_RUN_MAX_SIZE + 8];
+            for (size_t i = 0; i < run; i++)
+                text[i] = ' ' + (i*31) % 95;
+            size_t bytes = run + strlen(RUN_ENDS[end]);
+            memcpy(text + run, RUN_ENDS[end], strlen(RUN_ENDS[end]));
+            text[bytes++] = 'z';
+            check_text(text, bytes, "ascii run", run);
+        }
+    }
+
+    /* Random byte strings, biased towards lead and continuation bytes */
+    unsigned int random_state = 2463534242u;
+    for (int s = 0; s < RANDOM_STRINGS; s++) {
+        char text[RANDOM_STRING_MAX_SIZE];
+        size_t bytes = get_random(&random_state) % RANDOM_STRING_MAX_SIZE;
+        for (size_t i = 0; i < bytes; i++) {
+            unsigned int random = get_random(&random_state);
+            switch (random % 6) {
+                case 0: text[i] = 0x20 + (random >> 8) % 0x5F; break;
+                case 1: case 4: text[i] = 0x80 + (random >> 8) % 0x40; break;
+                case 2: text[i] = 0xC0 + (random >> 8) % 0x40; break;
+                case 3: text[i] = 0xE0 + (random >> 8) % 0x20; break;
+                default: text[i] = 1 + (random >> 8) % 255; break;
+            }
+        }
+        check_text(text, bytes, "random string", s);
+    }
+
+    printf("transcoder_test: %lu code points, %d ascii runs, %d random strings, %d mismatches\n", code_points, 4*(ASCII_RUN_MAX_SIZE + 1), RANDOM_STRINGS, mismatches);
+    for (int charset = CHARSET_SHIFT_JIS; charset <= CHARSET_ISO_8859_1; charset++)
+        iconv_close(converters[charset]);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,109 @@
+/* generate_qrcode_into gives the same qrcodes as generate_qrcode without any heap allocation (malloc, calloc and realloc are counted through the linker)
+ * gcc tests/workspace_test.c -fno-builtin-malloc -fno-builtin-calloc -fno-builtin-realloc -pthread -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+ * (the allocation builtins are disabled, so that no allocation is optimized away) */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define ENABLE_QRCODE_LIB
+#include "../qrcode_generator.h"
+
+#define TEXT_MAX_SIZE 8000
+
+/* Heap allocations made while counting */
+long allocations = 0;
+bool is_counting = false;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t number, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    allocations += is_counting;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t number, size_t size) {
+    allocations += is_counting;
+    return __real_calloc(number, size);
+}
+
+void *__wrap_realloc(void *pointer, size_t size) {
+    allocations += is_counting;
+    return __real_realloc(pointer, size);
+}
+
+/* Writes characters of the alphabet (whole UTF-8 characters) into text, until it holds 'characters' of them */
+void fill_text(char text[], const char *alphabet[], int alphabet_size, size_t characters) {
+    size_t bytes = 0;
+    for (size_t i = 0; i < characters; i++) {
+        const char *character = alphabet[(i*7 + i/3) % alphabet_size];
+        size_t character_bytes = strlen(character);
+        memcpy(text + bytes, character, character_bytes);
+        bytes += character_bytes;
+    }
+    text[bytes] = '\0';
+}
+
+int main() {
+    const char *DIGITS[] = {"0", "1", "2", "3", "4", "5", "6", "7", "8", "9"};
+    const char *ALPHANUMERICS[] = {"A", "B", "Q", "Z", "0", "7", " ", "$", "%", "*", "+", "-", ".", "/", ":"};
+    const char *LATIN1[] = {"a", "q", "z", "{", "~", "\xC3\xA9", "\xC3\xBC", "\xC2\xA3"};
+    const char *KANJIS[] = {"\xE6\xBC\xA2", "\xE5\xAD\x97", "\xE6\x97\xA5", "\xE6\x9C\xAC", "\xE8\xAA\x9E", "\xE3\x81\x82", "\xE3\x82\xA2", "\xEF\xBC\xA1"};
+    const char *MIXED_CHARACTERS[] = {"1", "2", "3", "4", "5", "6", "A", "B", ":", "\xE6\xBC\xA2", "\xE5\xAD\x97", "a"};
+
+    size_t workspace_size = get_qrcode_workspace_size(QRCODE_VERSIONS);
+    size_t buffer_size = get_qrcode_buffer_size(QRCODE_VERSIONS);
+    void *memory = malloc(workspace_size);
+    uint64_t *destination = malloc(buffer_size);
+    qrcode_workspace_t *workspace = qrcode_workspace_init(memory, workspace_size, QRCODE_VERSIONS);
+    if (!workspace || !destination) { fprintf(stderr, "workspace_test: Memory Error\n"); return 1; }
+
+    static char text[TEXT_MAX_SIZE];
+    int symbols = 0, mismatches = 0;
+    for (unsigned int version = 1; version <= QRCODE_VERSIONS; version++) {
+        for (int correction_level = LOW; correction_level <= HIGH; correction_level++) {
+            const size_t *capacity = QRCODE_INFO[version].correction_level_info[correction_level].character_capacity;
+            for (int encoding_mode = NUMERIC; encoding_mode <= ENCODING_AUTO; encoding_mode++) {
+                qrcode_template_t qrcode_template = QRCODE_TEMPLATE_DEFAULT;
+                qrcode_template.text = text;
+                qrcode_template.correction_level = correction_level;
+                qrcode_template.encoding_mode = encoding_mode;
+                qrcode_template.version = (version + encoding_mode) % 3 ? version : VERSION_ANY;
+                qrcode_template.mask = (version + correction_level) % 4 ? MASK_ANY : (int) (version % MASK_NUMBER);
+                qrcode_template.mask_strategy = qrcode_template.mask == MASK_ANY ? (version % 2 ? MASK_EXACT : MASK_APPROXIMATE) : MASK_FIXED;
+                qrcode_template.negative = version % 5 == 0;
+                qrcode_template.parallel_masks = version % 3 == 0;
+
+                /* Texts that fill the version in their mode (mixed text is cut to fit even if it were all kanji) */
+                switch (encoding_mode) {
+                    case NUMERIC: fill_text(text, DIGITS, 10, capacity[NUMERIC]); break;
+                    case ALPHANUMERIC: fill_text(text, ALPHANUMERICS, 15, capacity[ALPHANUMERIC]); break;
+                    case BYTE:
+                        qrcode_template.iso = version % 2 == 0;
+                        fill_text(text, LATIN1, qrcode_template.iso ? 8 : 5, capacity[BYTE]);
+                        break;
+                    case KANJI: fill_text(text, KANJIS, 8, capacity[KANJI]); break;
+                    case MIXED: fill_text(text, MIXED_CHARACTERS, 12, capacity[KANJI]*3/4); break;
+                    default: fill_text(text, ALPHANUMERICS, 15, capacity[ALPHANUMERIC]); break;
+                }
+
+                qrcode_t expected = generate_qrcode(qrcode_template);
+                is_counting = true;
+                qrcode_t qrcode = generate_qrcode_into(qrcode_template, workspace, destination);
+                is_counting = false;
+                symbols++;
+                if (!is_qrcode_valid(expected) || !is_qrcode_valid(qrcode) || qrcode.size != expected.size ||
+                        memcmp(qrcode.data, expected.data, expected.size*expected.words_per_row*sizeof(uint64_t))) {
+                    if (mismatches++ < 10)
+                        printf("workspace_test: version %u level %d mode %d: different qrcode\n", version, correction_level, encoding_mode);
+                }
+                free(expected.data);
+            }
+        }
+    }
+
+    printf("workspace_test: %d symbols, %d mismatches, %ld allocations in generate_qrcode_into\n", symbols, mismatches, allocations);
+    free(destination);
+    free(memory);
+    return mismatches || allocations ? 1 : 0;
+}